@@ -0,0 +1,117 @@
+#version 430
+precision highp float;
+layout(local_size_x = 256) in;
+
+// Refits the BVH at binding 8 to the triangles at bindings 9 and 16 without touching the
+// topology. Pass 0 rebuilds the parent links and clears the visit flags, pass 1
+// fits every leaf, refreshes its intersection triangles at binding 17 and merges
+// the bounds up to the root.
+#define PASS_LINKS 0
+#define PASS_BOUNDS 1
+
+uniform int u_pass;
+uniform uint u_nodeCount;
+
+// BVH Node structure (must match CPU side)
+struct BVHNode {
+	vec3 minBounds;
+	uint leftChild;     // 0 means leaf node
+	vec3 maxBounds;
+	uint triangleCount; // For leaf: triangle count, for internal: right child
+	uint triangleOffset; // For leaf: offset into triangle array
+	uint padding[3];
+};
+
+// Deduplicated mesh vertex (must match MeshVertex on the CPU side)
+struct OBJVertex {
+	vec4 positionU;
+	vec4 normalV;
+};
+
+layout(std430, binding = 8) coherent buffer OBJBVHBuffer
+{
+	BVHNode objBvhNodes[];
+};
+
+// Indexed triangles: xyz = vertices in objVertices, w = material index
+layout(std430, binding = 9) readonly buffer OBJTriangleBuffer
+{
+	uvec4 objTriangles[];
+};
+
+layout(std430, binding = 16) readonly buffer OBJVertexBuffer
+{
+	OBJVertex objVertices[];
+};
+
+struct OBJIntersectTriangle {
+	vec4 v0;
+	vec4 edge1;
+	vec4 edge2;
+};
+
+layout(std430, binding = 17) writeonly buffer OBJIntersectionBuffer
+{
+	OBJIntersectTriangle objIntersectTriangles[];
+};
+
+layout(std430, binding = 12) buffer BVHParentBuffer
+{
+	uint parents[];
+};
+
+layout(std430, binding = 13) buffer BVHVisitBuffer
+{
+	uint visits[];
+};
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= u_nodeCount) return;
+
+	uint leftChild = objBvhNodes[index].leftChild;
+
+	if (u_pass == PASS_LINKS) {
+		visits[index] = 0u;
+		if (leftChild != 0u) {
+			parents[leftChild] = index;
+			parents[objBvhNodes[index].triangleCount] = index;
+		}
+		return;
+	}
+
+	if (leftChild != 0u) return;
+
+	// Leaf
+	uint first = objBvhNodes[index].triangleOffset;
+	uint count = objBvhNodes[index].triangleCount;
+	vec3 minBounds = vec3(1e30);
+	vec3 maxBounds = vec3(-1e30);
+	for (uint i = first; i < first + count; i++) {
+		uvec4 tri = objTriangles[i];
+		vec3 v0 = objVertices[tri.x].positionU.xyz;
+		vec3 v1 = objVertices[tri.y].positionU.xyz;
+		vec3 v2 = objVertices[tri.z].positionU.xyz;
+		minBounds = min(minBounds, min(v0, min(v1, v2)));
+		maxBounds = max(maxBounds, max(v0, max(v1, v2)));
+		objIntersectTriangles[i] = OBJIntersectTriangle(vec4(v0, 0.0), vec4(v1 - v0, 0.0), vec4(v2 - v0, 0.0));
+	}
+	objBvhNodes[index].minBounds = minBounds;
+	objBvhNodes[index].maxBounds = maxBounds;
+	memoryBarrierBuffer();
+
+	// The first child to arrive stops, the second one sees both children finished
+	uint slot = index;
+	while (slot != 0u) {
+		uint parent = parents[slot];
+		if (atomicAdd(visits[parent], 1u) == 0u) return;
+
+		uint left = objBvhNodes[parent].leftChild;
+		uint right = objBvhNodes[parent].triangleCount;
+		objBvhNodes[parent].minBounds = min(objBvhNodes[left].minBounds, objBvhNodes[right].minBounds);
+		objBvhNodes[parent].maxBounds = max(objBvhNodes[left].maxBounds, objBvhNodes[right].maxBounds);
+		memoryBarrierBuffer();
+		slot = parent;
+	}
+}
@@ -5,8 +5,19 @@ layout(local_size_x = 8, local_size_y = 8) in;
 layout(rgba32f, binding = 0) uniform image2D img_input;
 layout(rgba32f, binding = 3) uniform image2D img_output;
 
-uniform int game_window_x;
-uniform int game_window_y;
+// Per-frame values, written once per frame by FrameUniformBuffer (must match FrameUniforms on the CPU)
+layout(std140, binding = 0) uniform FrameUniforms {
+	vec3 cameraPos;
+	float iTime;
+	vec3 cameraFwd;
+	float iFrame;
+	vec3 cameraUp;
+	float u_fov;
+	vec3 cameraRight;
+	float game_window_x;
+	vec3 cameraMov;
+	float game_window_y;
+};
 
 
 vec3 LessThan(vec3 f, float value)
@@ -0,0 +1,230 @@
+#version 430
+precision highp float;
+layout(local_size_x = 256) in;
+
+// GPU linear BVH build (Karras 2012), run as a sequence of passes selected by u_pass.
+// Writes the same BVHNode layout traversed by pathtracing_compute.glsl. Leaves hold
+// one triangle and point straight at its index in the triangle buffer, so the
+// triangles do not have to be reordered after the build.
+#define PASS_MORTON 0    // one 30 bit Morton code per triangle centroid
+#define PASS_SORT 1      // one bitonic merge step (u_sortSize, u_sortStride)
+#define PASS_HIERARCHY 2 // internal nodes, leaves and parent links
+#define PASS_BOUNDS 3    // leaf bounds merged bottom-up with atomic visit flags
+#define PASS_DEPTH 4     // depth of the deepest leaf into visits[u_triangleCount - 1]
+
+uniform int u_pass;
+uniform uint u_triangleCount;
+uniform uint u_paddedCount;  // triangle count rounded up to a power of two for the sort
+uniform uint u_sortSize;
+uniform uint u_sortStride;
+uniform vec3 u_sceneMin;
+uniform vec3 u_sceneMax;
+
+// BVH Node structure (must match CPU side)
+struct BVHNode {
+	vec3 minBounds;
+	uint leftChild;     // 0 means leaf node
+	vec3 maxBounds;
+	uint triangleCount; // For leaf: triangle count, for internal: right child
+	uint triangleOffset; // For leaf: offset into triangle array
+	uint padding[3];
+};
+
+// Deduplicated mesh vertex (must match MeshVertex on the CPU side)
+struct OBJVertex {
+	vec4 positionU;
+	vec4 normalV;
+};
+
+layout(std430, binding = 8) coherent buffer OBJBVHBuffer
+{
+	BVHNode objBvhNodes[];
+};
+
+// Indexed triangles: xyz = vertices in objVertices, w = material index
+layout(std430, binding = 9) readonly buffer OBJTriangleBuffer
+{
+	uvec4 objTriangles[];
+};
+
+layout(std430, binding = 16) readonly buffer OBJVertexBuffer
+{
+	OBJVertex objVertices[];
+};
+
+// x = Morton code, y = triangle index
+layout(std430, binding = 11) buffer LBVHMortonBuffer
+{
+	uvec2 mortonCodes[];
+};
+
+layout(std430, binding = 12) buffer LBVHParentBuffer
+{
+	uint parents[];
+};
+
+layout(std430, binding = 13) buffer LBVHVisitBuffer
+{
+	uint visits[];
+};
+
+uint expandBits(uint v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+uint mortonCode(vec3 p)
+{
+	vec3 extent = max(u_sceneMax - u_sceneMin, vec3(1e-20));
+	uvec3 q = uvec3(clamp((p - u_sceneMin) / extent * 1024.0, vec3(0.0), vec3(1023.0)));
+	return (expandBits(q.x) << 2) | (expandBits(q.y) << 1) | expandBits(q.z);
+}
+
+// Length of the common prefix of keys i and j, equal keys are told apart by their index
+int delta(int i, int j)
+{
+	if (j < 0 || j >= int(u_triangleCount)) return -1;
+	uint a = mortonCodes[i].x;
+	uint b = mortonCodes[j].x;
+	if (a == b) return 32 + 31 - findMSB(uint(i ^ j));
+	return 31 - findMSB(a ^ b);
+}
+
+void emitNodes(uint index)
+{
+	int n = int(u_triangleCount);
+	int leafBase = n - 1;
+
+	// Leaf
+	BVHNode leaf;
+	leaf.minBounds = vec3(0.0);
+	leaf.maxBounds = vec3(0.0);
+	leaf.leftChild = 0u;
+	leaf.triangleCount = 1u;
+	leaf.triangleOffset = mortonCodes[index].y;
+	leaf.padding[0] = leaf.padding[1] = leaf.padding[2] = 0u;
+	objBvhNodes[leafBase + int(index)] = leaf;
+
+	if (int(index) >= n - 1) {
+		// No internal node has this visit flag, PASS_DEPTH keeps its result there
+		visits[index] = 0u;
+		return;
+	}
+
+	// Internal node: direction and length of its key range
+	int i = int(index);
+	int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+	int deltaMin = delta(i, i - d);
+
+	int lMax = 2;
+	while (delta(i, i + lMax * d) > deltaMin) lMax *= 2;
+	int l = 0;
+	for (int t = lMax / 2; t >= 1; t /= 2) {
+		if (delta(i, i + (l + t) * d) > deltaMin) l += t;
+	}
+	int j = i + l * d;
+
+	// Split position
+	int deltaNode = delta(i, j);
+	int s = 0;
+	int t = l;
+	do {
+		t = (t + 1) / 2;
+		if (delta(i, i + (s + t) * d) > deltaNode) s += t;
+	} while (t > 1);
+	int split = i + s * d + min(d, 0);
+
+	uint left = min(i, j) == split ? uint(leafBase + split) : uint(split);
+	uint right = max(i, j) == split + 1 ? uint(leafBase + split + 1) : uint(split + 1);
+
+	objBvhNodes[i].leftChild = left;
+	objBvhNodes[i].triangleCount = right; // Store right child index
+	objBvhNodes[i].triangleOffset = 0u;
+	parents[left] = uint(i);
+	parents[right] = uint(i);
+	visits[i] = 0u;
+}
+
+void mergeBounds(uint index)
+{
+	uint slot = u_triangleCount - 1u + index;
+	uvec4 tri = objTriangles[objBvhNodes[slot].triangleOffset];
+	vec3 v0 = objVertices[tri.x].positionU.xyz;
+	vec3 v1 = objVertices[tri.y].positionU.xyz;
+	vec3 v2 = objVertices[tri.z].positionU.xyz;
+	objBvhNodes[slot].minBounds = min(v0, min(v1, v2));
+	objBvhNodes[slot].maxBounds = max(v0, max(v1, v2));
+	memoryBarrierBuffer();
+
+	// The first child to arrive stops, the second one sees both children finished
+	while (slot != 0u) {
+		uint parent = parents[slot];
+		if (atomicAdd(visits[parent], 1u) == 0u) return;
+
+		uint left = objBvhNodes[parent].leftChild;
+		uint right = objBvhNodes[parent].triangleCount;
+		objBvhNodes[parent].minBounds = min(objBvhNodes[left].minBounds, objBvhNodes[right].minBounds);
+		objBvhNodes[parent].maxBounds = max(objBvhNodes[left].maxBounds, objBvhNodes[right].maxBounds);
+		memoryBarrierBuffer();
+		slot = parent;
+	}
+}
+
+void measureDepth(uint index)
+{
+	uint slot = u_triangleCount - 1u + index;
+	uint depth = 0u;
+	while (slot != 0u) {
+		slot = parents[slot];
+		depth++;
+	}
+	atomicMax(visits[u_triangleCount - 1u], depth);
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+
+	if (u_pass == PASS_MORTON) {
+		if (index >= u_paddedCount) return;
+		if (index >= u_triangleCount) {
+			// Padding sorts behind every real triangle
+			mortonCodes[index] = uvec2(0xFFFFFFFFu);
+			return;
+		}
+		uvec4 tri = objTriangles[index];
+		vec3 center = (objVertices[tri.x].positionU.xyz + objVertices[tri.y].positionU.xyz +
+			objVertices[tri.z].positionU.xyz) / 3.0;
+		mortonCodes[index] = uvec2(mortonCode(center), index);
+	}
+	else if (u_pass == PASS_SORT) {
+		if (index >= u_paddedCount) return;
+		uint partner = index ^ u_sortStride;
+		if (partner <= index) return;
+
+		uvec2 a = mortonCodes[index];
+		uvec2 b = mortonCodes[partner];
+		bool ascending = (index & u_sortSize) == 0u;
+		bool greater = a.x > b.x || (a.x == b.x && a.y > b.y);
+		if (greater == ascending) {
+			mortonCodes[index] = b;
+			mortonCodes[partner] = a;
+		}
+	}
+	else if (u_pass == PASS_HIERARCHY) {
+		if (index >= u_triangleCount) return;
+		emitNodes(index);
+	}
+	else if (u_pass == PASS_BOUNDS) {
+		if (index >= u_triangleCount) return;
+		mergeBounds(index);
+	}
+	else if (u_pass == PASS_DEPTH) {
+		if (index >= u_triangleCount) return;
+		measureDepth(index);
+	}
+}
@@ -1,25 +1,96 @@
 #version 430
 precision highp float;
-layout(local_size_x = 8, local_size_y = 8) in;
 
 layout(rgba32f, binding = 0) uniform image2D img_output;
 
 uniform vec3 camera;
-uniform float iTime;
-uniform float iFrame;
 uniform vec3 sphereX;
-uniform float game_window_x;
-uniform float game_window_y;
 uniform vec2 iMouse;
 uniform float angleX;
 uniform float angleY;
 
 uniform int test_int;
-uniform float u_fov;
 uniform int scene_object_count;
+uniform int bvh_layout; // one of BVH_LAYOUT_*, only read when BVH_LAYOUT is -1
+
+#define BVH_LAYOUT_BINARY 0
+#define BVH_LAYOUT_WIDE4 1
+#define BVH_LAYOUT_WIDE8 2
+#define BVH_LAYOUT_COMPRESSED 3
+
+// Compile-time options. The engine injects its own values in a #define preamble
+// (PathTracerVariant), these defaults apply when a define is missing.
+#ifndef SCENE
+#define SCENE 8
+#endif
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES 2
+#endif
+#ifndef SAMPLES_PER_DISPATCH
+#define SAMPLES_PER_DISPATCH 1
+#endif
+// 0 compiles the refraction and absorption paths out of ShadeHit
+#ifndef HAS_REFRACTION
+#define HAS_REFRACTION 1
+#endif
+// One of BVH_LAYOUT_* to build a single traversal in, -1 to switch on bvh_layout at runtime
+#ifndef BVH_LAYOUT
+#define BVH_LAYOUT -1
+#endif
+// 1 counts rays, node visits, leaf and triangle tests and stack overflows into the
+// TraversalStatsBuffer and writes a heatmap to img_stats
+#ifndef TRAVERSAL_STATS
+#define TRAVERSAL_STATS 0
+#endif
+// 0 builds the megakernel main(), one of WAVEFRONT_PASS_* a pass of the wavefront mode
+// (WavefrontPathTracer). WAVEFRONT_MATERIAL picks the material type a shade pass handles.
+#define WAVEFRONT_PASS_GENERATE 1
+#define WAVEFRONT_PASS_EXTEND 2
+#define WAVEFRONT_PASS_SHADE 3
+#define WAVEFRONT_PASS_ACCUMULATE 4
+#define WAVEFRONT_PASS_DISPATCH 5
+#ifndef WAVEFRONT_PASS
+#define WAVEFRONT_PASS 0
+#endif
+#ifndef WAVEFRONT_MATERIAL
+#define WAVEFRONT_MATERIAL 0
+#endif
+#define WAVEFRONT_GROUP_SIZE 64
+// 1 builds the megakernel main() as persistent threads (PersistentPathTracer): only enough
+// workgroups to fill the GPU are launched and they pull tiles from PersistentWork until the
+// image is done. Not combined with TRAVERSAL_STATS.
+#ifndef PERSISTENT_THREADS
+#define PERSISTENT_THREADS 0
+#endif
+
+#if WAVEFRONT_PASS == 0
+layout(local_size_x = 8, local_size_y = 8) in;
+#elif WAVEFRONT_PASS == WAVEFRONT_PASS_DISPATCH
+layout(local_size_x = 1) in;
+#else
+layout(local_size_x = WAVEFRONT_GROUP_SIZE) in;
+#endif
+
+#if BVH_LAYOUT >= 0
+#define ACTIVE_BVH_LAYOUT BVH_LAYOUT
+#else
+#define ACTIVE_BVH_LAYOUT bvh_layout
+#endif
 
 uniform bool w_press;
-uniform vec3 cameraPos, cameraFwd, cameraUp, cameraRight, cameraMov;
+// Per-frame values, written once per frame by FrameUniformBuffer (must match FrameUniforms on the CPU)
+layout(std140, binding = 0) uniform FrameUniforms {
+	vec3 cameraPos;
+	float iTime;
+	vec3 cameraFwd;
+	float iFrame;
+	vec3 cameraUp;
+	float u_fov;
+	vec3 cameraRight;
+	float game_window_x;
+	vec3 cameraMov;
+	float game_window_y;
+};
 //layout(binding = 6) uniform samplerCube skybox;
 layout(binding = 7) uniform sampler2D equirectangularMap;
 layout(binding = 5) uniform sampler3D world;
@@ -31,28 +102,43 @@ struct BVHNode {
 	vec3 maxBounds;
 	uint triangleCount; // For leaf: triangle count, for internal: right child
 	uint triangleOffset; // For leaf: offset into triangle array
-	uint padding[3];     // Align to 64 bytes
+	uint padding[3];     // Pads the node to 48 bytes
 };
 
-// Triangle structure (must match CPU side exactly)
-struct OBJTriangle {
-	// Vertex 0
-	vec3 v0_pos;
-	vec3 v0_normal;
-	vec2 v0_texCoord;
-
-	// Vertex 1
-	vec3 v1_pos;
-	vec3 v1_normal;
-	vec2 v1_texCoord;
-
-	// Vertex 2
-	vec3 v2_pos;
-	vec3 v2_normal;
-	vec2 v2_texCoord;
-
-	uint materialIndex;
-	uint padding[3]; // For alignment
+// Four children of a wide BVH node, a BVH8 node is two consecutive packets (must match CPU side)
+struct WideBVHPacket {
+	vec4 minX, minY, minZ;
+	vec4 maxX, maxY, maxZ;
+	uvec4 child; // internal: wide node index, leaf: first triangle
+	uvec4 count; // 0 = internal, >0 = leaf triangle count, WIDE_BVH_EMPTY = unused
+};
+
+#define WIDE_BVH_EMPTY 0xFFFFFFFFu
+
+// 32-byte binary node with 8-bit quantized child boxes, children at child and child + 1 (must match CPU side).
+// Leaf records keep the first triangle in child and the triangle count in exponents.
+struct CompressedBVHNode {
+	vec3 origin;
+	uint exponents; // biased exponent x, y, z in bytes 0-2, flags in byte 3
+	uvec3 quantized; // left lo xyz, left hi xyz, right lo xyz, right hi xyz, one byte each
+	uint child;
+};
+
+#define COMPRESSED_BVH_LEFT_LEAF 1u
+#define COMPRESSED_BVH_RIGHT_LEAF 2u
+#define COMPRESSED_BVH_RIGHT_EMPTY 4u
+
+// Deduplicated mesh vertex (must match MeshVertex on the CPU side), texture coordinate in the w components
+struct OBJVertex {
+	vec4 positionU;
+	vec4 normalV;
+};
+
+// Intersection-ready triangle (must match IntersectionTriangle on the CPU side), read by the leaf loop
+struct OBJIntersectTriangle {
+	vec4 v0;
+	vec4 edge1;
+	vec4 edge2;
 };
 
 // Material structure (must match CPU side)
@@ -81,9 +167,21 @@ layout(std430, binding = 8) buffer OBJBVHBuffer
 	BVHNode objBvhNodes[];
 };
 
+// Indexed triangles in BVH order: xyz = vertices in objVertices, w = material index
 layout(std430, binding = 9) buffer OBJTriangleBuffer
 {
-	OBJTriangle objTriangles[];
+	uvec4 objTriangles[];
+};
+
+layout(std430, binding = 16) buffer OBJVertexBuffer
+{
+	OBJVertex objVertices[];
+};
+
+// Same order as objTriangles, only the positions in v0/edge form
+layout(std430, binding = 17) buffer OBJIntersectionBuffer
+{
+	OBJIntersectTriangle objIntersectTriangles[];
 };
 
 layout(std430, binding = 10) buffer OBJMaterialBuffer
@@ -91,14 +189,68 @@ layout(std430, binding = 10) buffer OBJMaterialBuffer
 	OBJMaterial objMaterials[];
 };
 
+layout(std430, binding = 14) buffer OBJWideBVHBuffer
+{
+	WideBVHPacket objWideBvhPackets[];
+};
+
+layout(std430, binding = 15) buffer OBJCompressedBVHBuffer
+{
+	CompressedBVHNode objCompressedBvhNodes[];
+};
 
-#define SCENE 8
 
 layout(std430, binding = 4) buffer layoutName
 {
 	float data_SSBO[];
 };
 
+#if TRAVERSAL_STATS
+// Must match TraversalCounters in traversal_stats.h. Histograms count rays by node visits
+// and triangle tests, bucket 0 holds rays with none and bucket k those with [2^(k-1), 2^k)
+#define STATS_HISTOGRAM_BUCKETS 32
+layout(std430, binding = 18) buffer TraversalStatsBuffer
+{
+	uint statRays;
+	uint statNodeVisits;
+	uint statLeafTests;
+	uint statTriangleTests;
+	uint statStackDrops;
+	uint statPadding[3];
+	uint statNodeHistogram[STATS_HISTOGRAM_BUCKETS];
+	uint statTriangleHistogram[STATS_HISTOGRAM_BUCKETS];
+};
+
+layout(rgba32f, binding = 1) uniform image2D img_stats;
+uniform int stats_heatmap;     // 0 shows node visits, 1 triangle tests
+uniform int stats_heatmap_max; // count shown at the hot end of the ramp
+
+// Counted per invocation, then summed in shared memory so each work group
+// touches the global counters once
+uint pixelRays;
+uint pixelNodeVisits;
+uint pixelLeafTests;
+uint pixelTriangleTests;
+uint pixelStackDrops;
+
+shared uint groupCounters[5];
+shared uint groupNodeHistogram[STATS_HISTOGRAM_BUCKETS];
+shared uint groupTriangleHistogram[STATS_HISTOGRAM_BUCKETS];
+
+uint statsBucket(uint count) {
+	return count == 0u ? 0u : min(uint(findMSB(count)) + 1u, uint(STATS_HISTOGRAM_BUCKETS - 1));
+}
+
+vec3 heatColor(float heat) {
+	heat = clamp(heat, 0.0, 1.0);
+	return clamp(vec3(heat * 3.0 - 1.0, sin(heat * 3.14159265), 1.0 - heat * 2.0), 0.0, 1.0);
+}
+
+#define COUNT_STAT(counter) counter++
+#else
+#define COUNT_STAT(counter)
+#endif
+
 
 // The minimunm distance a ray must travel before we consider an intersection.
 // This is to prevent a ray from intersecting a surface it just bounced off of.
@@ -116,7 +268,7 @@ const float c_exposure = 1.0f;
 const float c_rayPosNormalNudge = 0.00001f;
 
 // how many renders per frame - to get around the vsync limitation.
-const int c_numRendersPerFrame = 1;
+const int c_numRendersPerFrame = SAMPLES_PER_DISPATCH;
 const float c_minCameraAngle = 0.01f;
 const float c_maxCameraAngle = (c_pi - 0.01f);
 vec3 c_cameraAt = camera;
@@ -242,17 +394,15 @@ bool rayBoxIntersect(vec3 rayOrigin, vec3 rayDir, vec3 minBounds, vec3 maxBounds
 }
 
 // Triangle intersection with barycentric coordinates
-bool objTriangleIntersect(vec3 rayOrigin, vec3 rayDir, OBJTriangle tri,
-	inout float t, inout vec3 normal, inout vec2 texCoord, inout uint matIndex) {
-	vec3 edge1 = tri.v1_pos - tri.v0_pos;
-	vec3 edge2 = tri.v2_pos - tri.v0_pos;
+bool objTriangleIntersect(vec3 rayOrigin, vec3 rayDir, vec3 v0, vec3 edge1, vec3 edge2,
+	inout float t, inout vec2 barycentric) {
 	vec3 h = cross(rayDir, edge2);
 	float a = dot(edge1, h);
 
 	if (a > -0.00001 && a < 0.00001) return false;
 
 	float f = 1.0 / a;
-	vec3 s = rayOrigin - tri.v0_pos;
+	vec3 s = rayOrigin - v0;
 	float u = f * dot(s, h);
 	
 	if (u < 0.0 || u > 1.0) return false;
@@ -266,26 +416,62 @@ bool objTriangleIntersect(vec3 rayOrigin, vec3 rayDir, OBJTriangle tri,
 
 	if (dist > 0.000001 && dist < t) {
 		t = dist;
-
-		//normalize(cross(v1v0, v2v0));
-		// Interpolate normal using barycentric coordinates
-		float w = 1.0 - u - v;
-		//normal = normalize(w * tri.v0_normal + u * tri.v1_normal + v * tri.v2_normal);
-		normal = normalize(cross(edge1, edge2));
-		// Interpolate texture coordinates
-		texCoord = w * tri.v0_texCoord + u * tri.v1_texCoord + v * tri.v2_texCoord;
-		//texCoord = vec2(0.0, 0.0);
-		matIndex = tri.materialIndex;
+		barycentric = vec2(u, v);
 		return true;
 	}
 
 	return false;
 }
 
+// Surface of the closest hit, fetched once after traversal
+void getOBJSurface(uint triIndex, vec2 barycentric, out vec3 normal, out vec2 texCoord, out uint matIndex) {
+	uvec4 tri = objTriangles[triIndex];
+	OBJVertex v0 = objVertices[tri.x];
+	OBJVertex v1 = objVertices[tri.y];
+	OBJVertex v2 = objVertices[tri.z];
+
+	float u = barycentric.x;
+	float v = barycentric.y;
+	float w = 1.0 - u - v;
+	//normal = normalize(w * v0.normalV.xyz + u * v1.normalV.xyz + v * v2.normalV.xyz);
+	normal = normalize(cross(v1.positionU.xyz - v0.positionU.xyz, v2.positionU.xyz - v0.positionU.xyz));
+	// Interpolate texture coordinates
+	texCoord = w * vec2(v0.positionU.w, v0.normalV.w) + u * vec2(v1.positionU.w, v1.normalV.w) +
+		v * vec2(v2.positionU.w, v2.normalV.w);
+	matIndex = tri.w;
+}
 
 
-// BVH traversal using a stack
-bool traverseOBJBVH(vec3 rayOrigin, vec3 rayDir, inout SRayHitInfo hitInfo) {
+
+// Tests triangles [first, first + count) and keeps the closest hit
+bool intersectOBJLeaf(vec3 rayOrigin, vec3 rayDir, uint first, uint count, inout SRayHitInfo hitInfo,
+	inout uint bestTriangle, inout vec2 bestBarycentric) {
+	COUNT_STAT(pixelLeafTests);
+	bool hit = false;
+	for (uint i = 0; i < count; i++) {
+		uint triIndex = first + i;
+		if (triIndex >= objIntersectTriangles.length()) continue;
+		COUNT_STAT(pixelTriangleTests);
+
+		OBJIntersectTriangle tri = objIntersectTriangles[triIndex];
+		vec2 barycentric;
+		float t = hitInfo.dist;
+
+		if (objTriangleIntersect(rayOrigin, rayDir, tri.v0.xyz, tri.edge1.xyz, tri.edge2.xyz, t, barycentric)) {
+			if (t < hitInfo.dist && t > c_minimumRayHitTime) {
+				hitInfo.dist = t;
+				bestTriangle = triIndex;
+				bestBarycentric = barycentric;
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+
+// Binary BVH traversal using a stack
+bool traverseOBJBinaryBVH(vec3 rayOrigin, vec3 rayDir, inout SRayHitInfo hitInfo,
+	inout uint bestTriangle, inout vec2 bestBarycentric) {
 	if (objBvhNodes.length() == 0) return false;
 
 	bool hit = false;
@@ -295,16 +481,13 @@ bool traverseOBJBVH(vec3 rayOrigin, vec3 rayDir, inout SRayHitInfo hitInfo) {
 	int stackPtr = 0;
 	stack[stackPtr++] = 0; // Start with root node
 
-	vec3 bestNormal;
-	vec2 bestTexCoord;
-	uint bestMaterialIndex = 0;
-
 	while (stackPtr > 0) {
 		uint nodeIndex = stack[--stackPtr];
 
 		if (nodeIndex >= objBvhNodes.length()) continue;
 
 		BVHNode node = objBvhNodes[nodeIndex];
+		COUNT_STAT(pixelNodeVisits);
 
 		// Test ray against bounding box
 		if (!rayBoxIntersect(rayOrigin, rayDir, node.minBounds, node.maxBounds, hitInfo.dist)) {
@@ -313,39 +496,250 @@ bool traverseOBJBVH(vec3 rayOrigin, vec3 rayDir, inout SRayHitInfo hitInfo) {
 
 		if (node.leftChild == 0) {
 			// Leaf node - test triangles
-			for (uint i = 0; i < node.triangleCount; i++) {
-				uint triIndex = node.triangleOffset + i;
-				if (triIndex >= objTriangles.length()) continue;
-
-				vec3 normal;
-				vec2 texCoord;
-				uint matIndex;
-				float t = hitInfo.dist;
-
-				if (objTriangleIntersect(rayOrigin, rayDir, objTriangles[triIndex], t, normal, texCoord, matIndex)) {
-					if (t < hitInfo.dist && t > c_minimumRayHitTime) {
-						hitInfo.dist = t;
-						bestNormal = normal;
-						bestTexCoord = texCoord;
-						bestMaterialIndex = matIndex;
-						hit = true;
-					}
-				}
+			if (intersectOBJLeaf(rayOrigin, rayDir, node.triangleOffset, node.triangleCount, hitInfo,
+				bestTriangle, bestBarycentric)) {
+				hit = true;
 			}
 		}
 		else {
 			// Internal node - add children to stack
-			uint leftChild = node.leftChild; // Convert from 1-based to 0-based
+			uint leftChild = node.leftChild;
 			uint rightChild = node.triangleCount; // Right child stored in triangleCount
 
 			if (stackPtr < 30) { // Leave room for both children
 				stack[stackPtr++] = rightChild;
 				stack[stackPtr++] = leftChild;
 			}
+			else {
+				COUNT_STAT(pixelStackDrops);
+			}
 		}
 	}
 
+	return hit;
+}
+
+// Wide BVH traversal: every fetch tests the boxes of all children of a node,
+// leaf children are intersected right away and internal ones pushed far to near
+bool traverseOBJWideBVH(vec3 rayOrigin, vec3 rayDir, inout SRayHitInfo hitInfo,
+	inout uint bestTriangle, inout vec2 bestBarycentric) {
+	if (objWideBvhPackets.length() == 0) return false;
+
+	bool hit = false;
+	vec3 invDir = 1.0 / rayDir;
+	uint packetsPerNode = ACTIVE_BVH_LAYOUT == BVH_LAYOUT_WIDE8 ? 2u : 1u;
+
+	// Entry distance is kept so nodes behind a closer hit found later are skipped
+	uint stack[32];
+	float stackDist[32];
+	int stackPtr = 0;
+	stack[stackPtr] = 0;
+	stackDist[stackPtr++] = 0.0;
+
+	while (stackPtr > 0) {
+		--stackPtr;
+		if (stackDist[stackPtr] >= hitInfo.dist) continue;
+		uint nodeIndex = stack[stackPtr];
+		COUNT_STAT(pixelNodeVisits);
+
+		// Internal children that were hit, sorted by distance, farthest first
+		uint hitChild[8];
+		float hitDist[8];
+		int hitCount = 0;
+
+		for (uint p = 0; p < packetsPerNode; p++) {
+			WideBVHPacket packet = objWideBvhPackets[nodeIndex * packetsPerNode + p];
+
+			vec4 t0x = (packet.minX - rayOrigin.x) * invDir.x;
+			vec4 t1x = (packet.maxX - rayOrigin.x) * invDir.x;
+			vec4 t0y = (packet.minY - rayOrigin.y) * invDir.y;
+			vec4 t1y = (packet.maxY - rayOrigin.y) * invDir.y;
+			vec4 t0z = (packet.minZ - rayOrigin.z) * invDir.z;
+			vec4 t1z = (packet.maxZ - rayOrigin.z) * invDir.z;
+
+			vec4 tnear = max(max(min(t0x, t1x), min(t0y, t1y)), min(t0z, t1z));
+			vec4 tfar = min(min(max(t0x, t1x), max(t0y, t1y)), max(t0z, t1z));
+
+			for (int c = 0; c < 4; c++) {
+				if (packet.count[c] == WIDE_BVH_EMPTY) continue;
+				if (tnear[c] > tfar[c] || tfar[c] <= 0.0 || tnear[c] >= hitInfo.dist) continue;
+
+				if (packet.count[c] > 0u) {
+					// Leaf child
+					if (intersectOBJLeaf(rayOrigin, rayDir, packet.child[c], packet.count[c], hitInfo,
+						bestTriangle, bestBarycentric)) {
+						hit = true;
+					}
+				}
+				else {
+					int k = hitCount++;
+					while (k > 0 && hitDist[k - 1] < tnear[c]) {
+						hitChild[k] = hitChild[k - 1];
+						hitDist[k] = hitDist[k - 1];
+						k--;
+					}
+					hitChild[k] = packet.child[c];
+					hitDist[k] = tnear[c];
+				}
+			}
+		}
+
+		// Nearest child ends up on top of the stack. Without room for all of them the
+		// farthest are dropped, not the nearest.
+		int dropped = max(hitCount - (32 - stackPtr), 0);
+		for (int k = 0; k < dropped; k++) {
+			COUNT_STAT(pixelStackDrops);
+		}
+		for (int k = dropped; k < hitCount; k++) {
+			stack[stackPtr] = hitChild[k];
+			stackDist[stackPtr++] = hitDist[k];
+		}
+	}
+
+	return hit;
+}
+
+// Compressed BVH traversal: both child boxes are decoded from the parent's
+// origin and exponents, leaf children are intersected right away
+bool traverseOBJCompressedBVH(vec3 rayOrigin, vec3 rayDir, inout SRayHitInfo hitInfo,
+	inout uint bestTriangle, inout vec2 bestBarycentric) {
+	if (objCompressedBvhNodes.length() == 0) return false;
+
+	bool hit = false;
+	vec3 invDir = 1.0 / rayDir;
+
+	uint stack[32];
+	float stackDist[32];
+	int stackPtr = 0;
+	stack[stackPtr] = 0;
+	stackDist[stackPtr++] = 0.0;
+
+	while (stackPtr > 0) {
+		--stackPtr;
+		if (stackDist[stackPtr] >= hitInfo.dist) continue;
+
+		CompressedBVHNode node = objCompressedBvhNodes[stack[stackPtr]];
+		COUNT_STAT(pixelNodeVisits);
+
+		// 2^(e - 127) built straight from the exponent bits
+		vec3 scale = vec3(uintBitsToFloat((node.exponents & 0xFFu) << 23),
+			uintBitsToFloat(((node.exponents >> 8) & 0xFFu) << 23),
+			uintBitsToFloat(((node.exponents >> 16) & 0xFFu) << 23));
+		uint flags = node.exponents >> 24;
+
+		uvec4 q0 = (uvec4(node.quantized.x) >> uvec4(0, 8, 16, 24)) & 0xFFu;
+		uvec4 q1 = (uvec4(node.quantized.y) >> uvec4(0, 8, 16, 24)) & 0xFFu;
+		uvec4 q2 = (uvec4(node.quantized.z) >> uvec4(0, 8, 16, 24)) & 0xFFu;
+
+		vec3 leftMin = node.origin + vec3(q0.xyz) * scale;
+		vec3 leftMax = node.origin + vec3(q0.w, q1.xy) * scale;
+		vec3 rightMin = node.origin + vec3(q1.zw, q2.x) * scale;
+		vec3 rightMax = node.origin + vec3(q2.yzw) * scale;
+
+		// Slab test for both children
+		vec3 t0 = (leftMin - rayOrigin) * invDir;
+		vec3 t1 = (leftMax - rayOrigin) * invDir;
+		vec3 tmin = min(t0, t1);
+		vec3 tmax = max(t0, t1);
+		float leftNear = max(max(tmin.x, tmin.y), tmin.z);
+		float leftFar = min(min(tmax.x, tmax.y), tmax.z);
+		bool hitLeft = leftNear <= leftFar && leftFar > 0.0 && leftNear < hitInfo.dist;
+
+		t0 = (rightMin - rayOrigin) * invDir;
+		t1 = (rightMax - rayOrigin) * invDir;
+		tmin = min(t0, t1);
+		tmax = max(t0, t1);
+		float rightNear = max(max(tmin.x, tmin.y), tmin.z);
+		float rightFar = min(min(tmax.x, tmax.y), tmax.z);
+		bool hitRight = (flags & COMPRESSED_BVH_RIGHT_EMPTY) == 0u &&
+			rightNear <= rightFar && rightFar > 0.0 && rightNear < hitInfo.dist;
+
+		uint leftIndex = node.child;
+		uint rightIndex = node.child + 1u;
+
+		// Leaf children
+		if (hitLeft && (flags & COMPRESSED_BVH_LEFT_LEAF) != 0u) {
+			CompressedBVHNode leaf = objCompressedBvhNodes[leftIndex];
+			if (intersectOBJLeaf(rayOrigin, rayDir, leaf.child, leaf.exponents, hitInfo,
+				bestTriangle, bestBarycentric)) {
+				hit = true;
+			}
+			hitLeft = false;
+		}
+		if (hitRight && (flags & COMPRESSED_BVH_RIGHT_LEAF) != 0u) {
+			CompressedBVHNode leaf = objCompressedBvhNodes[rightIndex];
+			if (intersectOBJLeaf(rayOrigin, rayDir, leaf.child, leaf.exponents, hitInfo,
+				bestTriangle, bestBarycentric)) {
+				hit = true;
+			}
+			hitRight = false;
+		}
+
+		// Internal children, the nearer one is popped first. With room for one only the
+		// farther one is dropped.
+		if (hitLeft && hitRight) {
+			bool leftFirst = leftNear <= rightNear;
+			if (stackPtr < 31) {
+				stack[stackPtr] = leftFirst ? rightIndex : leftIndex;
+				stackDist[stackPtr++] = leftFirst ? rightNear : leftNear;
+			}
+			else {
+				COUNT_STAT(pixelStackDrops);
+			}
+			if (stackPtr < 32) {
+				stack[stackPtr] = leftFirst ? leftIndex : rightIndex;
+				stackDist[stackPtr++] = leftFirst ? leftNear : rightNear;
+			}
+			else {
+				COUNT_STAT(pixelStackDrops);
+			}
+		}
+		else if (hitLeft || hitRight) {
+			if (stackPtr < 32) {
+				stack[stackPtr] = hitLeft ? leftIndex : rightIndex;
+				stackDist[stackPtr++] = hitLeft ? leftNear : rightNear;
+			}
+			else {
+				COUNT_STAT(pixelStackDrops);
+			}
+		}
+	}
+
+	return hit;
+}
+
+// Closest OBJ hit through the BVH layout selected by BVH_LAYOUT or bvh_layout
+bool traverseOBJBVH(vec3 rayOrigin, vec3 rayDir, inout SRayHitInfo hitInfo) {
+	uint bestTriangle = 0;
+	vec2 bestBarycentric = vec2(0.0);
+
+#if TRAVERSAL_STATS
+	uint nodeVisitsBefore = pixelNodeVisits;
+	uint triangleTestsBefore = pixelTriangleTests;
+#endif
+
+	bool hit;
+	if (ACTIVE_BVH_LAYOUT == BVH_LAYOUT_WIDE4 || ACTIVE_BVH_LAYOUT == BVH_LAYOUT_WIDE8) {
+		hit = traverseOBJWideBVH(rayOrigin, rayDir, hitInfo, bestTriangle, bestBarycentric);
+	}
+	else if (ACTIVE_BVH_LAYOUT == BVH_LAYOUT_COMPRESSED) {
+		hit = traverseOBJCompressedBVH(rayOrigin, rayDir, hitInfo, bestTriangle, bestBarycentric);
+	}
+	else {
+		hit = traverseOBJBinaryBVH(rayOrigin, rayDir, hitInfo, bestTriangle, bestBarycentric);
+	}
+
+#if TRAVERSAL_STATS
+	pixelRays++;
+	atomicAdd(groupNodeHistogram[statsBucket(pixelNodeVisits - nodeVisitsBefore)], 1u);
+	atomicAdd(groupTriangleHistogram[statsBucket(pixelTriangleTests - triangleTestsBefore)], 1u);
+#endif
+
 	if (hit) {
+		vec3 bestNormal;
+		vec2 bestTexCoord;
+		uint bestMaterialIndex;
+		getOBJSurface(bestTriangle, bestBarycentric, bestNormal, bestTexCoord, bestMaterialIndex);
 		hitInfo.normal = bestNormal;
 
 		// Apply material properties
@@ -1076,6 +1470,123 @@ if (RayGridIntersect(rayPos, rayDir, hitInfo, vec3(data_SSBO[0], data_SSBO[1], d
 	*/
 }
 
+// One bounce at a hit: absorption, the pick between a diffuse, specular or refracted ray, the
+// next ray, emission and Russian roulette. Returns false when the path ends. Shared by
+// GetColorForRay and the wavefront shade pass.
+bool ShadeHit(inout vec3 rayPos, inout vec3 rayDir, in SRayHitInfo hitInfo, inout vec3 throughput, inout vec3 ret, inout uint rngState)
+{
+#if HAS_REFRACTION
+	// do absorption if we are hitting from inside the object
+	if (hitInfo.fromInside)
+		throughput *= exp(-hitInfo.material.refractionColor * hitInfo.dist);
+#endif
+
+	// get the pre-fresnel chances
+	float specularChance = hitInfo.material.specularChance;
+#if HAS_REFRACTION
+	float refractionChance = hitInfo.material.refractionChance;
+#else
+	float refractionChance = 0.0f;
+#endif
+
+	float diffuseChance = max(0.0f, 1.0f - (refractionChance + specularChance));
+
+	// take fresnel into account for specularChance and adjust other chances.
+	// specular takes priority.
+	// chanceMultiplier makes sure we keep diffuse / refraction ratio the same.
+	float rayProbability = 1.0f;
+	if (specularChance > 0.0f)
+	{
+		specularChance = FresnelReflectAmount(
+			hitInfo.fromInside ? hitInfo.material.IOR : 1.0,
+			!hitInfo.fromInside ? hitInfo.material.IOR : 1.0,
+			rayDir, hitInfo.normal, hitInfo.material.specularChance, 1.0f);
+
+		float chanceMultiplier = (1.0f - specularChance) / (1.0f - hitInfo.material.specularChance);
+		refractionChance *= chanceMultiplier;
+		diffuseChance *= chanceMultiplier;
+	}
+
+
+	// calculate whether we are going to do a diffuse, specular, or refractive ray
+	float doSpecular = 0.0f;
+	float doRefraction = 0.0f;
+	float raySelectRoll = RandomFloat01(rngState);
+	if (specularChance > 0.0f && raySelectRoll < specularChance)
+	{
+		doSpecular = 1.0f;
+		rayProbability = specularChance;
+	}
+	else if (refractionChance > 0.0f && raySelectRoll < specularChance + refractionChance)
+	{
+		doRefraction = 1.0f;
+		rayProbability = refractionChance;
+	}
+	else
+	{
+		rayProbability = 1.0f - (specularChance + refractionChance);
+	}
+
+	// numerical problems can cause rayProbability to become small enough to cause a divide by zero.
+	rayProbability = max(rayProbability, 0.001f);
+
+	// update the ray position
+	if (doRefraction == 1.0f)
+	{
+		rayPos = (rayPos + rayDir * hitInfo.dist) - hitInfo.normal * c_rayPosNormalNudge;
+	}
+	else
+	{
+		rayPos = (rayPos + rayDir * hitInfo.dist) + hitInfo.normal * c_rayPosNormalNudge;
+	}
+
+	// Calculate a new ray direction.
+	// Diffuse uses a normal oriented cosine weighted hemisphere sample.
+	// Perfectly smooth specular uses the reflection ray.
+	// Rough (glossy) specular lerps from the smooth specular to the rough diffuse by the material roughness squared
+	// Squaring the roughness is just a convention to make roughness feel more linear perceptually.
+	vec3 diffuseRayDir = normalize(hitInfo.normal + RandomUnitVector(rngState));
+
+	vec3 specularRayDir = reflect(rayDir, hitInfo.normal);
+	specularRayDir = normalize(mix(specularRayDir, diffuseRayDir, hitInfo.material.specularRoughness*hitInfo.material.specularRoughness));
+
+#if HAS_REFRACTION
+	vec3 refractionRayDir = refract(rayDir, hitInfo.normal, hitInfo.fromInside ? hitInfo.material.IOR : 1.0f / hitInfo.material.IOR);
+	refractionRayDir = normalize(mix(refractionRayDir, normalize(-hitInfo.normal + RandomUnitVector(rngState)), hitInfo.material.refractionRoughness*hitInfo.material.refractionRoughness));
+#endif
+
+	rayDir = mix(diffuseRayDir, specularRayDir, doSpecular);
+#if HAS_REFRACTION
+	rayDir = mix(rayDir, refractionRayDir, doRefraction);
+#endif
+
+	// add in emissive lighting
+	ret += hitInfo.material.emissive * throughput;
+
+	// update the colorMultiplier. refraction doesn't alter the color until we hit the next thing, so we can do light absorption over distance.
+	if (doRefraction == 0.0f)
+		throughput *= mix(hitInfo.material.albedo, hitInfo.material.specularColor, doSpecular);
+
+	// since we chose randomly between diffuse, specular, refract,
+	// we need to account for the times we didn't do one or the other.
+	throughput /= rayProbability;
+
+	// Russian Roulette
+	// As the throughput gets smaller, the ray is more likely to get terminated early.
+	// Survivors have their value boosted to make up for fewer samples being in the average.
+	{
+		float p = max(throughput.r, max(throughput.g, throughput.b));
+		if (RandomFloat01(rngState) > p)
+			return false;
+
+		// Add the energy we 'lose' by randomly terminating paths
+		throughput *= 1.0f / p;
+	}
+
+	throughput = clamp(throughput, 0.0, 1.0);
+	return true;
+}
+
 vec3 GetColorForRay(in vec3 startRayPos, in vec3 startRayDir, inout uint rngState)
 {
 	// initialize
@@ -1084,7 +1595,7 @@ vec3 GetColorForRay(in vec3 startRayPos, in vec3 startRayDir, inout uint rngStat
 	vec3 rayPos = startRayPos;
 	vec3 rayDir = startRayDir;
 
-	for (int bounceIndex = 0; bounceIndex <= 1; ++bounceIndex)
+	for (int bounceIndex = 0; bounceIndex < MAX_BOUNCES; ++bounceIndex)
 	{
 		// shoot a ray out into the world
 		SRayHitInfo hitInfo;
@@ -1102,105 +1613,8 @@ vec3 GetColorForRay(in vec3 startRayPos, in vec3 startRayDir, inout uint rngStat
 		}
 
 
-		// do absorption if we are hitting from inside the object
-		if (hitInfo.fromInside)
-			throughput *= exp(-hitInfo.material.refractionColor * hitInfo.dist);
-
-		// get the pre-fresnel chances
-		float specularChance = hitInfo.material.specularChance;
-		float refractionChance = hitInfo.material.refractionChance;
-
-		float diffuseChance = max(0.0f, 1.0f - (refractionChance + specularChance));
-
-		// take fresnel into account for specularChance and adjust other chances.
-		// specular takes priority.
-		// chanceMultiplier makes sure we keep diffuse / refraction ratio the same.
-		float rayProbability = 1.0f;
-		if (specularChance > 0.0f)
-		{
-			specularChance = FresnelReflectAmount(
-				hitInfo.fromInside ? hitInfo.material.IOR : 1.0,
-				!hitInfo.fromInside ? hitInfo.material.IOR : 1.0,
-				rayDir, hitInfo.normal, hitInfo.material.specularChance, 1.0f);
-
-			float chanceMultiplier = (1.0f - specularChance) / (1.0f - hitInfo.material.specularChance);
-			refractionChance *= chanceMultiplier;
-			diffuseChance *= chanceMultiplier;
-		}
-
-
-		// calculate whether we are going to do a diffuse, specular, or refractive ray
-		float doSpecular = 0.0f;
-		float doRefraction = 0.0f;
-		float raySelectRoll = RandomFloat01(rngState);
-		if (specularChance > 0.0f && raySelectRoll < specularChance)
-		{
-			doSpecular = 1.0f;
-			rayProbability = specularChance;
-		}
-		else if (refractionChance > 0.0f && raySelectRoll < specularChance + refractionChance)
-		{
-			doRefraction = 1.0f;
-			rayProbability = refractionChance;
-		}
-		else
-		{
-			rayProbability = 1.0f - (specularChance + refractionChance);
-		}
-
-		// numerical problems can cause rayProbability to become small enough to cause a divide by zero.
-		rayProbability = max(rayProbability, 0.001f);
-
-		// update the ray position
-		if (doRefraction == 1.0f)
-		{
-			rayPos = (rayPos + rayDir * hitInfo.dist) - hitInfo.normal * c_rayPosNormalNudge;
-		}
-		else
-		{
-			rayPos = (rayPos + rayDir * hitInfo.dist) + hitInfo.normal * c_rayPosNormalNudge;
-		}
-
-		// Calculate a new ray direction.
-		// Diffuse uses a normal oriented cosine weighted hemisphere sample.
-		// Perfectly smooth specular uses the reflection ray.
-		// Rough (glossy) specular lerps from the smooth specular to the rough diffuse by the material roughness squared
-		// Squaring the roughness is just a convention to make roughness feel more linear perceptually.
-		vec3 diffuseRayDir = normalize(hitInfo.normal + RandomUnitVector(rngState));
-
-		vec3 specularRayDir = reflect(rayDir, hitInfo.normal);
-		specularRayDir = normalize(mix(specularRayDir, diffuseRayDir, hitInfo.material.specularRoughness*hitInfo.material.specularRoughness));
-
-		vec3 refractionRayDir = refract(rayDir, hitInfo.normal, hitInfo.fromInside ? hitInfo.material.IOR : 1.0f / hitInfo.material.IOR);
-		refractionRayDir = normalize(mix(refractionRayDir, normalize(-hitInfo.normal + RandomUnitVector(rngState)), hitInfo.material.refractionRoughness*hitInfo.material.refractionRoughness));
-
-		rayDir = mix(diffuseRayDir, specularRayDir, doSpecular);
-		rayDir = mix(rayDir, refractionRayDir, doRefraction);
-
-		// add in emissive lighting
-		ret += hitInfo.material.emissive * throughput;
-
-		// update the colorMultiplier. refraction doesn't alter the color until we hit the next thing, so we can do light absorption over distance.
-		if (doRefraction == 0.0f)
-			throughput *= mix(hitInfo.material.albedo, hitInfo.material.specularColor, doSpecular);
-
-		// since we chose randomly between diffuse, specular, refract,
-		// we need to account for the times we didn't do one or the other.
-		throughput /= rayProbability;
-
-		// Russian Roulette
-		// As the throughput gets smaller, the ray is more likely to get terminated early.
-		// Survivors have their value boosted to make up for fewer samples being in the average.
-		{
-			float p = max(throughput.r, max(throughput.g, throughput.b));
-			if (RandomFloat01(rngState) > p)
-				break;
-
-			// Add the energy we 'lose' by randomly terminating paths
-			throughput *= 1.0f / p;
-		}
-
-		throughput = clamp(throughput, 0.0, 1.0);
+		if (!ShadeHit(rayPos, rayDir, hitInfo, throughput, ret, rngState))
+			break;
 
 		if (miss) {
 			break;
@@ -1237,38 +1651,42 @@ void GetCameraVectors(out vec3 cameraPos, out vec3 cameraFwd, out vec3 cameraUp,
 	cameraUp = normalize(cross(cameraPos, cameraRight));
 }
 
+// initial random number state of a pixel, from its coordinates and the frame
+uint PixelRandomSeed(ivec2 pixel_coords)
+{
+	return uint(uint(pixel_coords.x) * uint(1973) + uint(pixel_coords.y) * uint(9277) + uint(iTime) * uint(26699)) | uint(1);
+}
 
-void main() {
-	// base pixel colour for image
-	vec4 pixel = vec4(0.0, 0.0, 0.0, 1.0);
-	// get index in global work group i.e x,y position
-	ivec2 pixel_coords = ivec2(gl_GlobalInvocationID.xy);
-	vec4 texturecolor = imageLoad(img_output, pixel_coords.xy);
-
-	// initialize a random number state based on frag coord and frame
-	uint rngState = uint(uint(pixel_coords.x) * uint(1973) + uint(pixel_coords.y) * uint(9277) + uint(iTime) * uint(26699)) | uint(1);
-
+// jittered primary ray direction through a pixel, consumes the two jitter random numbers
+vec3 CameraRayDir(ivec2 pixel_coords, inout uint rngState)
+{
 	// calculate subpixel camera jitter for anti aliasing
 	vec2 jitter = vec2(RandomFloat01(rngState), RandomFloat01(rngState)) - 0.5f;
 
-	// get the camera vectors
-	
-	vec3 rayDir;
-	{
-		// calculate a screen position from -1 to +1 on each axis
-		vec2 rt = vec2(pixel_coords.x, pixel_coords.y);
-		vec2 uvJittered = vec2((rt + jitter) / vec2(game_window_x, game_window_y));
-		vec2 screen = uvJittered * 2.0f - 1.0f;
+	// calculate a screen position from -1 to +1 on each axis
+	vec2 rt = vec2(pixel_coords.x, pixel_coords.y);
+	vec2 uvJittered = vec2((rt + jitter) / vec2(game_window_x, game_window_y));
+	vec2 screen = uvJittered * 2.0f - 1.0f;
 
-		// adjust for aspect ratio
-		float aspectRatio = game_window_x / game_window_y;
-		screen.y /= aspectRatio;
+	// adjust for aspect ratio
+	float aspectRatio = game_window_x / game_window_y;
+	screen.y /= aspectRatio;
 
-		// make a ray direction based on camera orientation and field of view angle
-		float cameraDistance = tan(FOV * 0.5f * c_pi / 180.0f);
-		rayDir = vec3(screen, cameraDistance);
-		rayDir = normalize(mat3(cameraRight, cameraUp, cameraPos) * rayDir);
-	}
+	// make a ray direction based on camera orientation and field of view angle
+	float cameraDistance = tan(FOV * 0.5f * c_pi / 180.0f);
+	vec3 rayDir = vec3(screen, cameraDistance);
+	return normalize(mat3(cameraRight, cameraUp, cameraPos) * rayDir);
+}
+
+#if WAVEFRONT_PASS == 0
+// traces the samples of one pixel and blends them into the image
+void RenderPixel(ivec2 pixel_coords)
+{
+	vec4 texturecolor = imageLoad(img_output, pixel_coords.xy);
+
+	// initialize a random number state based on frag coord and frame
+	uint rngState = PixelRandomSeed(pixel_coords);
+	vec3 rayDir = CameraRayDir(pixel_coords, rngState);
 
 	//raytrace for this pxiel
 	vec3 color = vec3(0.0f, 0.0f, 0.0f);
@@ -1284,3 +1702,335 @@ void main() {
 	// output to a specific pixel in the image
 	imageStore(img_output, pixel_coords, vec4(color, blend));
 }
+
+#if PERSISTENT_THREADS
+// Must match PersistentPathTracer on the CPU, which zeroes it before every dispatch
+layout(std430, binding = 23) buffer PersistentWork {
+	uint nextTile;
+};
+
+shared uint groupTile;
+
+// Every workgroup takes the next 8x8 tile from the global counter until all are handed out, so
+// a group whose paths end early goes on with another tile instead of retiring while the slow
+// groups finish. A tile is traced with the same invocation per pixel as the 8x8 dispatch.
+void main() {
+	uvec2 size = uvec2(game_window_x, game_window_y);
+	uint tilesX = (size.x + 7u) / 8u;
+	uint tileCount = tilesX * ((size.y + 7u) / 8u);
+
+	for (;;) {
+		if (gl_LocalInvocationIndex == 0u)
+			groupTile = atomicAdd(nextTile, 1u);
+		barrier();
+		uint tile = groupTile;
+		// everyone has read the tile before the next one overwrites it
+		barrier();
+		if (tile >= tileCount) break;
+
+		uvec2 pixel = uvec2(tile % tilesX, tile / tilesX) * 8u + gl_LocalInvocationID.xy;
+		if (pixel.x < size.x && pixel.y < size.y)
+			RenderPixel(ivec2(pixel));
+	}
+}
+#else
+void main() {
+	// get index in global work group i.e x,y position
+	ivec2 pixel_coords = ivec2(gl_GlobalInvocationID.xy);
+
+#if TRAVERSAL_STATS
+	pixelRays = 0u;
+	pixelNodeVisits = 0u;
+	pixelLeafTests = 0u;
+	pixelTriangleTests = 0u;
+	pixelStackDrops = 0u;
+
+	// the 8x8 group clears one histogram bucket per invocation
+	uint localIndex = gl_LocalInvocationIndex;
+	if (localIndex < 5u) groupCounters[localIndex] = 0u;
+	if (localIndex < uint(STATS_HISTOGRAM_BUCKETS)) {
+		groupNodeHistogram[localIndex] = 0u;
+		groupTriangleHistogram[localIndex] = 0u;
+	}
+	barrier();
+#endif
+	RenderPixel(pixel_coords);
+
+#if TRAVERSAL_STATS
+	float heat = float(stats_heatmap == 1 ? pixelTriangleTests : pixelNodeVisits) / float(max(stats_heatmap_max, 1));
+	imageStore(img_stats, pixel_coords, vec4(heatColor(heat), 1.0));
+
+	atomicAdd(groupCounters[0], pixelRays);
+	atomicAdd(groupCounters[1], pixelNodeVisits);
+	atomicAdd(groupCounters[2], pixelLeafTests);
+	atomicAdd(groupCounters[3], pixelTriangleTests);
+	atomicAdd(groupCounters[4], pixelStackDrops);
+	barrier();
+
+	if (localIndex == 0u) {
+		atomicAdd(statRays, groupCounters[0]);
+		atomicAdd(statNodeVisits, groupCounters[1]);
+		atomicAdd(statLeafTests, groupCounters[2]);
+		atomicAdd(statTriangleTests, groupCounters[3]);
+		atomicAdd(statStackDrops, groupCounters[4]);
+	}
+	if (localIndex < uint(STATS_HISTOGRAM_BUCKETS)) {
+		if (groupNodeHistogram[localIndex] != 0u) atomicAdd(statNodeHistogram[localIndex], groupNodeHistogram[localIndex]);
+		if (groupTriangleHistogram[localIndex] != 0u) atomicAdd(statTriangleHistogram[localIndex], groupTriangleHistogram[localIndex]);
+	}
+#endif
+}
+#endif
+#else
+// Wavefront mode: the path of main() split into passes over queues of paths. generate writes a
+// camera ray per sample, extend traces the queued rays and sorts the hits into one queue per
+// material type, shade runs ShadeHit for one material type and queues the rays that go on, and
+// accumulate blends the finished samples into the image. The dispatch pass turns the queue
+// counters into the indirect dispatch sizes of the next pass.
+
+#define WAVEFRONT_MATERIAL_DIFFUSE 0
+#define WAVEFRONT_MATERIAL_SPECULAR 1
+#define WAVEFRONT_MATERIAL_REFRACTIVE 2
+#define WAVEFRONT_MATERIAL_TYPES 3
+
+struct WavefrontPath {
+	vec3 origin;
+	uint rngState;
+	vec3 direction;
+	uint pad0;
+	vec3 throughput;
+	uint pad1;
+	vec3 radiance;
+	uint pad2;
+};
+
+// SRayHitInfo of the last extend, read by the shade pass
+struct WavefrontHit {
+	vec3 normal;
+	float dist;
+	vec3 albedo;
+	float specularChance;
+	vec3 emissive;
+	float specularRoughness;
+	vec3 specularColor;
+	float IOR;
+	vec3 refractionColor;
+	float refractionChance;
+	float refractionRoughness;
+	uint fromInside;
+};
+
+// Must match WavefrontPathTracer::QueueState on the CPU
+layout(std430, binding = 19) buffer WavefrontQueueState {
+	uint rayCount;                             // rays queued for the next extend
+	uint hitCounts[WAVEFRONT_MATERIAL_TYPES];  // hits queued for the next shade, per material type
+	uint extendArgs[3];                        // indirect dispatch sizes
+	uint shadeArgs[3 * WAVEFRONT_MATERIAL_TYPES];
+};
+
+layout(std430, binding = 20) buffer WavefrontPathBuffer {
+	WavefrontPath wavefrontPaths[];
+};
+
+layout(std430, binding = 21) buffer WavefrontHitBuffer {
+	WavefrontHit wavefrontHits[];
+};
+
+// the ray queue, then one hit queue per material type, wavefront_paths entries each
+layout(std430, binding = 22) buffer WavefrontQueueBuffer {
+	uint wavefrontQueues[];
+};
+
+uniform int wavefront_paths; // paths in flight: pixels * SAMPLES_PER_DISPATCH
+uniform int wavefront_step;  // dispatch pass: 0 sizes an extend, 1 the shades
+
+uint WavefrontMaterialType(SMaterialInfo material)
+{
+#if HAS_REFRACTION
+	if (material.refractionChance > 0.0f)
+		return WAVEFRONT_MATERIAL_REFRACTIVE;
+#endif
+	return material.specularChance > 0.0f ? WAVEFRONT_MATERIAL_SPECULAR : WAVEFRONT_MATERIAL_DIFFUSE;
+}
+
+uint WavefrontHitQueue(uint type)
+{
+	return uint(wavefront_paths) * (1u + type);
+}
+
+// queue slots are counted per workgroup first, one global atomic per group and queue
+shared uint groupCounts[WAVEFRONT_MATERIAL_TYPES];
+shared uint groupBases[WAVEFRONT_MATERIAL_TYPES];
+
+#if WAVEFRONT_PASS == WAVEFRONT_PASS_GENERATE
+void main() {
+	uint pathIndex = gl_GlobalInvocationID.x;
+	if (pathIndex >= uint(wavefront_paths))
+		return;
+
+	// the samples of a pixel share its jittered ray like in main(), but run side by side, so
+	// every sample after the first continues from its own random sequence
+	uint pixelIndex = pathIndex / uint(SAMPLES_PER_DISPATCH);
+	uint sampleIndex = pathIndex % uint(SAMPLES_PER_DISPATCH);
+	ivec2 pixel_coords = ivec2(pixelIndex % uint(game_window_x), pixelIndex / uint(game_window_x));
+	uint rngState = PixelRandomSeed(pixel_coords);
+	vec3 rayDir = CameraRayDir(pixel_coords, rngState);
+	if (sampleIndex > 0u) {
+		rngState ^= sampleIndex * 0x9E3779B9u;
+		rngState = wang_hash(rngState) | 1u;
+	}
+
+	WavefrontPath path;
+	path.origin = cameraPos + cameraMov;
+	path.rngState = rngState;
+	path.direction = rayDir;
+	path.throughput = vec3(1.0f);
+	path.radiance = vec3(0.0f);
+	wavefrontPaths[pathIndex] = path;
+	wavefrontQueues[pathIndex] = pathIndex;
+}
+
+#elif WAVEFRONT_PASS == WAVEFRONT_PASS_EXTEND
+void main() {
+	if (gl_LocalInvocationIndex < uint(WAVEFRONT_MATERIAL_TYPES))
+		groupCounts[gl_LocalInvocationIndex] = 0u;
+	barrier();
+
+	uint pathIndex = 0u;
+	uint type = WAVEFRONT_MATERIAL_TYPES;
+	uint groupSlot = 0u;
+	if (gl_GlobalInvocationID.x < rayCount) {
+		pathIndex = wavefrontQueues[gl_GlobalInvocationID.x];
+		vec3 rayPos = wavefrontPaths[pathIndex].origin;
+		vec3 rayDir = wavefrontPaths[pathIndex].direction;
+
+		SRayHitInfo hitInfo;
+		hitInfo.material = GetZeroedMaterial();
+		hitInfo.dist = c_superFar;
+		hitInfo.fromInside = false;
+		TestSceneTrace(rayPos, rayDir, hitInfo);
+
+		if (hitInfo.dist == c_superFar) {
+			// a miss ends the path with the environment
+			wavefrontPaths[pathIndex].radiance += min(texture(equirectangularMap, SampleSphericalMap(normalize(rayDir))).rgb, vec3(1.0)) * wavefrontPaths[pathIndex].throughput;
+		}
+		else {
+			WavefrontHit hit;
+			hit.normal = hitInfo.normal;
+			hit.dist = hitInfo.dist;
+			hit.albedo = hitInfo.material.albedo;
+			hit.specularChance = hitInfo.material.specularChance;
+			hit.emissive = hitInfo.material.emissive;
+			hit.specularRoughness = hitInfo.material.specularRoughness;
+			hit.specularColor = hitInfo.material.specularColor;
+			hit.IOR = hitInfo.material.IOR;
+			hit.refractionColor = hitInfo.material.refractionColor;
+			hit.refractionChance = hitInfo.material.refractionChance;
+			hit.refractionRoughness = hitInfo.material.refractionRoughness;
+			hit.fromInside = hitInfo.fromInside ? 1u : 0u;
+			wavefrontHits[pathIndex] = hit;
+
+			type = WavefrontMaterialType(hitInfo.material);
+			groupSlot = atomicAdd(groupCounts[type], 1u);
+		}
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex < uint(WAVEFRONT_MATERIAL_TYPES) && groupCounts[gl_LocalInvocationIndex] > 0u)
+		groupBases[gl_LocalInvocationIndex] = atomicAdd(hitCounts[gl_LocalInvocationIndex], groupCounts[gl_LocalInvocationIndex]);
+	barrier();
+
+	if (type < uint(WAVEFRONT_MATERIAL_TYPES))
+		wavefrontQueues[WavefrontHitQueue(type) + groupBases[type] + groupSlot] = pathIndex;
+}
+
+#elif WAVEFRONT_PASS == WAVEFRONT_PASS_SHADE
+void main() {
+	if (gl_LocalInvocationIndex == 0u)
+		groupCounts[0] = 0u;
+	barrier();
+
+	uint pathIndex = 0u;
+	bool extend = false;
+	uint groupSlot = 0u;
+	if (gl_GlobalInvocationID.x < hitCounts[WAVEFRONT_MATERIAL]) {
+		pathIndex = wavefrontQueues[WavefrontHitQueue(WAVEFRONT_MATERIAL) + gl_GlobalInvocationID.x];
+		WavefrontPath path = wavefrontPaths[pathIndex];
+		WavefrontHit hit = wavefrontHits[pathIndex];
+
+		SRayHitInfo hitInfo;
+		hitInfo.fromInside = hit.fromInside != 0u;
+		hitInfo.dist = hit.dist;
+		hitInfo.normal = hit.normal;
+		hitInfo.material.albedo = hit.albedo;
+		hitInfo.material.emissive = hit.emissive;
+		hitInfo.material.specularChance = hit.specularChance;
+		hitInfo.material.specularRoughness = hit.specularRoughness;
+		hitInfo.material.specularColor = hit.specularColor;
+		hitInfo.material.IOR = hit.IOR;
+		hitInfo.material.refractionChance = hit.refractionChance;
+		hitInfo.material.refractionRoughness = hit.refractionRoughness;
+		hitInfo.material.refractionColor = hit.refractionColor;
+
+		// the chances the queue rules out are constants, so the compiler drops their branches
+#if WAVEFRONT_MATERIAL != WAVEFRONT_MATERIAL_REFRACTIVE
+		hitInfo.material.refractionChance = 0.0f;
+#endif
+#if WAVEFRONT_MATERIAL == WAVEFRONT_MATERIAL_DIFFUSE
+		hitInfo.material.specularChance = 0.0f;
+#endif
+
+		extend = ShadeHit(path.origin, path.direction, hitInfo, path.throughput, path.radiance, path.rngState);
+		wavefrontPaths[pathIndex] = path;
+		if (extend)
+			groupSlot = atomicAdd(groupCounts[0], 1u);
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0u && groupCounts[0] > 0u)
+		groupBases[0] = atomicAdd(rayCount, groupCounts[0]);
+	barrier();
+
+	if (extend)
+		wavefrontQueues[groupBases[0] + groupSlot] = pathIndex;
+}
+
+#elif WAVEFRONT_PASS == WAVEFRONT_PASS_ACCUMULATE
+void main() {
+	uint pixelIndex = gl_GlobalInvocationID.x;
+	if (pixelIndex >= uint(wavefront_paths) / uint(SAMPLES_PER_DISPATCH))
+		return;
+	ivec2 pixel_coords = ivec2(pixelIndex % uint(game_window_x), pixelIndex / uint(game_window_x));
+	vec4 texturecolor = imageLoad(img_output, pixel_coords);
+
+	vec3 color = vec3(0.0f, 0.0f, 0.0f);
+	for (int index = 0; index < c_numRendersPerFrame; ++index)
+		color += wavefrontPaths[pixelIndex * uint(SAMPLES_PER_DISPATCH) + uint(index)].radiance / float(c_numRendersPerFrame);
+
+	float blend = (iFrame < 2 || texturecolor.a == 0.0f) ? 1.0f : 1.0f / (1.0f + (1.0f / texturecolor.a));
+	color = mix(texturecolor.rgb, color, blend);
+	imageStore(img_output, pixel_coords, vec4(color, blend));
+}
+
+#elif WAVEFRONT_PASS == WAVEFRONT_PASS_DISPATCH
+void main() {
+	if (wavefront_step == 0) {
+		// after generate or the shades: size the extend, the hit queues fill up again
+		extendArgs[0] = (rayCount + uint(WAVEFRONT_GROUP_SIZE) - 1u) / uint(WAVEFRONT_GROUP_SIZE);
+		extendArgs[1] = 1u;
+		extendArgs[2] = 1u;
+		for (int type = 0; type < WAVEFRONT_MATERIAL_TYPES; ++type)
+			hitCounts[type] = 0u;
+	}
+	else {
+		// after an extend: size the shades, the ray queue fills up again
+		for (int type = 0; type < WAVEFRONT_MATERIAL_TYPES; ++type) {
+			shadeArgs[type * 3] = (hitCounts[type] + uint(WAVEFRONT_GROUP_SIZE) - 1u) / uint(WAVEFRONT_GROUP_SIZE);
+			shadeArgs[type * 3 + 1] = 1u;
+			shadeArgs[type * 3 + 2] = 1u;
+		}
+		rayCount = 0u;
+	}
+}
+#endif
+#endif
@@ -0,0 +1,943 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <float.h>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <utility>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "thread_pool.h"
+
+// BVH Node structure (GPU-friendly)
+struct BVHNode {
+	float minBounds[3];
+	uint32_t leftChild;    // If 0, this is a leaf node
+	float maxBounds[3];
+	uint32_t triangleCount; // For leaf nodes: number of triangles, for internal: right child
+	uint32_t triangleOffset; // For leaf nodes: offset into triangle array
+	uint32_t padding[3];     // Pads the node to 48 bytes, the std430 size of the GLSL struct
+
+							 // Constructor to initialize all values
+	BVHNode() {
+		minBounds[0] = minBounds[1] = minBounds[2] = 0.0f;
+		maxBounds[0] = maxBounds[1] = maxBounds[2] = 0.0f;
+		leftChild = 0;
+		triangleCount = 0;
+		triangleOffset = 0;
+		padding[0] = padding[1] = padding[2] = 0;
+	}
+};
+
+// How the builder chooses where to split a node
+enum class BVHBuildMode {
+	Median,    // longest axis, cut at the median centroid
+	BinnedSAH, // surface area heuristic evaluated over a fixed number of centroid bins
+	LBVH       // Morton code sort + Karras hierarchy, one triangle per leaf above maxDepth, fastest to build
+};
+
+// Node layout the path tracer traverses (values match BVH_LAYOUT_* in pathtracing_compute.glsl)
+enum class BVHLayout {
+	Binary = 0,    // BVHNode, 48 bytes per node
+	Wide4 = 1,     // WideBVHPacket, one per node
+	Wide8 = 2,     // WideBVHPacket, two per node
+	Compressed = 3 // CompressedBVHNode, 32 bytes per node
+};
+
+struct BVHBuildSettings {
+	BVHBuildMode mode = BVHBuildMode::Median;
+	uint32_t sahBinCount = 16;       // bins per axis for the binned SAH
+	float sahTraversalCost = 1.0f;   // cost of visiting an internal node
+	float sahIntersectionCost = 1.0f; // cost of testing one triangle in a leaf
+	uint32_t maxLeafSize = 4;        // leaves are never larger than this unless maxDepth is hit
+	int maxDepth = 20;
+	unsigned threadCount = 0;        // 0 = one per hardware thread, 1 = single-threaded
+	uint32_t parallelThreshold = 4096; // subtrees and ranges smaller than this stay on one thread
+	uint32_t mortonBits = 30;        // LBVH key size: 30 (10 bits per axis) or 63 (21 bits per axis)
+};
+
+// Figures reported after a build so different modes can be compared
+struct BVHBuildStats {
+	size_t nodeCount = 0;
+	size_t leafCount = 0;
+	int maxDepth = 0;
+	float sahCost = 0.0f;
+	double buildTimeMs = 0.0;
+};
+
+// Builds the flattened BVH layout traversed by pathtracing_compute.glsl.
+// Shared by OBJLoader and GLTFLoader; works on any triangle type exposing
+// getBounds() and getCentroid().
+class BVHBuilder {
+public:
+	explicit BVHBuilder(const BVHBuildSettings& settings = BVHBuildSettings()) : settings(settings) {}
+
+	// Fills nodes with the tree and indices with the triangle order the leaves refer to
+	template<typename TriangleT>
+	void build(const std::vector<TriangleT>& triangles, std::vector<BVHNode>& nodes, std::vector<uint32_t>& indices);
+
+	const BVHBuildStats& getStats() const { return stats; }
+
+	// SAH cost of a finished tree, normalized by the root surface area
+	static float computeSAHCost(const std::vector<BVHNode>& nodes, float traversalCost, float intersectionCost);
+	static const char* modeName(BVHBuildMode mode);
+
+	// Recomputes the bounds of an existing tree bottom-up after the triangles moved.
+	// Topology and triangle order are kept; an empty indices means leaves refer to
+	// triangles directly. Returns the [begin, end) range of nodes whose bounds changed.
+	template<typename TriangleT>
+	static std::pair<uint32_t, uint32_t> refit(const std::vector<TriangleT>& triangles, const std::vector<uint32_t>& indices,
+		std::vector<BVHNode>& nodes, ThreadPool* pool = nullptr, size_t grainSize = 4096);
+
+	// Puts triangles into the order the leaves refer to without a second array, following
+	// each permutation cycle with one saved element. indices is cleared afterwards, since
+	// the leaves then refer to the triangles directly.
+	template<typename TriangleT>
+	static void permuteInPlace(std::vector<TriangleT>& triangles, std::vector<uint32_t>& indices);
+
+private:
+	BVHBuildSettings settings;
+	BVHBuildStats stats;
+	ThreadPool* pool = nullptr;
+
+	// Per-triangle data gathered once before the recursion
+	std::vector<float> primMin;
+	std::vector<float> primMax;
+	std::vector<float> centroids;
+
+	// A subtree over n triangles owns the 2n - 1 slots starting at its root slot,
+	// so subtrees can be built concurrently without sharing an append position.
+	// The slots are compacted into depth-first order once the build is done.
+	std::vector<BVHNode> scratchNodes;
+	std::vector<uint32_t>* outIndices = nullptr;
+
+	struct Bin {
+		float minBounds[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float maxBounds[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		uint32_t count = 0;
+	};
+
+	void buildFromPrimitives(std::vector<BVHNode>& nodes);
+	void buildBVHRecursive(uint32_t start, uint32_t end, int depth, uint32_t slot);
+	void buildLBVH();
+	uint32_t limitLBVHDepth();
+	void sortMortonCodes(std::vector<uint64_t>& keys, std::vector<uint32_t>& values);
+	void compactNodes(std::vector<BVHNode>& nodes);
+	void calculateBounds(uint32_t start, uint32_t end, float minBounds[3], float maxBounds[3],
+		float centroidMin[3], float centroidMax[3]) const;
+	void binPrimitives(uint32_t start, uint32_t end, uint32_t binCount, const float centroidMin[3],
+		const float scale[3], Bin* bins) const;
+	uint32_t splitMedian(uint32_t start, uint32_t end, const float minBounds[3], const float maxBounds[3]);
+	bool splitBinnedSAH(uint32_t start, uint32_t end, const float minBounds[3], const float maxBounds[3],
+		const float centroidMin[3], const float centroidMax[3], uint32_t& mid);
+
+	// Fits every leaf with fitLeaf(leaf, min, max) and merges the bounds up to the root:
+	// the second child to reach a parent computes it, the first one stops there
+	template<typename FitLeaf>
+	static std::pair<uint32_t, uint32_t> propagateBounds(std::vector<BVHNode>& nodes, ThreadPool* pool, size_t grainSize,
+		const FitLeaf& fitLeaf);
+
+	static float surfaceArea(const float minBounds[3], const float maxBounds[3]);
+	static uint64_t expandBits(uint64_t v);
+	static int countLeadingZeros(uint64_t v);
+};
+
+// Builds the same triangles with 1, 2, 4, ... threads and prints the build time of each.
+// Every multithreaded result is checked against the single-threaded one byte for byte.
+template<typename TriangleT>
+void benchmarkBVHBuild(const std::vector<TriangleT>& triangles, BVHBuildSettings settings, unsigned maxThreads = 0);
+
+// Implementation
+template<typename TriangleT>
+void BVHBuilder::build(const std::vector<TriangleT>& triangles, std::vector<BVHNode>& nodes, std::vector<uint32_t>& indices) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// The calling thread helps while it waits, so it counts as one of the threads
+	unsigned threadCount = settings.threadCount == 0 ? ThreadPool::hardwareThreads() : settings.threadCount;
+	std::unique_ptr<ThreadPool> threads;
+	if (threadCount > 1) {
+		threads = std::make_unique<ThreadPool>(threadCount - 1);
+		pool = threads.get();
+	}
+
+	size_t count = triangles.size();
+	primMin.resize(count * 3);
+	primMax.resize(count * 3);
+	centroids.resize(count * 3);
+	auto gather = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			triangles[i].getBounds(&primMin[i * 3], &primMax[i * 3]);
+			triangles[i].getCentroid(&centroids[i * 3]);
+		}
+	};
+	if (pool) {
+		pool->parallelFor(0, count, settings.parallelThreshold, gather);
+	}
+	else {
+		gather(0, count);
+	}
+
+	outIndices = &indices;
+	buildFromPrimitives(nodes);
+	outIndices = nullptr;
+
+	pool = nullptr;
+	threads.reset();
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.buildTimeMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+inline void BVHBuilder::buildFromPrimitives(std::vector<BVHNode>& nodes) {
+	std::vector<uint32_t>& indices = *outIndices;
+	uint32_t count = (uint32_t)(centroids.size() / 3);
+
+	nodes.clear();
+	indices.clear();
+	stats = BVHBuildStats();
+	if (count == 0) return;
+
+	// Worst case: 2 * triangleCount - 1 nodes for a binary tree
+	scratchNodes.assign(2 * (size_t)count - 1, BVHNode());
+
+	// Initialize triangle indices
+	indices.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		indices[i] = i;
+	}
+
+	// Build BVH recursively
+	if (settings.mode == BVHBuildMode::LBVH) {
+		buildLBVH();
+	}
+	else {
+		buildBVHRecursive(0, count, 0, 0);
+	}
+	compactNodes(nodes);
+
+	std::vector<BVHNode>().swap(scratchNodes);
+
+	stats.sahCost = computeSAHCost(nodes, settings.sahTraversalCost, settings.sahIntersectionCost);
+}
+
+inline void BVHBuilder::buildBVHRecursive(uint32_t start, uint32_t end, int depth, uint32_t slot) {
+	BVHNode& node = scratchNodes[slot];
+	uint32_t triangleCount = end - start;
+
+	// Calculate bounds first and store them
+	float centroidMin[3], centroidMax[3];
+	calculateBounds(start, end, node.minBounds, node.maxBounds, centroidMin, centroidMax);
+
+	// Leaf node criteria
+	bool makeLeaf = triangleCount <= 1 || depth > settings.maxDepth;
+	if (settings.mode == BVHBuildMode::Median) {
+		makeLeaf = makeLeaf || triangleCount <= settings.maxLeafSize;
+	}
+
+	uint32_t mid = start;
+	if (!makeLeaf) {
+		if (settings.mode == BVHBuildMode::BinnedSAH) {
+			makeLeaf = !splitBinnedSAH(start, end, node.minBounds, node.maxBounds, centroidMin, centroidMax, mid);
+		}
+		else {
+			mid = splitMedian(start, end, node.minBounds, node.maxBounds);
+		}
+	}
+
+	if (makeLeaf) {
+		node.leftChild = 0; // Mark as leaf
+		node.triangleCount = triangleCount;
+		node.triangleOffset = start;
+		return;
+	}
+
+	// Children take consecutive slot ranges right after this node
+	uint32_t leftSlot = slot + 1;
+	uint32_t rightSlot = leftSlot + 2 * (mid - start) - 1;
+	node.leftChild = leftSlot;
+	node.triangleCount = rightSlot; // Store right child index
+
+	// Large subtrees are handed to the pool, the right one stays on this thread
+	if (pool && mid - start >= settings.parallelThreshold) {
+		TaskGroup group(pool);
+		group.run([=] { buildBVHRecursive(start, mid, depth + 1, leftSlot); });
+		buildBVHRecursive(mid, end, depth + 1, rightSlot);
+		group.wait();
+	}
+	else {
+		buildBVHRecursive(start, mid, depth + 1, leftSlot);
+		buildBVHRecursive(mid, end, depth + 1, rightSlot);
+	}
+}
+
+// Linear BVH (Karras 2012): sort the triangles along a Morton curve, then every
+// internal node finds its key range and split independently of the others.
+// Internal nodes take scratch slots [0, n - 1) with the root at 0, leaves take
+// [n - 1, 2n - 1). The root is never a child, so leftChild == 0 still means leaf.
+inline void BVHBuilder::buildLBVH() {
+	std::vector<uint32_t>& indices = *outIndices;
+	uint32_t count = (uint32_t)indices.size();
+	uint32_t leafBase = count - 1;
+	size_t grain = settings.parallelThreshold;
+
+	auto parallelFor = [&](size_t begin, size_t end, const auto& fn) {
+		if (pool && end - begin > grain) pool->parallelFor(begin, end, grain, fn);
+		else fn(begin, end);
+	};
+
+	// Quantize centroids inside the centroid bounds
+	float minBounds[3], maxBounds[3], centroidMin[3], centroidMax[3];
+	calculateBounds(0, count, minBounds, maxBounds, centroidMin, centroidMax);
+
+	uint32_t axisBits = settings.mortonBits > 30 ? 21 : 10;
+	float cells = (float)(1u << axisBits);
+	float scale[3];
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		scale[axis] = extent > 0.0f ? cells / extent : 0.0f;
+	}
+
+	std::vector<uint64_t> keys(count);
+	parallelFor(0, count, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			uint64_t code = 0;
+			for (int axis = 0; axis < 3; axis++) {
+				float cell = (centroids[i * 3 + axis] - centroidMin[axis]) * scale[axis];
+				uint64_t q = (uint64_t)std::min(cells - 1.0f, std::max(0.0f, cell));
+				code |= expandBits(q) << (2 - axis);
+			}
+			keys[i] = code;
+		}
+	});
+
+	sortMortonCodes(keys, indices);
+
+	// Equal keys are told apart by their position, so every prefix is unique
+	auto delta = [&](int64_t i, int64_t j) -> int {
+		if (j < 0 || j >= (int64_t)count) return -1;
+		if (keys[i] == keys[j]) return 64 + countLeadingZeros((uint64_t)(i ^ j));
+		return countLeadingZeros(keys[i] ^ keys[j]);
+	};
+
+	// Emit internal nodes
+	parallelFor(0, leafBase, [&](size_t begin, size_t end) {
+		for (int64_t i = (int64_t)begin; i < (int64_t)end; i++) {
+			// Direction of the range and the prefix length shared with the neighbour outside it
+			int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+			int deltaMin = delta(i, i - d);
+
+			// Upper bound for the length of the range, then binary search the other end
+			int64_t lMax = 2;
+			while (delta(i, i + lMax * d) > deltaMin) lMax *= 2;
+			int64_t l = 0;
+			for (int64_t t = lMax / 2; t >= 1; t /= 2) {
+				if (delta(i, i + (l + t) * d) > deltaMin) l += t;
+			}
+			int64_t j = i + l * d;
+
+			// Binary search the split position
+			int deltaNode = delta(i, j);
+			int64_t s = 0;
+			int64_t t = l;
+			do {
+				t = (t + 1) / 2;
+				if (delta(i, i + (s + t) * d) > deltaNode) s += t;
+			} while (t > 1);
+			int64_t split = i + s * d + std::min(d, 0);
+
+			uint32_t left = std::min(i, j) == split ? leafBase + (uint32_t)split : (uint32_t)split;
+			uint32_t right = std::max(i, j) == split + 1 ? leafBase + (uint32_t)split + 1 : (uint32_t)split + 1;
+
+			BVHNode& node = scratchNodes[i];
+			node.leftChild = left;
+			node.triangleCount = right; // Store right child index
+		}
+	});
+
+	// Leaves hold one triangle each
+	for (uint32_t j = 0; j < count; j++) {
+		BVHNode& leaf = scratchNodes[leafBase + j];
+		leaf.leftChild = 0; // Mark as leaf
+		leaf.triangleCount = 1;
+		leaf.triangleOffset = j;
+	}
+
+	propagateBounds(scratchNodes, pool, grain, [&](const BVHNode& leaf, float minBounds[3], float maxBounds[3]) {
+		uint32_t prim = indices[leaf.triangleOffset] * 3;
+		for (int axis = 0; axis < 3; axis++) {
+			minBounds[axis] = primMin[prim + axis];
+			maxBounds[axis] = primMax[prim + axis];
+		}
+	});
+
+	// Tied or clustered codes can chain far deeper than the traversal stacks hold
+	uint32_t collapsed = limitLBVHDepth();
+	if (collapsed > 0) {
+		std::cerr << "LBVH deeper than " << settings.maxDepth << " levels, " << collapsed
+			<< " subtrees collapsed into leaves" << std::endl;
+	}
+}
+
+inline uint32_t BVHBuilder::limitLBVHDepth() {
+	// Same limit as the SAH build: a node below maxDepth becomes a leaf. The leaves of a
+	// subtree are a contiguous run of the sorted indices, from its leftmost leaf to its
+	// rightmost one, and its bounds already cover them.
+	struct PendingNode {
+		uint32_t slot;
+		int depth;
+	};
+
+	uint32_t collapsed = 0;
+	std::vector<PendingNode> stack;
+	stack.push_back({ 0, 0 });
+	while (!stack.empty()) {
+		PendingNode pending = stack.back();
+		stack.pop_back();
+
+		BVHNode& node = scratchNodes[pending.slot];
+		if (node.leftChild == 0) continue;
+		if (pending.depth <= settings.maxDepth) {
+			stack.push_back({ node.leftChild, pending.depth + 1 });
+			stack.push_back({ node.triangleCount, pending.depth + 1 });
+			continue;
+		}
+
+		uint32_t first = node.leftChild;
+		while (scratchNodes[first].leftChild != 0) first = scratchNodes[first].leftChild;
+		uint32_t last = node.triangleCount;
+		while (scratchNodes[last].leftChild != 0) last = scratchNodes[last].triangleCount;
+
+		node.leftChild = 0;
+		node.triangleOffset = scratchNodes[first].triangleOffset;
+		node.triangleCount = scratchNodes[last].triangleOffset - node.triangleOffset + 1;
+		collapsed++;
+	}
+	return collapsed;
+}
+
+template<typename FitLeaf>
+std::pair<uint32_t, uint32_t> BVHBuilder::propagateBounds(std::vector<BVHNode>& nodes, ThreadPool* pool, size_t grainSize,
+	const FitLeaf& fitLeaf) {
+	uint32_t nodeCount = (uint32_t)nodes.size();
+	if (nodeCount == 0) return { 0, 0 };
+	grainSize = std::max<size_t>(grainSize, 1);
+
+	auto parallelFor = [&](size_t begin, size_t end, const auto& fn) {
+		if (pool && end - begin > grainSize) pool->parallelFor(begin, end, grainSize, fn);
+		else fn(begin, end);
+	};
+
+	// The root (node 0) is never a child, so its parent entry stays unused
+	std::vector<uint32_t> parents(nodeCount, 0);
+	std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[nodeCount]);
+	parallelFor(0, nodeCount, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			visits[i].store(0, std::memory_order_relaxed);
+			if (nodes[i].leftChild != 0) {
+				parents[nodes[i].leftChild] = (uint32_t)i;
+				parents[nodes[i].triangleCount] = (uint32_t)i;
+			}
+		}
+	});
+
+	std::mutex dirtyMutex;
+	uint32_t dirtyBegin = nodeCount;
+	uint32_t dirtyEnd = 0;
+
+	parallelFor(0, nodeCount, [&](size_t begin, size_t end) {
+		uint32_t localBegin = nodeCount;
+		uint32_t localEnd = 0;
+		auto store = [&](uint32_t index, const float minBounds[3], const float maxBounds[3]) {
+			BVHNode& node = nodes[index];
+			if (memcmp(node.minBounds, minBounds, sizeof(node.minBounds)) == 0 &&
+				memcmp(node.maxBounds, maxBounds, sizeof(node.maxBounds)) == 0) return;
+			memcpy(node.minBounds, minBounds, sizeof(node.minBounds));
+			memcpy(node.maxBounds, maxBounds, sizeof(node.maxBounds));
+			localBegin = std::min(localBegin, index);
+			localEnd = std::max(localEnd, index + 1);
+		};
+
+		for (size_t i = begin; i < end; i++) {
+			if (nodes[i].leftChild != 0) continue;
+
+			uint32_t slot = (uint32_t)i;
+			float minBounds[3], maxBounds[3];
+			fitLeaf(nodes[slot], minBounds, maxBounds);
+			store(slot, minBounds, maxBounds);
+
+			while (slot != 0) {
+				uint32_t parent = parents[slot];
+				if (visits[parent].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+
+				const BVHNode& a = nodes[nodes[parent].leftChild];
+				const BVHNode& b = nodes[nodes[parent].triangleCount];
+				for (int axis = 0; axis < 3; axis++) {
+					minBounds[axis] = std::min(a.minBounds[axis], b.minBounds[axis]);
+					maxBounds[axis] = std::max(a.maxBounds[axis], b.maxBounds[axis]);
+				}
+				store(parent, minBounds, maxBounds);
+				slot = parent;
+			}
+		}
+
+		if (localBegin < localEnd) {
+			std::lock_guard<std::mutex> lock(dirtyMutex);
+			dirtyBegin = std::min(dirtyBegin, localBegin);
+			dirtyEnd = std::max(dirtyEnd, localEnd);
+		}
+	});
+
+	if (dirtyBegin >= dirtyEnd) return { 0, 0 };
+	return { dirtyBegin, dirtyEnd };
+}
+
+template<typename TriangleT>
+std::pair<uint32_t, uint32_t> BVHBuilder::refit(const std::vector<TriangleT>& triangles, const std::vector<uint32_t>& indices,
+	std::vector<BVHNode>& nodes, ThreadPool* pool, size_t grainSize) {
+	return propagateBounds(nodes, pool, grainSize, [&](const BVHNode& leaf, float minBounds[3], float maxBounds[3]) {
+		for (int axis = 0; axis < 3; axis++) {
+			minBounds[axis] = FLT_MAX;
+			maxBounds[axis] = -FLT_MAX;
+		}
+		for (uint32_t k = 0; k < leaf.triangleCount; k++) {
+			uint32_t position = leaf.triangleOffset + k;
+			float triMin[3], triMax[3];
+			triangles[indices.empty() ? position : indices[position]].getBounds(triMin, triMax);
+			for (int axis = 0; axis < 3; axis++) {
+				minBounds[axis] = std::min(minBounds[axis], triMin[axis]);
+				maxBounds[axis] = std::max(maxBounds[axis], triMax[axis]);
+			}
+		}
+	});
+}
+
+template<typename TriangleT>
+void BVHBuilder::permuteInPlace(std::vector<TriangleT>& triangles, std::vector<uint32_t>& indices) {
+	// Slot i receives triangles[indices[i]]; finished slots are marked by indices[i] == i
+	for (uint32_t start = 0; start < (uint32_t)indices.size(); start++) {
+		if (indices[start] == start) continue;
+
+		TriangleT saved = std::move(triangles[start]);
+		uint32_t slot = start;
+		while (indices[slot] != start) {
+			uint32_t source = indices[slot];
+			triangles[slot] = std::move(triangles[source]);
+			indices[slot] = slot;
+			slot = source;
+		}
+		triangles[slot] = std::move(saved);
+		indices[slot] = slot;
+	}
+	indices.clear();
+}
+
+// Parallel LSD radix sort on 8-bit digits, stable so equal codes keep their triangle order
+inline void BVHBuilder::sortMortonCodes(std::vector<uint64_t>& keys, std::vector<uint32_t>& values) {
+	size_t count = keys.size();
+	size_t grain = std::max<size_t>(settings.parallelThreshold, 1);
+	size_t chunks = pool ? (count + grain - 1) / grain : 1;
+	size_t chunkSize = (count + chunks - 1) / chunks;
+	uint32_t passes = (std::min(settings.mortonBits, 63u) + 7) / 8;
+
+	std::vector<uint64_t> keysOut(count);
+	std::vector<uint32_t> valuesOut(count);
+	std::vector<size_t> offsets(chunks * 256);
+
+	auto forEachChunk = [&](const auto& fn) {
+		if (pool && chunks > 1) {
+			pool->parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+				for (size_t c = first; c < last; c++) fn(c, c * chunkSize, std::min(count, (c + 1) * chunkSize));
+			});
+		}
+		else {
+			for (size_t c = 0; c < chunks; c++) fn(c, c * chunkSize, std::min(count, (c + 1) * chunkSize));
+		}
+	};
+
+	for (uint32_t pass = 0; pass < passes; pass++) {
+		uint32_t shift = pass * 8;
+
+		// Per chunk digit histograms
+		std::fill(offsets.begin(), offsets.end(), 0);
+		forEachChunk([&](size_t c, size_t begin, size_t end) {
+			size_t* histogram = &offsets[c * 256];
+			for (size_t i = begin; i < end; i++) histogram[(keys[i] >> shift) & 0xFF]++;
+		});
+
+		// Exclusive prefix sum, digit major so chunks scatter in order
+		size_t sum = 0;
+		for (uint32_t digit = 0; digit < 256; digit++) {
+			for (size_t c = 0; c < chunks; c++) {
+				size_t n = offsets[c * 256 + digit];
+				offsets[c * 256 + digit] = sum;
+				sum += n;
+			}
+		}
+
+		forEachChunk([&](size_t c, size_t begin, size_t end) {
+			size_t* offset = &offsets[c * 256];
+			for (size_t i = begin; i < end; i++) {
+				size_t dst = offset[(keys[i] >> shift) & 0xFF]++;
+				keysOut[dst] = keys[i];
+				valuesOut[dst] = values[i];
+			}
+		});
+
+		keys.swap(keysOut);
+		values.swap(valuesOut);
+	}
+}
+
+inline void BVHBuilder::compactNodes(std::vector<BVHNode>& nodes) {
+	struct PendingNode {
+		uint32_t slot;
+		uint32_t parent;
+		bool isRight;
+		int depth;
+	};
+
+	nodes.reserve(scratchNodes.size());
+
+	// Depth-first, left child first: the same order a single-threaded
+	// recursive build appends its nodes in
+	std::vector<PendingNode> stack;
+	stack.push_back({ 0, 0, false, 0 });
+	while (!stack.empty()) {
+		PendingNode pending = stack.back();
+		stack.pop_back();
+
+		uint32_t nodeIndex = (uint32_t)nodes.size();
+		nodes.push_back(scratchNodes[pending.slot]);
+		stats.maxDepth = std::max(stats.maxDepth, pending.depth);
+
+		if (nodeIndex > 0) {
+			if (pending.isRight) nodes[pending.parent].triangleCount = nodeIndex;
+			else nodes[pending.parent].leftChild = nodeIndex;
+		}
+
+		const BVHNode& node = scratchNodes[pending.slot];
+		if (node.leftChild == 0) {
+			stats.leafCount++;
+			continue;
+		}
+		stack.push_back({ node.triangleCount, nodeIndex, true, pending.depth + 1 });
+		stack.push_back({ node.leftChild, nodeIndex, false, pending.depth + 1 });
+	}
+
+	stats.nodeCount = nodes.size();
+}
+
+inline void BVHBuilder::calculateBounds(uint32_t start, uint32_t end, float minBounds[3], float maxBounds[3],
+	float centroidMin[3], float centroidMax[3]) const {
+	const std::vector<uint32_t>& indices = *outIndices;
+
+	auto accumulate = [&](uint32_t begin, uint32_t finish, float* bounds) {
+		for (int axis = 0; axis < 3; axis++) {
+			bounds[axis] = bounds[6 + axis] = FLT_MAX;
+			bounds[3 + axis] = bounds[9 + axis] = -FLT_MAX;
+		}
+		for (uint32_t i = begin; i < finish; i++) {
+			uint32_t prim = indices[i] * 3;
+			for (int axis = 0; axis < 3; axis++) {
+				bounds[axis] = std::min(bounds[axis], primMin[prim + axis]);
+				bounds[3 + axis] = std::max(bounds[3 + axis], primMax[prim + axis]);
+				bounds[6 + axis] = std::min(bounds[6 + axis], centroids[prim + axis]);
+				bounds[9 + axis] = std::max(bounds[9 + axis], centroids[prim + axis]);
+			}
+		}
+	};
+
+	float bounds[12];
+	uint32_t grain = settings.parallelThreshold;
+	if (pool && end - start >= 4 * grain) {
+		// Each chunk reduces into its own slot, merged afterwards
+		size_t chunks = (end - start + grain - 1) / grain;
+		std::vector<float> partial(chunks * 12);
+		pool->parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; c++) {
+				uint32_t begin = start + (uint32_t)c * grain;
+				accumulate(begin, std::min(end, begin + grain), &partial[c * 12]);
+			}
+		});
+
+		memcpy(bounds, partial.data(), sizeof(bounds));
+		for (size_t c = 1; c < chunks; c++) {
+			for (int axis = 0; axis < 3; axis++) {
+				bounds[axis] = std::min(bounds[axis], partial[c * 12 + axis]);
+				bounds[3 + axis] = std::max(bounds[3 + axis], partial[c * 12 + 3 + axis]);
+				bounds[6 + axis] = std::min(bounds[6 + axis], partial[c * 12 + 6 + axis]);
+				bounds[9 + axis] = std::max(bounds[9 + axis], partial[c * 12 + 9 + axis]);
+			}
+		}
+	}
+	else {
+		accumulate(start, end, bounds);
+	}
+
+	for (int axis = 0; axis < 3; axis++) {
+		minBounds[axis] = bounds[axis];
+		maxBounds[axis] = bounds[3 + axis];
+		centroidMin[axis] = bounds[6 + axis];
+		centroidMax[axis] = bounds[9 + axis];
+	}
+}
+
+inline void BVHBuilder::binPrimitives(uint32_t start, uint32_t end, uint32_t binCount, const float centroidMin[3],
+	const float scale[3], Bin* bins) const {
+	const std::vector<uint32_t>& indices = *outIndices;
+	for (uint32_t i = start; i < end; i++) {
+		uint32_t prim = indices[i] * 3;
+		for (int axis = 0; axis < 3; axis++) {
+			if (scale[axis] == 0.0f) continue;
+
+			float offset = (centroids[prim + axis] - centroidMin[axis]) * scale[axis];
+			uint32_t b = offset > 0.0f ? std::min(binCount - 1, (uint32_t)offset) : 0;
+			Bin& bin = bins[axis * binCount + b];
+			bin.count++;
+			for (int k = 0; k < 3; k++) {
+				bin.minBounds[k] = std::min(bin.minBounds[k], primMin[prim + k]);
+				bin.maxBounds[k] = std::max(bin.maxBounds[k], primMax[prim + k]);
+			}
+		}
+	}
+}
+
+inline uint32_t BVHBuilder::splitMedian(uint32_t start, uint32_t end, const float minBounds[3], const float maxBounds[3]) {
+	std::vector<uint32_t>& indices = *outIndices;
+
+	// Choose the axis with largest extent
+	int bestAxis = 0;
+	float maxExtent = maxBounds[0] - minBounds[0];
+	for (int axis = 1; axis < 3; axis++) {
+		float extent = maxBounds[axis] - minBounds[axis];
+		if (extent > maxExtent) {
+			maxExtent = extent;
+			bestAxis = axis;
+		}
+	}
+
+	// Sort triangles along best axis
+	std::sort(indices.begin() + start, indices.begin() + end,
+		[&](uint32_t a, uint32_t b) {
+		return centroids[a * 3 + bestAxis] < centroids[b * 3 + bestAxis];
+	});
+
+	return start + (end - start) / 2;
+}
+
+inline bool BVHBuilder::splitBinnedSAH(uint32_t start, uint32_t end, const float minBounds[3], const float maxBounds[3],
+	const float centroidMin[3], const float centroidMax[3], uint32_t& mid) {
+	std::vector<uint32_t>& indices = *outIndices;
+	uint32_t triangleCount = end - start;
+	uint32_t binCount = std::max(2u, settings.sahBinCount);
+
+	float leafCost = settings.sahIntersectionCost * triangleCount;
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	uint32_t bestBin = 0;
+
+	// Axes where all centroids share a coordinate get a zero scale and are skipped
+	float scale[3];
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		scale[axis] = extent > 0.0f ? binCount / extent : 0.0f;
+	}
+
+	std::vector<Bin> allBins(3 * binCount);
+	uint32_t grain = settings.parallelThreshold;
+	if (pool && triangleCount >= 4 * grain) {
+		size_t chunks = (triangleCount + grain - 1) / grain;
+		std::vector<Bin> partial(chunks * 3 * binCount);
+		pool->parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; c++) {
+				uint32_t begin = start + (uint32_t)c * grain;
+				binPrimitives(begin, std::min(end, begin + grain), binCount, centroidMin, scale, &partial[c * 3 * binCount]);
+			}
+		});
+
+		for (size_t c = 0; c < chunks; c++) {
+			for (uint32_t b = 0; b < 3 * binCount; b++) {
+				const Bin& src = partial[c * 3 * binCount + b];
+				Bin& dst = allBins[b];
+				dst.count += src.count;
+				for (int k = 0; k < 3; k++) {
+					dst.minBounds[k] = std::min(dst.minBounds[k], src.minBounds[k]);
+					dst.maxBounds[k] = std::max(dst.maxBounds[k], src.maxBounds[k]);
+				}
+			}
+		}
+	}
+	else {
+		binPrimitives(start, end, binCount, centroidMin, scale, allBins.data());
+	}
+
+	std::vector<float> rightArea(binCount);
+	std::vector<uint32_t> rightCount(binCount);
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (scale[axis] == 0.0f) continue;
+		const Bin* bins = &allBins[axis * binCount];
+
+		// Sweep from the right to get the area and count of every right-hand partition
+		float accMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float accMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		uint32_t accCount = 0;
+		for (uint32_t b = binCount - 1; b > 0; b--) {
+			for (int k = 0; k < 3; k++) {
+				accMin[k] = std::min(accMin[k], bins[b].minBounds[k]);
+				accMax[k] = std::max(accMax[k], bins[b].maxBounds[k]);
+			}
+			accCount += bins[b].count;
+			rightArea[b] = accCount > 0 ? surfaceArea(accMin, accMax) : 0.0f;
+			rightCount[b] = accCount;
+		}
+
+		// Sweep from the left and evaluate the split in front of every bin
+		for (int k = 0; k < 3; k++) {
+			accMin[k] = FLT_MAX;
+			accMax[k] = -FLT_MAX;
+		}
+		accCount = 0;
+		for (uint32_t b = 1; b < binCount; b++) {
+			for (int k = 0; k < 3; k++) {
+				accMin[k] = std::min(accMin[k], bins[b - 1].minBounds[k]);
+				accMax[k] = std::max(accMax[k], bins[b - 1].maxBounds[k]);
+			}
+			accCount += bins[b - 1].count;
+			if (accCount == 0 || rightCount[b] == 0) continue;
+
+			float cost = surfaceArea(accMin, accMax) * accCount + rightArea[b] * rightCount[b];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	float parentArea = surfaceArea(minBounds, maxBounds);
+	if (bestAxis >= 0 && parentArea > 0.0f) {
+		bestCost = settings.sahTraversalCost + settings.sahIntersectionCost * bestCost / parentArea;
+	}
+
+	if (bestAxis < 0) {
+		// Every centroid is in the same spot, SAH cannot separate them
+		if (triangleCount <= settings.maxLeafSize) return false;
+		mid = start + triangleCount / 2;
+		return true;
+	}
+
+	if (bestCost >= leafCost && triangleCount <= settings.maxLeafSize) {
+		return false;
+	}
+
+	auto split = std::partition(indices.begin() + start, indices.begin() + end,
+		[&](uint32_t prim) {
+		float offset = (centroids[prim * 3 + bestAxis] - centroidMin[bestAxis]) * scale[bestAxis];
+		uint32_t b = offset > 0.0f ? std::min(binCount - 1, (uint32_t)offset) : 0;
+		return b < bestBin;
+	});
+
+	mid = (uint32_t)(split - indices.begin());
+	return true;
+}
+
+inline float BVHBuilder::surfaceArea(const float minBounds[3], const float maxBounds[3]) {
+	float dx = std::max(0.0f, maxBounds[0] - minBounds[0]);
+	float dy = std::max(0.0f, maxBounds[1] - minBounds[1]);
+	float dz = std::max(0.0f, maxBounds[2] - minBounds[2]);
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+// Spreads the low 21 bits of v so there are two zero bits between each of them
+inline uint64_t BVHBuilder::expandBits(uint64_t v) {
+	v &= 0x1FFFFF;
+	v = (v | v << 32) & 0x1F00000000FFFFull;
+	v = (v | v << 16) & 0x1F0000FF0000FFull;
+	v = (v | v << 8) & 0x100F00F00F00F00Full;
+	v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+inline int BVHBuilder::countLeadingZeros(uint64_t v) {
+	if (v == 0) return 64;
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, v);
+	return 63 - (int)index;
+#else
+	return __builtin_clzll(v);
+#endif
+}
+
+inline float BVHBuilder::computeSAHCost(const std::vector<BVHNode>& nodes, float traversalCost, float intersectionCost) {
+	if (nodes.empty()) return 0.0f;
+
+	float rootArea = surfaceArea(nodes[0].minBounds, nodes[0].maxBounds);
+	if (rootArea <= 0.0f) return 0.0f;
+
+	float cost = 0.0f;
+	for (const BVHNode& node : nodes) {
+		float area = surfaceArea(node.minBounds, node.maxBounds) / rootArea;
+		if (node.leftChild == 0) {
+			cost += intersectionCost * node.triangleCount * area;
+		}
+		else {
+			cost += traversalCost * area;
+		}
+	}
+	return cost;
+}
+
+inline const char* BVHBuilder::modeName(BVHBuildMode mode) {
+	switch (mode) {
+	case BVHBuildMode::BinnedSAH: return "binned SAH";
+	case BVHBuildMode::LBVH: return "LBVH";
+	default: return "median";
+	}
+}
+
+template<typename TriangleT>
+void benchmarkBVHBuild(const std::vector<TriangleT>& triangles, BVHBuildSettings settings, unsigned maxThreads) {
+	if (maxThreads == 0) maxThreads = ThreadPool::hardwareThreads();
+
+	std::vector<BVHNode> referenceNodes;
+	std::vector<uint32_t> referenceIndices;
+	double referenceMs = 0.0;
+
+	std::cout << "BVH build benchmark (" << BVHBuilder::modeName(settings.mode) << ", "
+		<< triangles.size() << " triangles)" << std::endl;
+
+	for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+		settings.threadCount = threads;
+		BVHBuilder builder(settings);
+
+		std::vector<BVHNode> nodes;
+		std::vector<uint32_t> indices;
+		builder.build(triangles, nodes, indices);
+		double ms = builder.getStats().buildTimeMs;
+
+		bool identical = true;
+		if (threads == 1) {
+			referenceNodes.swap(nodes);
+			referenceIndices.swap(indices);
+			referenceMs = ms;
+		}
+		else {
+			identical = nodes.size() == referenceNodes.size() && indices == referenceIndices &&
+				memcmp(nodes.data(), referenceNodes.data(), nodes.size() * sizeof(BVHNode)) == 0;
+		}
+
+		printf("  %2u threads: %9.2f ms  speedup %5.2fx%s\n", threads, ms,
+			ms > 0.0 ? referenceMs / ms : 0.0, identical ? "" : "  OUTPUT DIFFERS");
+
+		if (threads >= maxThreads) break;
+	}
+}
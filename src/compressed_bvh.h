@@ -0,0 +1,169 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <float.h>
+
+#include "bvh_builder.h"
+
+// 32-byte binary BVH node with 8-bit quantized child boxes (must match CompressedBVHNode in GLSL).
+// Children are stored side by side at child and child + 1, so one index covers both.
+// Internal record: child boxes are origin + q * 2^(exponent - 127) per axis, rounded outwards.
+// Leaf record: child is the first triangle, exponents holds the triangle count.
+struct CompressedBVHNode {
+	float origin[3];
+	uint32_t exponents;    // biased exponent x, y, z in bytes 0-2, flags in byte 3
+	uint8_t quantized[12]; // left lo xyz, left hi xyz, right lo xyz, right hi xyz
+	uint32_t child;        // internal: index of the left child, leaf: first triangle
+};
+
+// Flags in the top byte of CompressedBVHNode::exponents
+const uint32_t COMPRESSED_BVH_LEFT_LEAF = 1;
+const uint32_t COMPRESSED_BVH_RIGHT_LEAF = 2;
+const uint32_t COMPRESSED_BVH_RIGHT_EMPTY = 4;
+
+// Compressed copy of the binary tree in breadth-first order, so the two
+// children of every node are adjacent
+class CompressedBVH {
+public:
+	void build(const std::vector<BVHNode>& nodes);
+
+	// Re-quantizes the child boxes from a refitted binary tree, the layout stays
+	void refitFrom(const std::vector<BVHNode>& nodes);
+
+	void clear();
+
+	bool empty() const { return records.empty(); }
+	size_t getNodeCount() const { return records.size(); }
+	const std::vector<CompressedBVHNode>& getNodes() const { return records; }
+
+private:
+	std::vector<CompressedBVHNode> records;
+	std::vector<uint32_t> sources;     // binary node behind every record
+	std::vector<uint8_t> childCounts;  // 0 for leaf records, 1 or 2 for internal ones
+
+	void encode(CompressedBVHNode& record, const BVHNode* left, const BVHNode* right) const;
+	static uint8_t quantizeLow(float value, float origin, float scale);
+	static uint8_t quantizeHigh(float value, float origin, float scale);
+};
+
+// Implementation
+inline void CompressedBVH::clear() {
+	records.clear();
+	sources.clear();
+	childCounts.clear();
+}
+
+inline void CompressedBVH::build(const std::vector<BVHNode>& nodes) {
+	clear();
+	if (nodes.empty()) return;
+
+	// The root record is always internal, a leaf root becomes its only child
+	records.emplace_back();
+	sources.push_back(0);
+	childCounts.push_back(0);
+
+	for (size_t i = 0; i < records.size(); i++) {
+		const BVHNode& node = nodes[sources[i]];
+		bool isRoot = i == 0;
+
+		if (node.leftChild == 0 && !isRoot) {
+			records[i] = CompressedBVHNode();
+			records[i].child = node.triangleOffset;
+			records[i].exponents = node.triangleCount;
+			continue;
+		}
+
+		uint32_t first = (uint32_t)records.size();
+		records[i].child = first;
+		if (node.leftChild == 0) {
+			sources.push_back(sources[i]);
+			childCounts[i] = 1;
+		}
+		else {
+			sources.push_back(node.leftChild);
+			sources.push_back(node.triangleCount);
+			childCounts[i] = 2;
+		}
+		records.resize(sources.size());
+		childCounts.resize(sources.size(), 0);
+	}
+
+	refitFrom(nodes);
+}
+
+inline void CompressedBVH::refitFrom(const std::vector<BVHNode>& nodes) {
+	for (size_t i = 0; i < records.size(); i++) {
+		if (childCounts[i] == 0) continue;
+
+		uint32_t first = records[i].child;
+		const BVHNode* left = &nodes[sources[first]];
+		const BVHNode* right = childCounts[i] > 1 ? &nodes[sources[first + 1]] : nullptr;
+		encode(records[i], left, right);
+
+		uint32_t flags = 0;
+		if (childCounts[first] == 0) flags |= COMPRESSED_BVH_LEFT_LEAF;
+		if (!right) flags |= COMPRESSED_BVH_RIGHT_EMPTY;
+		else if (childCounts[first + 1] == 0) flags |= COMPRESSED_BVH_RIGHT_LEAF;
+		records[i].exponents |= flags << 24;
+	}
+}
+
+inline void CompressedBVH::encode(CompressedBVHNode& record, const BVHNode* left, const BVHNode* right) const {
+	float minBounds[3], maxBounds[3];
+	for (int axis = 0; axis < 3; axis++) {
+		minBounds[axis] = left->minBounds[axis];
+		maxBounds[axis] = left->maxBounds[axis];
+		if (right) {
+			minBounds[axis] = std::min(minBounds[axis], right->minBounds[axis]);
+			maxBounds[axis] = std::max(maxBounds[axis], right->maxBounds[axis]);
+		}
+	}
+
+	record.exponents = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		record.origin[axis] = minBounds[axis];
+
+		// Smallest power of two step that spans the node in 255 steps
+		float extent = maxBounds[axis] - minBounds[axis];
+		int exponent = extent > 0.0f ? (int)std::ceil(std::log2(extent / 255.0f)) : -126;
+		exponent = std::max(-126, std::min(127, exponent));
+
+		// Rounding of the decode can still fall short of the top, then take the next step size
+		uint8_t q[4];
+		while (true) {
+			float scale = std::ldexp(1.0f, exponent);
+			q[0] = quantizeLow(left->minBounds[axis], record.origin[axis], scale);
+			q[1] = quantizeHigh(left->maxBounds[axis], record.origin[axis], scale);
+			q[2] = right ? quantizeLow(right->minBounds[axis], record.origin[axis], scale) : 0;
+			q[3] = right ? quantizeHigh(right->maxBounds[axis], record.origin[axis], scale) : 0;
+
+			bool covered = record.origin[axis] + 255.0f * scale >= maxBounds[axis] &&
+				std::fma(255.0f, scale, record.origin[axis]) >= maxBounds[axis];
+			if (covered || exponent >= 127) break;
+			exponent++;
+		}
+
+		record.exponents |= (uint32_t)(exponent + 127) << (8 * axis);
+		record.quantized[axis] = q[0];
+		record.quantized[3 + axis] = q[1];
+		record.quantized[6 + axis] = q[2];
+		record.quantized[9 + axis] = q[3];
+	}
+}
+
+// Largest step whose decoded value is still at or below value, for both plain and fused decodes
+inline uint8_t CompressedBVH::quantizeLow(float value, float origin, float scale) {
+	float steps = std::floor((value - origin) / scale);
+	int q = (int)std::max(0.0f, std::min(255.0f, steps));
+	while (q > 0 && (origin + q * scale > value || std::fma((float)q, scale, origin) > value)) q--;
+	return (uint8_t)q;
+}
+
+// Smallest step whose decoded value is at or above value
+inline uint8_t CompressedBVH::quantizeHigh(float value, float origin, float scale) {
+	float steps = std::ceil((value - origin) / scale);
+	int q = (int)std::max(0.0f, std::min(255.0f, steps));
+	while (q < 255 && (origin + q * scale < value || std::fma((float)q, scale, origin) < value)) q++;
+	return (uint8_t)q;
+}
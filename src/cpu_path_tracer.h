@@ -0,0 +1,692 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include "bvh_builder.h"
+#include "thread_pool.h"
+#include "tile_scheduler.h"
+#include "simd_bvh.h"
+#include "path_tracer_variant.h"
+#include "path_tracing/pt_camera.h"
+
+// CPU port of pathtracing_compute.glsl: the same camera rays, random number sequence,
+// diffuse/specular/refraction sampling, Fresnel, Russian roulette and accumulation,
+// tracing the loaders' binary BVH. Serves as a correctness oracle for kernel changes
+// and as a renderer on hosts without a GPU. TestSceneTrace returns after the floor and
+// the light quad, so those are the only analytic objects; the SCENE blocks are not reached.
+// The scalar level walks the binary tree exactly like traverseOBJBinaryBVH; the SIMD levels
+// (simd_bvh.h) find the same closest hits in a different order and never drop stack entries.
+// Frames are rendered in tiles handed out by a work-stealing TileScheduler.
+// Images are RGBA floats with row 0 at the bottom, like a GL texture readback.
+class CPUPathTracer {
+public:
+	// threadCount == 0 uses one worker per hardware thread, 1 renders on the calling thread
+	explicit CPUPathTracer(unsigned threadCount = 0);
+
+	CPUPathTracer(const CPUPathTracer&) = delete;
+	CPUPathTracer& operator=(const CPUPathTracer&) = delete;
+
+	// Copies the scene in the layout the kernel reads: triangleIndices maps each BVH leaf
+	// position to a triangle (empty when the triangles already are in BVH order).
+	// TriangleT is the Triangle of obj_loader.h or gltf_loader.h.
+	template<typename TriangleT>
+	void setScene(const std::vector<BVHNode>& nodes, const std::vector<TriangleT>& triangles,
+		const std::vector<uint32_t>& triangleIndices, size_t materialCount);
+
+	// Equirectangular RGB environment, bottom row first (stbi_loadf with flipped loading)
+	void setEnvironment(const float* rgb, int width, int height);
+
+	// MAX_BOUNCES, SAMPLES_PER_DISPATCH and HAS_REFRACTION of the variant
+	void setVariant(const PathTracerVariant& variant);
+	// The sphereX uniform, which moves the light quad
+	void setSceneTranslation(const glm::vec3& translation) { sceneTranslation = translation; }
+
+	// Traversal instruction set, clamped to what detectSIMDLevel() found
+	void setSIMDLevel(SIMDLevel level) { simdLevel = std::min(level, detectSIMDLevel()); }
+	SIMDLevel getSIMDLevel() const { return simdLevel; }
+
+	// Single thread closest hit Mrays/s of every supported level, for pixel center primary rays
+	// and one diffuse bounce off their hits, best of repeats. Hits are checked against scalar.
+	void benchmarkTraversal(const PTCamera& camera, int width, int height, int repeats = 3) const;
+
+	// Accumulates dispatches [1, dispatches] into rgba, like that many kernel dispatches
+	// starting from a cleared image
+	void render(const PTCamera& camera, int width, int height, int dispatches, std::vector<float>& rgba);
+	// One dispatch: frame is the iFrame/iTime the kernel would see. Returns false when cancel
+	// stopped it, rgba then holds the new frame only in the tiles that finished.
+	bool renderFrame(const PTCamera& camera, int width, int height, int frame, std::vector<float>& rgba,
+		const std::atomic<bool>* cancel = nullptr);
+
+	// final.glsl: exposure 0.5, ACES and sRGB, to 8 bits with alpha 255
+	static void tonemap(const std::vector<float>& rgba, std::vector<unsigned char>& ldr);
+
+	struct ImageDifference {
+		double rmse = 0.0;         // over the RGB channels
+		double meanAbsolute = 0.0;
+		double maxAbsolute = 0.0;
+		double meanReference = 0.0; // mean RGB value of the reference, to put the errors in scale
+	};
+	static ImageDifference compare(const std::vector<float>& rgba, const std::vector<float>& reference);
+
+	unsigned getThreadCount() const { return pool ? pool->getThreadCount() : 1; }
+
+	// Tile size, order and stealing of the renders, and the per-tile timings of the last one
+	TileScheduler& getTileScheduler() { return scheduler; }
+	const TileScheduler& getTileScheduler() const { return scheduler; }
+
+private:
+
+	// Kernel constants
+	static constexpr float MINIMUM_RAY_HIT_TIME = 0.01f;
+	static constexpr float SUPER_FAR = 10000.0f;
+	static constexpr float RAY_POS_NORMAL_NUDGE = 0.00001f;
+	static constexpr float PI = 3.14159265359f;
+
+	struct SurfaceMaterial {
+		glm::vec3 albedo = glm::vec3(0.0f);
+		glm::vec3 emissive = glm::vec3(0.0f);
+		float specularChance = 0.0f;
+		float specularRoughness = 0.0f;
+		glm::vec3 specularColor = glm::vec3(0.0f);
+		float IOR = 1.0f;
+		float refractionChance = 0.0f;
+		float refractionRoughness = 0.0f;
+		glm::vec3 refractionColor = glm::vec3(0.0f);
+	};
+
+	struct HitInfo {
+		bool fromInside = false;
+		float dist = SUPER_FAR;
+		glm::vec3 normal = glm::vec3(0.0f);
+		SurfaceMaterial material;
+	};
+
+	std::unique_ptr<ThreadPool> pool;
+	TileScheduler scheduler;
+	std::vector<BVHNode> nodes;
+	std::vector<CPUTriangle> triangles; // BVH order, as in the intersection buffer
+	SIMDBVH simdBVH;
+	SIMDLevel simdLevel = detectSIMDLevel();
+	size_t materialCount = 0;
+
+	std::vector<float> environment;
+	int environmentWidth = 0;
+	int environmentHeight = 0;
+
+	int maxBounces = 2;
+	int samplesPerDispatch = 1;
+	bool hasRefraction = true;
+	glm::vec3 sceneTranslation = glm::vec3(0.0f);
+
+	bool renderFrames(const PTCamera& camera, int width, int height, int firstFrame, int lastFrame,
+		std::vector<float>& rgba, const std::atomic<bool>* cancel = nullptr);
+	glm::vec3 colorForRay(glm::vec3 rayPos, glm::vec3 rayDir, uint32_t& rngState) const;
+	void traceScene(const glm::vec3& rayPos, const glm::vec3& rayDir, HitInfo& hitInfo) const;
+	bool traverseBVH(const glm::vec3& rayOrigin, const glm::vec3& rayDir, HitInfo& hitInfo) const;
+	// Closest triangle below t at the given level, t and triangle are updated on a hit
+	bool intersectBVH(SIMDLevel level, const glm::vec3& rayOrigin, const glm::vec3& rayDir, float& t, uint32_t& triangle) const;
+	bool intersectBinaryBVH(const glm::vec3& rayOrigin, const glm::vec3& rayDir, float& t, uint32_t& triangle) const;
+	glm::vec3 sampleEnvironment(const glm::vec3& direction) const;
+
+	static bool rayBoxIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDir, const BVHNode& node, float maxT);
+	static bool triangleIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDir, const CPUTriangle& tri,
+		float& t);
+	static bool quadTrace(const glm::vec3& rayPos, const glm::vec3& rayDir, HitInfo& info,
+		glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d);
+	static float fresnelReflectAmount(float n1, float n2, const glm::vec3& normal, const glm::vec3& incident,
+		float f0, float f90);
+
+	static uint32_t wangHash(uint32_t& seed);
+	static float randomFloat01(uint32_t& state) { return (float)wangHash(state) / 4294967296.0f; }
+	static glm::vec3 randomUnitVector(uint32_t& state);
+};
+
+// Implementation
+inline CPUPathTracer::CPUPathTracer(unsigned threadCount) {
+	if (threadCount != 1) pool = std::make_unique<ThreadPool>(threadCount);
+}
+
+template<typename TriangleT>
+void CPUPathTracer::setScene(const std::vector<BVHNode>& bvhNodes, const std::vector<TriangleT>& sceneTriangles,
+	const std::vector<uint32_t>& triangleIndices, size_t sceneMaterialCount) {
+	nodes = bvhNodes;
+	materialCount = sceneMaterialCount;
+
+	auto position = [](const float* p) { return glm::vec3(p[0], p[1], p[2]); };
+	triangles.resize(sceneTriangles.size());
+	for (size_t i = 0; i < sceneTriangles.size(); i++) {
+		const TriangleT& tri = sceneTriangles[triangleIndices.empty() ? i : triangleIndices[i]];
+		glm::vec3 v0 = position(tri.v0.position);
+		triangles[i].v0 = v0;
+		triangles[i].edge1 = position(tri.v1.position) - v0;
+		triangles[i].edge2 = position(tri.v2.position) - v0;
+		triangles[i].materialIndex = tri.materialIndex;
+	}
+	simdBVH.build(nodes, triangles);
+}
+
+inline void CPUPathTracer::setEnvironment(const float* rgb, int width, int height) {
+	environment.assign(rgb, rgb + (size_t)width * height * 3);
+	environmentWidth = width;
+	environmentHeight = height;
+}
+
+inline void CPUPathTracer::setVariant(const PathTracerVariant& variant) {
+	maxBounces = variant.maxBounces;
+	samplesPerDispatch = variant.samplesPerDispatch;
+	hasRefraction = variant.hasRefraction != 0;
+}
+
+inline void CPUPathTracer::render(const PTCamera& camera, int width, int height, int dispatches, std::vector<float>& rgba) {
+	rgba.assign((size_t)width * height * 4, 0.0f);
+	renderFrames(camera, width, height, 1, dispatches, rgba);
+}
+
+inline bool CPUPathTracer::renderFrame(const PTCamera& camera, int width, int height, int frame, std::vector<float>& rgba,
+	const std::atomic<bool>* cancel) {
+	rgba.resize((size_t)width * height * 4, 0.0f);
+	return renderFrames(camera, width, height, frame, frame, rgba, cancel);
+}
+
+inline bool CPUPathTracer::renderFrames(const PTCamera& camera, int width, int height, int firstFrame, int lastFrame,
+	std::vector<float>& rgba, const std::atomic<bool>* cancel) {
+	float aspectRatio = (float)width / (float)height;
+	float cameraDistance = std::tan(camera.fov * 0.5f * PI / 180.0f);
+	glm::vec3 origin = camera.cameraPos + camera.cameraMov;
+
+	// Every tile runs all its frames, pixels never depend on each other
+	auto renderTile = [&](const TileScheduler::Tile& tile) {
+		for (int y = tile.y0; y < tile.y1; y++) {
+			for (int x = tile.x0; x < tile.x1; x++) {
+				float* pixel = &rgba[((size_t)y * width + x) * 4];
+				for (int frame = firstFrame; frame <= lastFrame; frame++) {
+					uint32_t rngState = ((uint32_t)x * 1973u + (uint32_t)y * 9277u + (uint32_t)frame * 26699u) | 1u;
+
+					glm::vec2 jitter = glm::vec2(randomFloat01(rngState), randomFloat01(rngState)) - 0.5f;
+					glm::vec2 screen = (glm::vec2((float)x, (float)y) + jitter) / glm::vec2((float)width, (float)height);
+					screen = screen * 2.0f - 1.0f;
+					screen.y /= aspectRatio;
+					glm::vec3 rayDir = glm::normalize(camera.cameraRight * screen.x + camera.cameraUp * screen.y +
+						camera.cameraPos * cameraDistance);
+
+					glm::vec3 color(0.0f);
+					for (int index = 0; index < samplesPerDispatch; index++)
+						color += colorForRay(origin, rayDir, rngState) / (float)samplesPerDispatch;
+
+					float blend = (frame < 2 || pixel[3] == 0.0f) ? 1.0f : 1.0f / (1.0f + (1.0f / pixel[3]));
+					color = glm::mix(glm::vec3(pixel[0], pixel[1], pixel[2]), color, blend);
+					pixel[0] = color.r;
+					pixel[1] = color.g;
+					pixel[2] = color.b;
+					pixel[3] = blend;
+				}
+			}
+		}
+	};
+
+	scheduler.setup(width, height);
+	return scheduler.run(pool.get(), renderTile, cancel);
+}
+
+inline glm::vec3 CPUPathTracer::colorForRay(glm::vec3 rayPos, glm::vec3 rayDir, uint32_t& rngState) const {
+	glm::vec3 ret(0.0f);
+	glm::vec3 throughput(1.0f);
+
+	for (int bounceIndex = 0; bounceIndex < maxBounces; ++bounceIndex) {
+		HitInfo hitInfo;
+		traceScene(rayPos, rayDir, hitInfo);
+
+		if (hitInfo.dist == SUPER_FAR) {
+			ret += glm::min(sampleEnvironment(glm::normalize(rayDir)), glm::vec3(1.0f)) * throughput;
+			break;
+		}
+
+		if (hasRefraction && hitInfo.fromInside)
+			throughput *= glm::exp(-hitInfo.material.refractionColor * hitInfo.dist);
+
+		// Fresnel adjusted chances, specular takes priority
+		float specularChance = hitInfo.material.specularChance;
+		float refractionChance = hasRefraction ? hitInfo.material.refractionChance : 0.0f;
+		float diffuseChance = std::max(0.0f, 1.0f - (refractionChance + specularChance));
+
+		float rayProbability = 1.0f;
+		if (specularChance > 0.0f) {
+			specularChance = fresnelReflectAmount(
+				hitInfo.fromInside ? hitInfo.material.IOR : 1.0f,
+				!hitInfo.fromInside ? hitInfo.material.IOR : 1.0f,
+				rayDir, hitInfo.normal, hitInfo.material.specularChance, 1.0f);
+
+			float chanceMultiplier = (1.0f - specularChance) / (1.0f - hitInfo.material.specularChance);
+			refractionChance *= chanceMultiplier;
+			diffuseChance *= chanceMultiplier;
+		}
+
+		float doSpecular = 0.0f;
+		float doRefraction = 0.0f;
+		float raySelectRoll = randomFloat01(rngState);
+		if (specularChance > 0.0f && raySelectRoll < specularChance) {
+			doSpecular = 1.0f;
+			rayProbability = specularChance;
+		}
+		else if (refractionChance > 0.0f && raySelectRoll < specularChance + refractionChance) {
+			doRefraction = 1.0f;
+			rayProbability = refractionChance;
+		}
+		else {
+			rayProbability = 1.0f - (specularChance + refractionChance);
+		}
+		rayProbability = std::max(rayProbability, 0.001f);
+
+		if (doRefraction == 1.0f)
+			rayPos = (rayPos + rayDir * hitInfo.dist) - hitInfo.normal * RAY_POS_NORMAL_NUDGE;
+		else
+			rayPos = (rayPos + rayDir * hitInfo.dist) + hitInfo.normal * RAY_POS_NORMAL_NUDGE;
+
+		// The random numbers are drawn in the kernel's order, so both trace the same paths
+		glm::vec3 diffuseRayDir = glm::normalize(hitInfo.normal + randomUnitVector(rngState));
+
+		const SurfaceMaterial& material = hitInfo.material;
+		glm::vec3 specularRayDir = glm::reflect(rayDir, hitInfo.normal);
+		specularRayDir = glm::normalize(glm::mix(specularRayDir, diffuseRayDir,
+			material.specularRoughness * material.specularRoughness));
+
+		glm::vec3 refractionRayDir(0.0f);
+		if (hasRefraction) {
+			refractionRayDir = glm::refract(rayDir, hitInfo.normal, hitInfo.fromInside ? material.IOR : 1.0f / material.IOR);
+			refractionRayDir = glm::normalize(glm::mix(refractionRayDir, glm::normalize(-hitInfo.normal + randomUnitVector(rngState)),
+				material.refractionRoughness * material.refractionRoughness));
+		}
+
+		rayDir = glm::mix(diffuseRayDir, specularRayDir, doSpecular);
+		if (hasRefraction)
+			rayDir = glm::mix(rayDir, refractionRayDir, doRefraction);
+
+		ret += material.emissive * throughput;
+
+		if (doRefraction == 0.0f)
+			throughput *= glm::mix(material.albedo, material.specularColor, doSpecular);
+		throughput /= rayProbability;
+
+		// Russian roulette
+		float p = std::max(throughput.r, std::max(throughput.g, throughput.b));
+		if (randomFloat01(rngState) > p)
+			break;
+		throughput *= 1.0f / p;
+
+		throughput = glm::clamp(throughput, 0.0f, 1.0f);
+	}
+
+	return ret;
+}
+
+inline void CPUPathTracer::traceScene(const glm::vec3& rayPos, const glm::vec3& rayDir, HitInfo& hitInfo) const {
+	traverseBVH(rayPos, rayDir, hitInfo);
+
+	// Floor
+	if (quadTrace(rayPos, rayDir, hitInfo, glm::vec3(-50.0f, -12.5f, 50.0f), glm::vec3(50.0f, -12.5f, 50.0f),
+		glm::vec3(50.0f, -12.5f, -50.0f), glm::vec3(-50.0f, -12.5f, -50.0f))) {
+		hitInfo.material = SurfaceMaterial();
+		hitInfo.material.albedo = glm::vec3(1.0f);
+	}
+
+	// Light
+	glm::vec3 t = sceneTranslation;
+	if (quadTrace(rayPos, rayDir, hitInfo, glm::vec3(-5.0f, 2.4f, 2.5f) + t, glm::vec3(5.0f, 2.4f, 2.5f) + t,
+		glm::vec3(5.0f, -5.4f, 2.5f) + t, glm::vec3(-5.0f, -5.4f, 2.5f) + t)) {
+		hitInfo.material = SurfaceMaterial();
+		hitInfo.material.emissive = glm::vec3(1.0f, 0.9f, 0.7f) * 10.0f;
+	}
+}
+
+inline bool CPUPathTracer::traverseBVH(const glm::vec3& rayOrigin, const glm::vec3& rayDir, HitInfo& hitInfo) const {
+	float t = hitInfo.dist;
+	uint32_t bestTriangle = 0;
+	bool hit = intersectBVH(simdLevel, rayOrigin, rayDir, t, bestTriangle);
+
+	if (hit) {
+		hitInfo.dist = t;
+		const CPUTriangle& tri = triangles[bestTriangle];
+		hitInfo.normal = glm::normalize(glm::cross(tri.edge1, tri.edge2));
+
+		// The kernel shades every OBJ material alike, out of range indices get the default
+		hitInfo.material = SurfaceMaterial();
+		hitInfo.material.specularRoughness = 0.0f;
+		hitInfo.material.specularColor = glm::vec3(1.0f) * 0.8f;
+		hitInfo.material.IOR = 1.5f;
+		if (tri.materialIndex < materialCount) {
+			hitInfo.material.albedo = glm::vec3(0.9f);
+			hitInfo.material.specularChance = 0.02f;
+		}
+		else {
+			hitInfo.material.albedo = glm::vec3(0.9f, 0.4f, 0.9f);
+			hitInfo.material.specularChance = 0.1f;
+		}
+	}
+	return hit;
+}
+
+inline bool CPUPathTracer::intersectBVH(SIMDLevel level, const glm::vec3& rayOrigin, const glm::vec3& rayDir,
+	float& t, uint32_t& triangle) const {
+	if (level == SIMDLevel::Scalar || simdBVH.empty())
+		return intersectBinaryBVH(rayOrigin, rayDir, t, triangle);
+	return simdBVH.intersect(level, rayOrigin, rayDir, MINIMUM_RAY_HIT_TIME, t, t, triangle);
+}
+
+inline bool CPUPathTracer::intersectBinaryBVH(const glm::vec3& rayOrigin, const glm::vec3& rayDir, float& t,
+	uint32_t& triangle) const {
+	if (nodes.empty()) return false;
+
+	bool hit = false;
+
+	// Same stack depth and overflow behaviour as traverseOBJBinaryBVH
+	uint32_t stack[32];
+	int stackPtr = 0;
+	stack[stackPtr++] = 0;
+
+	while (stackPtr > 0) {
+		uint32_t nodeIndex = stack[--stackPtr];
+		if (nodeIndex >= nodes.size()) continue;
+
+		const BVHNode& node = nodes[nodeIndex];
+		if (!rayBoxIntersect(rayOrigin, rayDir, node, t)) continue;
+
+		if (node.leftChild == 0) {
+			for (uint32_t i = 0; i < node.triangleCount; i++) {
+				uint32_t triIndex = node.triangleOffset + i;
+				if (triIndex >= triangles.size()) continue;
+
+				float dist = t;
+				if (triangleIntersect(rayOrigin, rayDir, triangles[triIndex], dist) &&
+					dist < t && dist > MINIMUM_RAY_HIT_TIME) {
+					t = dist;
+					triangle = triIndex;
+					hit = true;
+				}
+			}
+		}
+		else if (stackPtr < 30) {
+			stack[stackPtr++] = node.triangleCount; // right child
+			stack[stackPtr++] = node.leftChild;
+		}
+	}
+	return hit;
+}
+
+inline glm::vec3 CPUPathTracer::sampleEnvironment(const glm::vec3& direction) const {
+	if (environment.empty()) return glm::vec3(0.0f);
+
+	// SampleSphericalMap, then a GL_LINEAR fetch with GL_CLAMP_TO_EDGE
+	glm::vec2 uv = glm::vec2(std::atan2(direction.z, direction.x), std::asin(direction.y));
+	uv = uv * glm::vec2(0.1591f, 0.3183f) + 0.5f;
+
+	float fx = uv.x * environmentWidth - 0.5f;
+	float fy = uv.y * environmentHeight - 0.5f;
+	int x0 = (int)std::floor(fx);
+	int y0 = (int)std::floor(fy);
+	float tx = fx - x0;
+	float ty = fy - y0;
+
+	auto texel = [&](int x, int y) {
+		x = std::min(std::max(x, 0), environmentWidth - 1);
+		y = std::min(std::max(y, 0), environmentHeight - 1);
+		const float* p = &environment[((size_t)y * environmentWidth + x) * 3];
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+	glm::vec3 bottom = glm::mix(texel(x0, y0), texel(x0 + 1, y0), tx);
+	glm::vec3 top = glm::mix(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), tx);
+	return glm::mix(bottom, top, ty);
+}
+
+inline bool CPUPathTracer::rayBoxIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDir, const BVHNode& node, float maxT) {
+	glm::vec3 invDir = 1.0f / rayDir;
+	glm::vec3 t0 = (glm::vec3(node.minBounds[0], node.minBounds[1], node.minBounds[2]) - rayOrigin) * invDir;
+	glm::vec3 t1 = (glm::vec3(node.maxBounds[0], node.maxBounds[1], node.maxBounds[2]) - rayOrigin) * invDir;
+
+	glm::vec3 tmin = glm::min(t0, t1);
+	glm::vec3 tmax = glm::max(t0, t1);
+	float tnear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+	float tfar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+
+	return tnear <= tfar && tfar > 0.0f && tnear < maxT;
+}
+
+inline bool CPUPathTracer::triangleIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDir,
+	const CPUTriangle& tri, float& t) {
+	// Moller-Trumbore, as objTriangleIntersect
+	glm::vec3 h = glm::cross(rayDir, tri.edge2);
+	float a = glm::dot(tri.edge1, h);
+	if (a > -0.00001f && a < 0.00001f) return false;
+
+	float f = 1.0f / a;
+	glm::vec3 s = rayOrigin - tri.v0;
+	float u = f * glm::dot(s, h);
+	if (u < 0.0f || u > 1.0f) return false;
+
+	glm::vec3 q = glm::cross(s, tri.edge1);
+	float v = f * glm::dot(rayDir, q);
+	if (v < 0.0f || u + v > 1.0f) return false;
+
+	float dist = f * glm::dot(tri.edge2, q);
+	if (dist > 0.000001f && dist < t) {
+		t = dist;
+		return true;
+	}
+	return false;
+}
+
+inline bool CPUPathTracer::quadTrace(const glm::vec3& rayPos, const glm::vec3& rayDir, HitInfo& info,
+	glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d) {
+	// Normal faces the ray, vertex order flips with it
+	glm::vec3 normal = glm::normalize(glm::cross(c - a, c - b));
+	if (glm::dot(normal, rayDir) > 0.0f) {
+		normal *= -1.0f;
+		std::swap(a, d);
+		std::swap(b, c);
+	}
+
+	glm::vec3 pq = (rayPos + rayDir) - rayPos;
+	glm::vec3 pa = a - rayPos;
+	glm::vec3 pb = b - rayPos;
+	glm::vec3 pc = c - rayPos;
+
+	// Pick the triangle by testing against the diagonal first
+	glm::vec3 m = glm::cross(pc, pq);
+	float v = glm::dot(pa, m);
+	glm::vec3 intersectPos;
+	if (v >= 0.0f) {
+		float u = -glm::dot(pb, m);
+		if (u < 0.0f) return false;
+		float w = glm::dot(glm::cross(pq, pb), pa);
+		if (w < 0.0f) return false;
+		float denom = 1.0f / (u + v + w);
+		intersectPos = u * denom * a + v * denom * b + w * denom * c;
+	}
+	else {
+		glm::vec3 pd = d - rayPos;
+		float u = glm::dot(pd, m);
+		if (u < 0.0f) return false;
+		float w = glm::dot(glm::cross(pq, pa), pd);
+		if (w < 0.0f) return false;
+		v = -v;
+		float denom = 1.0f / (u + v + w);
+		intersectPos = u * denom * a + v * denom * d + w * denom * c;
+	}
+
+	float dist;
+	if (std::abs(rayDir.x) > 0.1f) dist = (intersectPos.x - rayPos.x) / rayDir.x;
+	else if (std::abs(rayDir.y) > 0.1f) dist = (intersectPos.y - rayPos.y) / rayDir.y;
+	else dist = (intersectPos.z - rayPos.z) / rayDir.z;
+
+	if (dist > MINIMUM_RAY_HIT_TIME && dist < info.dist) {
+		info.dist = dist;
+		info.normal = normal;
+		return true;
+	}
+	return false;
+}
+
+inline float CPUPathTracer::fresnelReflectAmount(float n1, float n2, const glm::vec3& normal, const glm::vec3& incident,
+	float f0, float f90) {
+	// Schlick approximation
+	float r0 = (n1 - n2) / (n1 + n2);
+	r0 *= r0;
+	float cosX = -glm::dot(normal, incident);
+	if (n1 > n2) {
+		float n = n1 / n2;
+		float sinT2 = n * n * (1.0f - cosX * cosX);
+		// Total internal reflection
+		if (sinT2 > 1.0f) return f90;
+		cosX = std::sqrt(1.0f - sinT2);
+	}
+	float x = 1.0f - cosX;
+	float ret = r0 + (1.0f - r0) * x * x * x * x * x;
+	return glm::mix(f0, f90, ret);
+}
+
+inline uint32_t CPUPathTracer::wangHash(uint32_t& seed) {
+	seed = (seed ^ 61u) ^ (seed >> 16);
+	seed *= 9u;
+	seed = seed ^ (seed >> 4);
+	seed *= 0x27d4eb2du;
+	seed = seed ^ (seed >> 15);
+	return seed;
+}
+
+inline glm::vec3 CPUPathTracer::randomUnitVector(uint32_t& state) {
+	float z = randomFloat01(state) * 2.0f - 1.0f;
+	float a = randomFloat01(state) * 2.0f * PI;
+	float r = std::sqrt(1.0f - z * z);
+	return glm::vec3(r * std::cos(a), r * std::sin(a), z);
+}
+
+inline void CPUPathTracer::tonemap(const std::vector<float>& rgba, std::vector<unsigned char>& ldr) {
+	ldr.resize(rgba.size());
+	for (size_t i = 0; i + 3 < rgba.size(); i += 4) {
+		for (int channel = 0; channel < 3; channel++) {
+			float x = rgba[i + channel] * 0.5f;
+			x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+			x = std::min(std::max(x, 0.0f), 1.0f);
+			x = x < 0.0031308f ? x * 12.92f : std::pow(x, 1.0f / 2.4f) * 1.055f - 0.055f;
+			ldr[i + channel] = (unsigned char)std::lround(std::min(std::max(x, 0.0f), 1.0f) * 255.0f);
+		}
+		ldr[i + 3] = 255;
+	}
+}
+
+inline CPUPathTracer::ImageDifference CPUPathTracer::compare(const std::vector<float>& rgba, const std::vector<float>& reference) {
+	ImageDifference difference;
+	size_t count = std::min(rgba.size(), reference.size()) / 4 * 3;
+	if (count == 0) return difference;
+
+	double squared = 0.0, absolute = 0.0, sum = 0.0;
+	for (size_t i = 0; i + 3 < std::min(rgba.size(), reference.size()); i += 4) {
+		for (int channel = 0; channel < 3; channel++) {
+			double delta = std::abs((double)rgba[i + channel] - (double)reference[i + channel]);
+			squared += delta * delta;
+			absolute += delta;
+			sum += reference[i + channel];
+			difference.maxAbsolute = std::max(difference.maxAbsolute, delta);
+		}
+	}
+	difference.rmse = std::sqrt(squared / count);
+	difference.meanAbsolute = absolute / count;
+	difference.meanReference = sum / count;
+	return difference;
+}
+
+inline void CPUPathTracer::benchmarkTraversal(const PTCamera& camera, int width, int height, int repeats) const {
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct RaySet {
+		const char* name;
+		std::vector<glm::vec3> origins;
+		std::vector<glm::vec3> directions;
+	};
+	RaySet primary{ "primary", {}, {} };
+	RaySet bounce{ "diffuse", {}, {} };
+
+	// Pixel centers, shot like renderFrames without the jitter
+	float aspectRatio = (float)width / (float)height;
+	float cameraDistance = std::tan(camera.fov * 0.5f * PI / 180.0f);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			glm::vec2 screen = glm::vec2((float)x, (float)y) / glm::vec2((float)width, (float)height) * 2.0f - 1.0f;
+			screen.y /= aspectRatio;
+			primary.origins.push_back(camera.cameraPos + camera.cameraMov);
+			primary.directions.push_back(glm::normalize(camera.cameraRight * screen.x + camera.cameraUp * screen.y +
+				camera.cameraPos * cameraDistance));
+		}
+	}
+
+	// Traces every ray at one level, returns the best time of the repeats
+	auto run = [&](SIMDLevel level, const RaySet& rays, std::vector<float>& hitT, std::vector<uint32_t>& hitTriangle) {
+		size_t count = rays.origins.size();
+		hitT.assign(count, SUPER_FAR);
+		hitTriangle.assign(count, UINT32_MAX);
+		double bestMs = 0.0;
+		for (int repeat = 0; repeat < repeats; repeat++) {
+			Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < count; i++) {
+				float t = SUPER_FAR;
+				uint32_t triangle = UINT32_MAX;
+				intersectBVH(level, rays.origins[i], rays.directions[i], t, triangle);
+				hitT[i] = t;
+				hitTriangle[i] = triangle;
+			}
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			if (repeat == 0 || ms < bestMs) bestMs = ms;
+		}
+		return bestMs;
+	};
+
+	// Diffuse bounces leave the primary hits the way GetColorForRay sends them
+	std::vector<float> primaryT;
+	std::vector<uint32_t> primaryTriangle;
+	run(SIMDLevel::Scalar, primary, primaryT, primaryTriangle);
+	uint32_t rngState = 1;
+	for (size_t i = 0; i < primaryTriangle.size(); i++) {
+		if (primaryTriangle[i] == UINT32_MAX) continue;
+		const CPUTriangle& tri = triangles[primaryTriangle[i]];
+		glm::vec3 normal = glm::normalize(glm::cross(tri.edge1, tri.edge2));
+		bounce.origins.push_back(primary.origins[i] + primary.directions[i] * primaryT[i] + normal * RAY_POS_NORMAL_NUDGE);
+		bounce.directions.push_back(glm::normalize(normal + randomUnitVector(rngState)));
+	}
+
+	printf("CPU traversal benchmark (%zu triangles, %dx%d pixels, 1 thread, best of %d)\n",
+		triangles.size(), width, height, repeats);
+	for (const RaySet* rays : { &primary, &bounce }) {
+		if (rays->origins.empty()) continue;
+
+		std::vector<float> scalarT;
+		double scalarMs = 0.0;
+		for (int l = 0; l <= (int)detectSIMDLevel(); l++) {
+			SIMDLevel level = (SIMDLevel)l;
+			std::vector<float> hitT;
+			std::vector<uint32_t> hitTriangle;
+			double ms = run(level, *rays, hitT, hitTriangle);
+
+			size_t count = hitT.size();
+			size_t hits = 0;
+			size_t differing = 0;
+			for (size_t i = 0; i < count; i++) {
+				if (hitTriangle[i] != UINT32_MAX) hits++;
+				if (level != SIMDLevel::Scalar && hitT[i] != scalarT[i]) differing++;
+			}
+			if (level == SIMDLevel::Scalar) {
+				scalarMs = ms;
+				scalarT.swap(hitT);
+			}
+
+			printf("  %-8s %-7s %9.2f Mrays/s  %5.1f%% hit  speedup %5.2fx", rays->name, simdLevelName(level),
+				count / (ms * 1000.0), 100.0 * hits / count, ms > 0.0 ? scalarMs / ms : 0.0);
+			if (differing > 0) printf("  %zu HITS DIFFER", differing);
+			printf("\n");
+		}
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <vector>
+#include <future>
+#include <atomic>
+#include <chrono>
+
+#include <glad/glad.h>
+
+#include "cpu_path_tracer.h"
+
+// Renders the game viewport with the CPU path tracer. Frames run on a background thread while
+// the UI keeps drawing; every UI frame the tiles finished so far are copied into the accumulation
+// texture, so with the spiral tile order the image fills in and converges from the centre.
+class CPUViewport {
+public:
+	struct TileSettings {
+		int tileSize = 16;
+		TileOrder order = TileOrder::Spiral;
+		bool stealing = true;
+	};
+
+	explicit CPUViewport(unsigned threadCount = 0) : tracer(threadCount) {}
+	~CPUViewport() { stop(); }
+
+	CPUViewport(const CPUViewport&) = delete;
+	CPUViewport& operator=(const CPUViewport&) = delete;
+
+	// Scene, environment and variant are set on the tracer before the first update
+	CPUPathTracer& getTracer() { return tracer; }
+	const CPUPathTracer& getTracer() const { return tracer; }
+
+	// Picked up when the next frame starts, nothing the workers read changes mid frame
+	TileSettings tileSettings;
+	glm::vec3 sceneTranslation = glm::vec3(0.0f); // the sphereX uniform
+
+	// Once per UI frame. A reset or a new size cancels the frame in flight and starts over
+	// from a cleared image; the camera is read when a frame starts.
+	void update(const PTCamera& camera, int width, int height, bool reset, GLuint texture);
+	// Cancels the frame in flight and waits for its running tiles
+	void stop();
+
+	int getFrame() const { return frame; } // frames completed since the last reset
+	double getLastFrameMs() const { return lastFrameMs; }
+
+private:
+	CPUPathTracer tracer;
+	std::vector<float> rgba;
+	int imageWidth = 0;
+	int imageHeight = 0;
+	int frame = 0;
+	double lastFrameMs = 0.0;
+
+	std::future<bool> inFlight;
+	std::atomic<bool> cancel{ false };
+	std::vector<TileScheduler::Tile> finishedTiles;
+
+	void upload(GLuint texture);
+};
+
+// Implementation
+inline void CPUViewport::stop() {
+	if (!inFlight.valid()) return;
+	cancel = true;
+	inFlight.get();
+	cancel = false;
+
+	// Tiles of the cancelled frame are not shown
+	finishedTiles.clear();
+	tracer.getTileScheduler().takeFinished(finishedTiles);
+	finishedTiles.clear();
+}
+
+inline void CPUViewport::update(const PTCamera& camera, int width, int height, bool reset, GLuint texture) {
+	if (width <= 0 || height <= 0) return;
+
+	if (reset || width != imageWidth || height != imageHeight) {
+		stop();
+		imageWidth = width;
+		imageHeight = height;
+		rgba.assign((size_t)width * height * 4, 0.0f);
+		frame = 0;
+	}
+
+	// Checked before the upload, so a finished frame has all its tiles in the list
+	bool idle = !inFlight.valid() || inFlight.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	upload(texture);
+	if (!idle) return;
+
+	if (inFlight.valid() && inFlight.get()) {
+		frame++;
+		lastFrameMs = tracer.getTileScheduler().getSummary().wallMs;
+	}
+
+	TileScheduler& scheduler = tracer.getTileScheduler();
+	scheduler.setTileSize(tileSettings.tileSize);
+	scheduler.setOrder(tileSettings.order);
+	scheduler.setStealing(tileSettings.stealing);
+	tracer.setSceneTranslation(sceneTranslation);
+
+	int nextFrame = frame + 1;
+	inFlight = std::async(std::launch::async, [this, camera, nextFrame] {
+		return tracer.renderFrame(camera, imageWidth, imageHeight, nextFrame, rgba, &cancel);
+	});
+}
+
+inline void CPUViewport::upload(GLuint texture) {
+	tracer.getTileScheduler().takeFinished(finishedTiles);
+	if (finishedTiles.empty()) return;
+
+	// A worker never touches a tile again within the frame it finished it in
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, imageWidth);
+	for (const TileScheduler::Tile& tile : finishedTiles) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, tile.x0, tile.y0, tile.x1 - tile.x0, tile.y1 - tile.y0, GL_RGBA, GL_FLOAT,
+			&rgba[((size_t)tile.y0 * imageWidth + tile.x0) * 4]);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	finishedTiles.clear();
+}
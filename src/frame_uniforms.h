@@ -0,0 +1,91 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "path_tracing/pt_camera.h"
+
+// Uniform block binding read by pathtracing_compute.glsl and final.glsl
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+// Per-frame camera and render parameters, std140 (must match FrameUniforms in GLSL).
+// Every vec3 shares its 16-byte slot with the float after it.
+struct FrameUniforms {
+	glm::vec3 cameraPos;
+	float iTime = 0.0f;
+	glm::vec3 cameraFwd;
+	float iFrame = 0.0f;
+	glm::vec3 cameraUp;
+	float u_fov = 50.0f;
+	glm::vec3 cameraRight;
+	float game_window_x = 0.0f;
+	glm::vec3 cameraMov;
+	float game_window_y = 0.0f;
+
+	void setCamera(const PTCamera& camera);
+};
+static_assert(sizeof(FrameUniforms) == 80, "FrameUniforms must match the std140 block");
+
+// Uniform buffer holding FrameUniforms, written once per frame. Consecutive frames go to
+// different slots of a small ring, so an update never waits on a dispatch still reading
+// the previous values.
+class FrameUniformBuffer {
+public:
+	FrameUniformBuffer() = default;
+	~FrameUniformBuffer() {
+		cleanup();
+	}
+
+	FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+	FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+
+	// Uploads the values into the next slot and binds it at FRAME_UNIFORMS_BINDING
+	void update(const FrameUniforms& values);
+	void cleanup();
+
+	GLuint getBuffer() const { return buffer; }
+
+private:
+	static const int SLOT_COUNT = 3;
+	GLuint buffer = 0;
+	GLsizeiptr slotSize = 0;
+	int slot = 0;
+
+	void create();
+};
+
+// Implementation
+inline void FrameUniforms::setCamera(const PTCamera& camera) {
+	cameraPos = camera.cameraPos;
+	cameraFwd = camera.cameraFwd;
+	cameraUp = camera.cameraUp;
+	cameraRight = camera.cameraRight;
+	cameraMov = camera.cameraMov;
+	u_fov = camera.fov;
+}
+
+inline void FrameUniformBuffer::create() {
+	// Slots start at multiples of the offset alignment so each can be bound on its own
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	slotSize = ((GLsizeiptr)sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, slotSize * SLOT_COUNT, nullptr, GL_DYNAMIC_DRAW);
+}
+
+inline void FrameUniformBuffer::update(const FrameUniforms& values) {
+	if (buffer == 0) create();
+
+	slot = (slot + 1) % SLOT_COUNT;
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, slot * slotSize, sizeof(FrameUniforms), &values);
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, buffer, slot * slotSize, sizeof(FrameUniforms));
+}
+
+inline void FrameUniformBuffer::cleanup() {
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "path_tracing/pt_camera.h"
+#include "bvh_builder.h"
+#include "path_tracer_variant.h"
 
 namespace gLink {
 	const int SCR_WIDTH = 1600;
@@ -24,6 +26,35 @@ namespace gLink {
 
 	inline float frame_count;
 
+	// run the CPU side benchmarks (BVH build, ...) while loading the scene
+	inline bool runBenchmarks = false;
+
+	// build the OBJ BVH with the LBVH compute shader instead of on the CPU
+	inline bool buildBVHOnGPU = false;
+
+	// BVH layout traversed by the path tracer
+	inline BVHLayout bvhLayout = BVHLayout::Wide4;
+
+	// load the built OBJ scene from <file>.scenecache when it matches, write it after a build
+	inline bool useSceneCache = true;
+
+	// path tracer options, the BVH layout and refraction are filled in from the loaded scene
+	inline PathTracerVariant pathTracerVariant;
+
+	// megakernel, wavefront or persistent threads dispatch of the path tracer, switchable in the Path Tracer window
+	inline PathTracerMode pathTracerMode = PathTracerMode::Megakernel;
+
+	// render the game viewport with the CPU path tracer, read at startup: the scene is then
+	// built on the CPU without the scene cache. The CPU Renderer window switches back and forth.
+	inline bool renderOnCPU = false;
+
+	// recompile compute shaders when their source files change
+	inline bool hotReloadShaders = true;
+
+	// time every dispatch and the UI pass with GPU timer queries, the CSV trace is written to profilerTracePath
+	inline bool profileGPU = true;
+	inline std::string profilerTracePath = "gpu_profile.csv";
+
 	// glad: load all OpenGL function pointers
 	// ---------------------------------------
 	inline void initGLAD() {
@@ -11,6 +11,8 @@
 #include "cgltf.h"
 #include <glad/glad.h>
 
+#include "bvh_builder.h"
+
 // Forward declarations
 struct cgltf_data;
 struct cgltf_node;
@@ -67,25 +69,6 @@ struct Material {
 	float refractionColor[3] = { 0.0f, 0.0f, 0.0f };
 };
 
-// BVH Node structure (GPU-friendly)
-struct BVHNode {
-	float minBounds[3];
-	uint32_t leftChild;
-	float maxBounds[3];
-	uint32_t triangleCount;
-	uint32_t triangleOffset;
-	uint32_t padding[3];
-
-	BVHNode() {
-		minBounds[0] = minBounds[1] = minBounds[2] = 0.0f;
-		maxBounds[0] = maxBounds[1] = maxBounds[2] = 0.0f;
-		leftChild = 0;
-		triangleCount = 0;
-		triangleOffset = 0;
-		padding[0] = padding[1] = padding[2] = 0;
-	}
-};
-
 class GLTFLoader {
 private:
 	std::vector<Triangle> triangles;
@@ -93,6 +76,9 @@ private:
 	std::vector<BVHNode> bvhNodes;
 	std::vector<uint32_t> triangleIndices;
 
+	BVHBuildSettings bvhSettings;
+	BVHBuildStats bvhStats;
+
 	GLuint bvhBuffer = 0;
 	GLuint triangleBuffer = 0;
 	GLuint materialBuffer = 0;
@@ -104,6 +90,7 @@ public:
 
 	bool loadGLTF(const std::string& filename);
 	void buildBVH();
+	void benchmarkBVHBuild(unsigned maxThreads = 0) const { ::benchmarkBVHBuild(triangles, bvhSettings, maxThreads); }
 	void uploadToGPU();
 	void cleanup();
 
@@ -111,6 +98,10 @@ public:
 	size_t getTriangleCount() const { return triangles.size(); }
 	size_t getBVHNodeCount() const { return bvhNodes.size(); }
 	size_t getMaterialCount() const { return materials.size(); }
+	const BVHBuildStats& getBVHStats() const { return bvhStats; }
+
+	void setBVHBuildSettings(const BVHBuildSettings& settings) { bvhSettings = settings; }
+	const BVHBuildSettings& getBVHBuildSettings() const { return bvhSettings; }
 
 	GLuint getBVHBuffer() const { return bvhBuffer; }
 	GLuint getTriangleBuffer() const { return triangleBuffer; }
@@ -122,12 +113,6 @@ private:
 	void processPrimitive(cgltf_data* data, cgltf_primitive* primitive, const float* transform, uint32_t materialIndex);
 	void loadMaterials(cgltf_data* data);
 
-	// BVH construction
-	uint32_t buildBVHRecursive(std::vector<uint32_t>& triangleIndices, uint32_t start, uint32_t end, int depth = 0);
-	void calculateBounds(const std::vector<uint32_t>& triangleIndices, uint32_t start, uint32_t end,
-		float minBounds[3], float maxBounds[3]);
-	int findBestSplit(const std::vector<uint32_t>& triangleIndices, uint32_t start, uint32_t end);
-
 	// Utility functions
 	void multiplyMatrix4(const float* a, const float* b, float* result);
 	void transformVertex(const float* vertex, const float* matrix, float* result);
@@ -307,119 +292,16 @@ void GLTFLoader::loadMaterials(cgltf_data* data) {
 void GLTFLoader::buildBVH() {
 	if (triangles.empty()) return;
 
-	bvhNodes.clear();
-	triangleIndices.clear();
-
-	// Reserve memory to prevent reallocations during recursive construction
-	// Worst case: 2 * triangleCount - 1 nodes for a binary tree
-	bvhNodes.reserve(2 * triangles.size());
-
-	// Initialize triangle indices
-	triangleIndices.resize(triangles.size());
-	for (size_t i = 0; i < triangles.size(); i++) {
-		triangleIndices[i] = (uint32_t)i;
-	}
-
-	// Build BVH recursively
-	buildBVHRecursive(triangleIndices, 0, (uint32_t)triangles.size());
-}
-
-uint32_t GLTFLoader::buildBVHRecursive(std::vector<uint32_t>& indices, uint32_t start, uint32_t end, int depth) {
-	uint32_t nodeIndex = (uint32_t)bvhNodes.size();
-	bvhNodes.emplace_back();
-
-	// Calculate bounds - access node after potential reallocation
-	calculateBounds(indices, start, end, bvhNodes[nodeIndex].minBounds, bvhNodes[nodeIndex].maxBounds);
-
-	uint32_t triangleCount = end - start;
-
-	// Leaf node criteria
-	if (triangleCount <= 4 || depth > 20) {
-		bvhNodes[nodeIndex].leftChild = 0; // Mark as leaf
-		bvhNodes[nodeIndex].triangleCount = triangleCount;
-		bvhNodes[nodeIndex].triangleOffset = start;
-		return nodeIndex;
-	}
-
-	// Find best split
-	int bestAxis = findBestSplit(indices, start, end);
-
-	// Sort triangles along best axis
-	std::sort(indices.begin() + start, indices.begin() + end,
-		[&](uint32_t a, uint32_t b) {
-		float centroidA[3], centroidB[3];
-		triangles[a].getCentroid(centroidA);
-		triangles[b].getCentroid(centroidB);
-		return centroidA[bestAxis] < centroidB[bestAxis];
-	});
-
-	uint32_t mid = start + triangleCount / 2;
-
-	// Build children - these calls may reallocate bvhNodes vector!
-	uint32_t leftChild = buildBVHRecursive(indices, start, mid, depth + 1);
-	uint32_t rightChild = buildBVHRecursive(indices, mid, end, depth + 1);
+	BVHBuilder builder(bvhSettings);
+	builder.build(triangles, bvhNodes, triangleIndices);
+	bvhStats = builder.getStats();
 
-	// CRITICAL: Don't use node reference after recursive calls!
-	// Access by index instead since vector may have been reallocated
-	bvhNodes[nodeIndex].leftChild = leftChild + 1; // Store as 1-based index (0 means leaf)
-	bvhNodes[nodeIndex].triangleCount = rightChild; // Store right child index in triangleCount for internal nodes
+	// Nothing needs the file order afterwards, so the triangles take the BVH order in place
+	BVHBuilder::permuteInPlace(triangles, triangleIndices);
 
-	return nodeIndex;
-}
-
-void GLTFLoader::calculateBounds(const std::vector<uint32_t>& indices, uint32_t start, uint32_t end,
-	float minBounds[3], float maxBounds[3]) {
-	if (start >= end || start >= triangles.size()) {
-		// Handle edge case with default bounds
-		minBounds[0] = minBounds[1] = minBounds[2] = 0.0f;
-		maxBounds[0] = maxBounds[1] = maxBounds[2] = 0.0f;
-		return;
-	}
-
-	minBounds[0] = minBounds[1] = minBounds[2] = FLT_MAX;
-	maxBounds[0] = maxBounds[1] = maxBounds[2] = -FLT_MAX;
-
-	for (uint32_t i = start; i < end; i++) {
-		if (i >= indices.size() || indices[i] >= triangles.size()) {
-			printf("Warning: Invalid triangle index %u at position %u\n",
-				i < indices.size() ? indices[i] : 999999, i);
-			continue;
-		}
-
-		float triMin[3], triMax[3];
-		triangles[indices[i]].getBounds(triMin, triMax);
-
-		for (int axis = 0; axis < 3; axis++) {
-			minBounds[axis] = std::min(minBounds[axis], triMin[axis]);
-			maxBounds[axis] = std::max(maxBounds[axis], triMax[axis]);
-		}
-	}
-
-	// Debug output for first few nodes
-	static int debugCount = 0;
-	if (debugCount < 5) {
-		printf("Bounds[%d]: min(%.2f, %.2f, %.2f) max(%.2f, %.2f, %.2f) triangles=%u-%u\n",
-			debugCount, minBounds[0], minBounds[1], minBounds[2],
-			maxBounds[0], maxBounds[1], maxBounds[2], start, end);
-		debugCount++;
-	}
-}
-
-int GLTFLoader::findBestSplit(const std::vector<uint32_t>& indices, uint32_t start, uint32_t end) {
-	// Simple approach: choose the axis with largest extent
-	float extent[3] = { 0, 0, 0 };
-	float minBounds[3], maxBounds[3];
-	calculateBounds(indices, start, end, minBounds, maxBounds);
-
-	int bestAxis = 0;
-	for (int axis = 0; axis < 3; axis++) {
-		extent[axis] = maxBounds[axis] - minBounds[axis];
-		if (extent[axis] > extent[bestAxis]) {
-			bestAxis = axis;
-		}
-	}
-
-	return bestAxis;
+	printf("Built BVH (%s): %zu nodes, %zu leaves, depth %d, SAH cost %.3f, %.2f ms\n",
+		BVHBuilder::modeName(bvhSettings.mode), bvhNodes.size(), bvhStats.leafCount,
+		bvhStats.maxDepth, bvhStats.sahCost, bvhStats.buildTimeMs);
 }
 
 void GLTFLoader::uploadToGPU() {
@@ -433,21 +315,14 @@ void GLTFLoader::uploadToGPU() {
 			bvhNodes.data(), GL_STATIC_DRAW);
 	}
 
-	// Upload triangles (reordered by BVH)
+	// Upload triangles (already in BVH order after buildBVH)
 	if (!triangles.empty()) {
 		if (triangleBuffer == 0) {
 			glGenBuffers(1, &triangleBuffer);
 		}
-
-		// Reorder triangles according to BVH
-		std::vector<Triangle> reorderedTriangles(triangles.size());
-		for (size_t i = 0; i < triangleIndices.size(); i++) {
-			reorderedTriangles[i] = triangles[triangleIndices[i]];
-		}
-
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleBuffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, reorderedTriangles.size() * sizeof(Triangle),
-			reorderedTriangles.data(), GL_STATIC_DRAW);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(Triangle),
+			triangles.data(), GL_STATIC_DRAW);
 	}
 
 	// Upload materials
@@ -0,0 +1,89 @@
+#pragma once
+#include <memory>
+#include <cstdint>
+
+#include "shader.h"
+#include "bvh_builder.h"
+
+// Refits a BVH that already lives on the GPU (CPU built or GPU built) with
+// shaders/compute/bvh_refit.glsl. Use it when the triangles are changed on the
+// GPU side, or after OBJLoader::uploadDirtyRanges() pushed the edited ones.
+class GPUBVHRefitter {
+public:
+	GPUBVHRefitter() = default;
+	~GPUBVHRefitter() {
+		cleanup();
+	}
+
+	GPUBVHRefitter(const GPUBVHRefitter&) = delete;
+	GPUBVHRefitter& operator=(const GPUBVHRefitter&) = delete;
+
+	// Leaves refer to triangles in triangleBuffer order, as uploaded by OBJLoader.
+	// The intersection triangles of every leaf are rebuilt from the vertex pool on the way.
+	void refit(GLuint bvhBuffer, GLuint triangleBuffer, GLuint vertexBuffer, GLuint intersectionBuffer,
+		uint32_t nodeCount);
+	void cleanup();
+
+private:
+	std::unique_ptr<Shader> shader;
+	GLuint parentBuffer = 0;
+	GLuint visitBuffer = 0;
+	uint32_t capacity = 0;
+};
+
+// Implementation
+inline void GPUBVHRefitter::refit(GLuint bvhBuffer, GLuint triangleBuffer, GLuint vertexBuffer, GLuint intersectionBuffer,
+	uint32_t nodeCount) {
+	if (nodeCount == 0) return;
+
+	if (!shader) {
+		shader = std::make_unique<Shader>("BVH refit", "shaders\\compute\\bvh_refit.glsl");
+	}
+
+	if (nodeCount > capacity) {
+		capacity = nodeCount;
+		if (parentBuffer == 0) {
+			glGenBuffers(1, &parentBuffer);
+			glGenBuffers(1, &visitBuffer);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, parentBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, visitBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bvhBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, triangleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, vertexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, intersectionBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, parentBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, visitBuffer);
+
+	shader->use();
+	GLint passLocation = glGetUniformLocation(shader->ID, "u_pass");
+	glUniform1ui(glGetUniformLocation(shader->ID, "u_nodeCount"), nodeCount);
+	GLuint groups = (nodeCount + 256 - 1) / 256;
+
+	// Parent links, then bounds
+	glUniform1i(passLocation, 0);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(passLocation, 1);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+inline void GPUBVHRefitter::cleanup() {
+	if (parentBuffer != 0) {
+		glDeleteBuffers(1, &parentBuffer);
+		glDeleteBuffers(1, &visitBuffer);
+		parentBuffer = visitBuffer = 0;
+	}
+	if (shader) {
+		Shader::createdShaders.erase("BVH refit");
+		glDeleteProgram(shader->ID);
+		shader.reset();
+	}
+	capacity = 0;
+}
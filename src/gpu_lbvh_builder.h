@@ -0,0 +1,163 @@
+#pragma once
+#include <memory>
+#include <cstdint>
+#include <iostream>
+
+#include "shader.h"
+#include "bvh_builder.h"
+
+// Builds an LBVH on the GPU with shaders/compute/lbvh_build.glsl, straight into
+// the SSBO bound at binding 8. The result uses the usual BVHNode layout, so the
+// existing traversal works unchanged. Leaves point at triangles in buffer order:
+// the triangle buffer must not be reordered by a CPU build afterwards.
+class GPULBVHBuilder {
+public:
+	GPULBVHBuilder() = default;
+	~GPULBVHBuilder() {
+		cleanup();
+	}
+
+	GPULBVHBuilder(const GPULBVHBuilder&) = delete;
+	GPULBVHBuilder& operator=(const GPULBVHBuilder&) = delete;
+
+	// Fills bvhBuffer with 2 * triangleCount - 1 nodes over the indexed triangles in
+	// triangleBuffer/vertexBuffer. sceneMin/sceneMax only need to enclose the triangle centroids.
+	// Leaves hold one triangle, so the tree cannot be cut at a depth the way the CPU LBVH is:
+	// returns false when an internal node lies below maxDepth, and the tree must not be traversed.
+	bool build(GLuint triangleBuffer, GLuint vertexBuffer, GLuint bvhBuffer, uint32_t triangleCount,
+		const float sceneMin[3], const float sceneMax[3], int maxDepth);
+
+	double getLastBuildTimeMs() const { return lastBuildTimeMs; }
+	// Depth of the deepest leaf of the last build, the root is at 0
+	int getLastDepth() const { return lastDepth; }
+	void cleanup();
+
+private:
+	std::unique_ptr<Shader> shader;
+	GLuint mortonBuffer = 0;
+	GLuint parentBuffer = 0;
+	GLuint visitBuffer = 0;
+	GLuint timerQuery = 0;
+	GLint passLocation = -1;
+	uint32_t capacity = 0;
+	double lastBuildTimeMs = 0.0;
+	int lastDepth = 0;
+
+	void reserve(uint32_t paddedCount);
+	void dispatch(int pass, uint32_t threads);
+};
+
+// Implementation
+inline void GPULBVHBuilder::reserve(uint32_t paddedCount) {
+	if (paddedCount <= capacity) return;
+	capacity = paddedCount;
+
+	if (mortonBuffer == 0) {
+		glGenBuffers(1, &mortonBuffer);
+		glGenBuffers(1, &parentBuffer);
+		glGenBuffers(1, &visitBuffer);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mortonBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * 2 * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, parentBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * 2 * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visitBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+}
+
+inline void GPULBVHBuilder::dispatch(int pass, uint32_t threads) {
+	glUniform1i(passLocation, pass);
+	glDispatchCompute((threads + 256 - 1) / 256, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+inline bool GPULBVHBuilder::build(GLuint triangleBuffer, GLuint vertexBuffer, GLuint bvhBuffer, uint32_t triangleCount,
+	const float sceneMin[3], const float sceneMax[3], int maxDepth) {
+	lastDepth = 0;
+	if (triangleCount == 0) return true;
+
+	if (!shader) {
+		shader = std::make_unique<Shader>("LBVH build", "shaders\\compute\\lbvh_build.glsl");
+		glGenQueries(1, &timerQuery);
+	}
+
+	uint32_t paddedCount = 1;
+	while (paddedCount < triangleCount) paddedCount *= 2;
+	reserve(paddedCount);
+
+	// Size the node buffer for the full tree, its contents are written by the build
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(2 * (size_t)triangleCount - 1) * sizeof(BVHNode), nullptr, GL_STATIC_DRAW);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bvhBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, triangleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, vertexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, mortonBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, parentBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, visitBuffer);
+
+	// Locations come from the shader's cache, after use() so they follow a hot reload
+	shader->use();
+	passLocation = shader->getUniformLocation("u_pass");
+	glUniform1ui(shader->getUniformLocation("u_triangleCount"), triangleCount);
+	glUniform1ui(shader->getUniformLocation("u_paddedCount"), paddedCount);
+	glUniform3fv(shader->getUniformLocation("u_sceneMin"), 1, sceneMin);
+	glUniform3fv(shader->getUniformLocation("u_sceneMax"), 1, sceneMax);
+
+	glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+
+	dispatch(0, paddedCount); // Morton codes
+
+	// Bitonic sort, one dispatch per merge step
+	GLint sizeLocation = shader->getUniformLocation("u_sortSize");
+	GLint strideLocation = shader->getUniformLocation("u_sortStride");
+	for (uint32_t size = 2; size <= paddedCount; size *= 2) {
+		for (uint32_t stride = size / 2; stride > 0; stride /= 2) {
+			glUniform1ui(sizeLocation, size);
+			glUniform1ui(strideLocation, stride);
+			dispatch(1, paddedCount);
+		}
+	}
+
+	dispatch(2, triangleCount); // Hierarchy
+	dispatch(3, triangleCount); // Bounds
+	dispatch(4, triangleCount); // Depth
+
+	glEndQuery(GL_TIME_ELAPSED);
+
+	// One-off build, waiting for the result here is fine
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &elapsed);
+	lastBuildTimeMs = elapsed / 1.0e6;
+
+	uint32_t depth = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visitBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)(triangleCount - 1) * sizeof(uint32_t), sizeof(depth), &depth);
+	lastDepth = (int)depth;
+
+	std::cout << "Built BVH on GPU (LBVH): " << 2 * (size_t)triangleCount - 1 << " nodes, depth " << lastDepth << ", "
+		<< lastBuildTimeMs << " ms" << std::endl;
+
+	// Leaves may sit one level below maxDepth, as in the CPU builds
+	return lastDepth <= maxDepth + 1;
+}
+
+inline void GPULBVHBuilder::cleanup() {
+	if (mortonBuffer != 0) {
+		glDeleteBuffers(1, &mortonBuffer);
+		glDeleteBuffers(1, &parentBuffer);
+		glDeleteBuffers(1, &visitBuffer);
+		mortonBuffer = parentBuffer = visitBuffer = 0;
+	}
+	if (timerQuery != 0) {
+		glDeleteQueries(1, &timerQuery);
+		timerQuery = 0;
+	}
+	if (shader) {
+		Shader::createdShaders.erase("LBVH build");
+		glDeleteProgram(shader->ID);
+		shader.reset();
+	}
+	capacity = 0;
+}
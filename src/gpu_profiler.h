@@ -0,0 +1,237 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+
+// Times the GPU work of each pipeline stage with GL_TIME_ELAPSED queries. Every stage owns
+// two queries used on alternating frames, and a frame's results are read at the end of the
+// next frame. A result that is still not available then is dropped rather than waited for,
+// so profiling never stalls the pipeline.
+class GPUProfiler {
+public:
+	GPUProfiler() = default;
+	~GPUProfiler() {
+		cleanup();
+	}
+
+	GPUProfiler(const GPUProfiler&) = delete;
+	GPUProfiler& operator=(const GPUProfiler&) = delete;
+
+	struct StageStats {
+		float averageMs = 0.0f;
+		float p50Ms = 0.0f;
+		float p99Ms = 0.0f;
+		float lastMs = 0.0f;
+	};
+
+	// samples is the number of path tracing samples the frame dispatches, for samples per second
+	void beginFrame(uint64_t samples);
+	void endFrame();
+
+	// Stages are created on first use and may not nest, GL allows one GL_TIME_ELAPSED query at a time
+	void begin(const std::string& name);
+	void end();
+
+	size_t stageCount() const { return stages.size(); }
+	const std::string& stageName(size_t stage) const { return stages[stage].name; }
+	StageStats stageStats(size_t stage) const;
+
+	// Samples per second of GPU time over the rolling window, counting all stages
+	double samplesPerSecond() const;
+	float frameMs() const;
+	uint64_t droppedResults() const { return dropped; }
+
+	// Resolved frames are kept for the CSV trace while recording
+	void setRecording(bool enabled) { recording = enabled; }
+	bool isRecording() const { return recording; }
+	size_t tracedFrames() const { return trace.size(); }
+	bool exportCSV(const std::string& filename) const;
+	void clearTrace() { trace.clear(); }
+
+	void cleanup();
+
+private:
+	static const int WINDOW_SIZE = 240; // rolling window, in resolved frames
+
+	struct Stage {
+		std::string name;
+		GLuint queries[2] = {};
+		bool pending[2] = {};
+		std::vector<float> samples; // ring of the last WINDOW_SIZE results in ms
+		size_t next = 0;
+	};
+	struct Frame {
+		uint64_t index = 0;
+		uint64_t samples = 0;
+		std::vector<float> stageMs; // negative when the stage did not run or its result was dropped
+	};
+
+	std::vector<Stage> stages;
+	Frame frames[2];
+	int current = 0;
+	int activeStage = -1;
+	uint64_t frameIndex = 0;
+	uint64_t dropped = 0;
+
+	std::vector<uint64_t> windowSamples; // ring of per-frame samples, parallel to windowFrameMs
+	std::vector<float> windowFrameMs;
+	size_t windowNext = 0;
+
+	bool recording = false;
+	std::vector<Frame> trace;
+
+	void resolve(int set);
+	static void push(std::vector<float>& ring, size_t& next, float value);
+};
+
+// Implementation
+inline void GPUProfiler::beginFrame(uint64_t samples) {
+	Frame& frame = frames[current];
+	frame.index = frameIndex++;
+	frame.samples = samples;
+	frame.stageMs.assign(stages.size(), -1.0f);
+}
+
+inline void GPUProfiler::begin(const std::string& name) {
+	size_t stage = 0;
+	while (stage < stages.size() && stages[stage].name != name) stage++;
+	if (stage == stages.size()) {
+		stages.emplace_back();
+		stages.back().name = name;
+		glGenQueries(2, stages.back().queries);
+	}
+
+	activeStage = (int)stage;
+	glBeginQuery(GL_TIME_ELAPSED, stages[stage].queries[current]);
+}
+
+inline void GPUProfiler::end() {
+	if (activeStage < 0) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	stages[activeStage].pending[current] = true;
+	activeStage = -1;
+}
+
+inline void GPUProfiler::endFrame() {
+	// The other set holds the previous frame, its queries are reused next frame
+	current ^= 1;
+	resolve(current);
+}
+
+inline void GPUProfiler::resolve(int set) {
+	Frame& frame = frames[set];
+	frame.stageMs.resize(stages.size(), -1.0f);
+
+	bool any = false;
+	float totalMs = 0.0f;
+	for (size_t i = 0; i < stages.size(); i++) {
+		Stage& stage = stages[i];
+		if (!stage.pending[set]) continue;
+		stage.pending[set] = false;
+
+		GLint available = 0;
+		glGetQueryObjectiv(stage.queries[set], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			dropped++;
+			continue;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(stage.queries[set], GL_QUERY_RESULT, &elapsed);
+		float ms = (float)(elapsed / 1.0e6);
+		frame.stageMs[i] = ms;
+		push(stage.samples, stage.next, ms);
+		totalMs += ms;
+		any = true;
+	}
+	if (!any) return;
+
+	if (windowSamples.size() < WINDOW_SIZE) {
+		windowSamples.push_back(frame.samples);
+		windowFrameMs.push_back(totalMs);
+	}
+	else {
+		windowSamples[windowNext] = frame.samples;
+		windowFrameMs[windowNext] = totalMs;
+	}
+	windowNext = (windowNext + 1) % WINDOW_SIZE;
+
+	if (recording) trace.push_back(frame);
+}
+
+inline void GPUProfiler::push(std::vector<float>& ring, size_t& next, float value) {
+	if (ring.size() < WINDOW_SIZE) ring.push_back(value);
+	else ring[next] = value;
+	next = (next + 1) % WINDOW_SIZE;
+}
+
+inline GPUProfiler::StageStats GPUProfiler::stageStats(size_t stage) const {
+	StageStats stats;
+	const Stage& s = stages[stage];
+	if (s.samples.empty()) return stats;
+
+	std::vector<float> sorted = s.samples;
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (float ms : sorted) sum += ms;
+
+	// Nearest rank percentiles
+	auto percentile = [&](double p) {
+		size_t rank = (size_t)(p * sorted.size() + 0.999999);
+		return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+	};
+	stats.averageMs = (float)(sum / sorted.size());
+	stats.p50Ms = percentile(0.50);
+	stats.p99Ms = percentile(0.99);
+	stats.lastMs = s.samples[(s.next + s.samples.size() - 1) % s.samples.size()];
+	return stats;
+}
+
+inline double GPUProfiler::samplesPerSecond() const {
+	double samples = 0.0;
+	double ms = 0.0;
+	for (size_t i = 0; i < windowSamples.size(); i++) {
+		samples += (double)windowSamples[i];
+		ms += windowFrameMs[i];
+	}
+	return ms > 0.0 ? samples / (ms / 1000.0) : 0.0;
+}
+
+inline float GPUProfiler::frameMs() const {
+	if (windowFrameMs.empty()) return 0.0f;
+	double ms = 0.0;
+	for (float frame : windowFrameMs) ms += frame;
+	return (float)(ms / windowFrameMs.size());
+}
+
+inline bool GPUProfiler::exportCSV(const std::string& filename) const {
+	std::ofstream out(filename, std::ios::trunc);
+	if (!out) return false;
+
+	out << "frame,samples";
+	for (const Stage& stage : stages) out << "," << stage.name << " ms";
+	out << "\n";
+
+	// Stages first used after a frame was traced have no column in that frame
+	for (const Frame& frame : trace) {
+		out << frame.index << "," << frame.samples;
+		for (size_t i = 0; i < stages.size(); i++) {
+			out << ",";
+			if (i < frame.stageMs.size() && frame.stageMs[i] >= 0.0f) out << frame.stageMs[i];
+		}
+		out << "\n";
+	}
+	out.close();
+	return !out.fail();
+}
+
+inline void GPUProfiler::cleanup() {
+	for (Stage& stage : stages) {
+		glDeleteQueries(2, stage.queries);
+	}
+	stages.clear();
+	activeStage = -1;
+}
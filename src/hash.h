@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+// 64-bit non-cryptographic hash, four independent lanes so large files hash at memory speed
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+	const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+	const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t word;
+			memcpy(&word, bytes + i + 8 * lane, 8);
+			lanes[lane] += word * prime2;
+			lanes[lane] = (lanes[lane] << 31) | (lanes[lane] >> 33);
+			lanes[lane] *= prime1;
+		}
+	}
+
+	uint64_t h = size;
+	for (int lane = 0; lane < 4; lane++) {
+		h ^= lanes[lane];
+		h = ((h << 27) | (h >> 37)) * prime1 + prime2;
+	}
+	for (; i < size; i++) {
+		h ^= bytes[i] * prime1;
+		h = ((h << 11) | (h >> 53)) * prime2;
+	}
+
+	// Final avalanche
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime1;
+	h ^= h >> 32;
+	return h;
+}
+
+inline uint64_t hashString(const std::string& text, uint64_t seed = 0) {
+	return hashBytes(text.data(), text.size(), seed);
+}
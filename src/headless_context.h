@@ -0,0 +1,128 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+// OpenGL 4.3 core context without a window, for offline rendering. Linux uses an EGL
+// surfaceless display, which Mesa serves with llvmpipe when there is no GPU (or when
+// software is requested). Other platforms fall back to a hidden GLFW window.
+class HeadlessContext {
+public:
+	HeadlessContext() = default;
+	~HeadlessContext() {
+		destroy();
+	}
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// Creates the context, makes it current and loads the GL functions
+	bool create(bool software = false);
+	void destroy();
+
+private:
+#ifdef __linux__
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+#else
+	GLFWwindow* window = nullptr;
+#endif
+};
+
+// Implementation
+#ifdef __linux__
+inline bool HeadlessContext::create(bool software) {
+	// Read by Mesa when the display is initialized
+	if (software) setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		printf("Failed to initialize EGL\n");
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = nullptr;
+	EGLint configCount = 0;
+	eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, configCount > 0 ? config : nullptr, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		printf("Failed to create an OpenGL 4.3 context (EGL error 0x%x)\n", eglGetError());
+		destroy();
+		return false;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		printf("Failed to initialize GLAD\n");
+		destroy();
+		return false;
+	}
+	printf("Headless context: %s\n", (const char*)glGetString(GL_RENDERER));
+	return true;
+}
+
+inline void HeadlessContext::destroy() {
+	if (display == EGL_NO_DISPLAY) return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+	eglTerminate(display);
+	context = EGL_NO_CONTEXT;
+	display = EGL_NO_DISPLAY;
+}
+#else
+inline bool HeadlessContext::create(bool software) {
+	if (software) printf("Software rendering is only selectable on Linux, using the default driver\n");
+
+	if (!glfwInit()) {
+		printf("Failed to initialize GLFW\n");
+		return false;
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	window = glfwCreateWindow(1, 1, "Headless", NULL, NULL);
+	if (window == NULL) {
+		printf("Failed to create an OpenGL 4.3 context\n");
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		printf("Failed to initialize GLAD\n");
+		destroy();
+		return false;
+	}
+	printf("Headless context: %s\n", (const char*)glGetString(GL_RENDERER));
+	return true;
+}
+
+inline void HeadlessContext::destroy() {
+	if (window == nullptr) return;
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	window = nullptr;
+}
+#endif
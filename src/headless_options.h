@@ -0,0 +1,166 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+// Command line of the offline render mode. Without --headless the engine opens its window.
+struct HeadlessOptions {
+	bool enabled = false;
+	std::string scene = "assets/objects/white-room1.obj";
+	std::string environment = "assets/textures/cubemaps/partly_cloudy.hdr";
+	std::string output = "render";   // writes <output>.pfm and <output>.png
+	int width = 960;
+	int height = 540;
+	int samples = 64;                // samples per pixel
+	bool software = false;           // force Mesa llvmpipe
+	bool hasEye = false;
+	glm::vec3 eye = glm::vec3(0.0f);
+	bool hasDirection = false;
+	glm::vec3 direction = glm::vec3(0.0f, 0.0f, 1.0f);
+	float fov = 50.0f;
+	int maxBounces = -1;             // -1 keeps gLink::pathTracerVariant
+	int samplesPerDispatch = -1;
+	bool cpu = false;                // render with the CPU path tracer, no GL context
+	bool reference = false;          // also render on the CPU and print the difference
+	unsigned threads = 0;            // CPU path tracer threads, 0 uses every hardware thread
+	int simdLevel = -1;              // SIMDLevel of the CPU traversal, -1 uses the best supported
+	bool benchmarkTraversal = false; // time the CPU traversal levels instead of rendering
+	int tileSize = 16;               // CPU render tile edge in pixels
+	int tileOrder = -1;              // TileOrder of the CPU render, -1 keeps the spiral
+	bool tileStealing = true;        // false deals the tiles out as a static split
+	bool tileReport = false;         // print the per-worker tile times and write <output>_tiles.csv
+	bool wavefront = false;          // render with the wavefront passes instead of the megakernel
+	bool benchmarkWavefront = false; // render with both, print their times and the image difference
+	bool persistent = false;         // render with the persistent threads kernel
+	int persistentGroups = 0;        // workgroups it launches, 0 sizes them to the device
+	bool benchmarkPersistent = false; // like benchmarkWavefront, for the persistent threads kernel
+
+	// Fills the options from argv, false (after printing usage) on an unknown or malformed argument
+	bool parse(int argc, char** argv);
+	static void printUsage(const char* program);
+};
+
+// Implementation
+inline void HeadlessOptions::printUsage(const char* program) {
+	printf("usage: %s --headless [options]\n"
+		"  --scene <file.obj>          scene to render\n"
+		"  --environment <file.hdr>    equirectangular environment map\n"
+		"  --output <path>             writes <path>.pfm and <path>.png\n"
+		"  --size <width>x<height>     resolution\n"
+		"  --spp <n>                   samples per pixel\n"
+		"  --eye <x,y,z>               camera position\n"
+		"  --dir <x,y,z>               camera view direction\n"
+		"  --fov <degrees>             field of view\n"
+		"  --bounces <n>               maximum bounces\n"
+		"  --spp-per-dispatch <n>      samples each dispatch traces\n"
+		"  --software                  render with Mesa llvmpipe\n"
+		"  --cpu                       render with the CPU path tracer instead of the GPU\n"
+		"  --reference                 also render on the CPU and compare the images\n"
+		"  --threads <n>               CPU path tracer threads (default: all)\n"
+		"  --simd <scalar|sse4|avx2>   CPU traversal instruction set (default: best supported)\n"
+		"  --benchmark-traversal       report CPU traversal Mrays/s per instruction set and exit\n"
+		"  --tile-size <n>             CPU render tile size in pixels (default: 16)\n"
+		"  --tile-order <order>        CPU render tile order: scanline, morton or spiral (default)\n"
+		"  --no-steal                  CPU render tiles as a static split, without work stealing\n"
+		"  --tile-report               print the CPU tile timings and write <output>_tiles.csv\n"
+		"  --wavefront                 render with the wavefront passes instead of the megakernel\n"
+		"  --benchmark-wavefront       render with the megakernel and the wavefront passes and compare\n"
+		"  --persistent                render with the persistent threads kernel instead of the 8x8 dispatch\n"
+		"  --persistent-groups <n>     workgroups the persistent threads kernel launches (default: fill the GPU)\n"
+		"  --benchmark-persistent      render with the megakernel and the persistent threads kernel and compare\n", program);
+}
+
+inline bool HeadlessOptions::parse(int argc, char** argv) {
+	auto parseVec3 = [](const char* text, glm::vec3& value) {
+		return sscanf(text, "%f,%f,%f", &value.x, &value.y, &value.z) == 3;
+	};
+
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool ok = true;
+
+		if (argument == "--headless") {
+			enabled = true;
+			continue;
+		}
+		else if (argument == "--software") {
+			software = true;
+			continue;
+		}
+		else if (argument == "--cpu") {
+			cpu = true;
+			continue;
+		}
+		else if (argument == "--reference") {
+			reference = true;
+			continue;
+		}
+		else if (argument == "--benchmark-traversal") {
+			benchmarkTraversal = true;
+			continue;
+		}
+		else if (argument == "--no-steal") {
+			tileStealing = false;
+			continue;
+		}
+		else if (argument == "--tile-report") {
+			tileReport = true;
+			continue;
+		}
+		else if (argument == "--wavefront") {
+			wavefront = true;
+			continue;
+		}
+		else if (argument == "--benchmark-wavefront") {
+			benchmarkWavefront = true;
+			continue;
+		}
+		else if (argument == "--persistent") {
+			persistent = true;
+			continue;
+		}
+		else if (argument == "--benchmark-persistent") {
+			benchmarkPersistent = true;
+			continue;
+		}
+		else if (value == nullptr) {
+			ok = false;
+		}
+		else if (argument == "--scene") scene = value;
+		else if (argument == "--environment") environment = value;
+		else if (argument == "--output") output = value;
+		else if (argument == "--size") ok = sscanf(value, "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+		else if (argument == "--spp") ok = (samples = atoi(value)) > 0;
+		else if (argument == "--eye") ok = hasEye = parseVec3(value, eye);
+		else if (argument == "--dir") ok = hasDirection = parseVec3(value, direction) && glm::length(direction) > 0.0f;
+		else if (argument == "--fov") ok = (fov = (float)atof(value)) > 0.0f;
+		else if (argument == "--bounces") ok = (maxBounces = atoi(value)) > 0;
+		else if (argument == "--spp-per-dispatch") ok = (samplesPerDispatch = atoi(value)) > 0;
+		else if (argument == "--threads") ok = (threads = (unsigned)atoi(value)) > 0;
+		else if (argument == "--simd") {
+			std::string level = value;
+			simdLevel = level == "scalar" ? 0 : level == "sse4" ? 1 : level == "avx2" ? 2 : -1;
+			ok = simdLevel >= 0;
+		}
+		else if (argument == "--tile-size") ok = (tileSize = atoi(value)) > 0;
+		else if (argument == "--persistent-groups") ok = (persistentGroups = atoi(value)) > 0;
+		else if (argument == "--tile-order") {
+			std::string order = value;
+			tileOrder = order == "scanline" ? 0 : order == "morton" ? 1 : order == "spiral" ? 2 : -1;
+			ok = tileOrder >= 0;
+		}
+		else ok = false;
+
+		if (!ok) {
+			printf("Invalid argument: %s%s%s\n", argument.c_str(), value ? " " : "", value ? value : "");
+			printUsage(argv[0]);
+			return false;
+		}
+		i++;
+	}
+	return true;
+}
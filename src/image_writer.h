@@ -0,0 +1,126 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// Writers for the offline render outputs. Pixels are RGBA with row 0 at the bottom,
+// as read back from a GL texture.
+
+// Portable float map: little endian RGB floats, stored bottom row first like GL
+bool writePFM(const std::string& filename, int width, int height, const float* rgba);
+
+// 8-bit RGB PNG. The image data goes into stored (uncompressed) deflate blocks, so no
+// compression library is needed; outputs are larger than a compressed PNG.
+bool writePNG(const std::string& filename, int width, int height, const unsigned char* rgba);
+
+// Implementation
+inline bool writePFM(const std::string& filename, int width, int height, const float* rgba) {
+	std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+
+	// A negative scale marks little endian data
+	out << "PF\n" << width << " " << height << "\n-1.0\n";
+	std::vector<float> row((size_t)width * 3);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			memcpy(&row[(size_t)x * 3], &rgba[((size_t)y * width + x) * 4], 3 * sizeof(float));
+		}
+		out.write((const char*)row.data(), (std::streamsize)(row.size() * sizeof(float)));
+	}
+	out.close();
+	return !out.fail();
+}
+
+namespace PNGDetail {
+	inline uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+		static uint32_t table[256];
+		static bool tableReady = false;
+		if (!tableReady) {
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[i] = c;
+			}
+			tableReady = true;
+		}
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	inline void putBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+		out.push_back((unsigned char)(value >> 24));
+		out.push_back((unsigned char)(value >> 16));
+		out.push_back((unsigned char)(value >> 8));
+		out.push_back((unsigned char)value);
+	}
+
+	inline void writeChunk(std::ofstream& out, const char type[4], const std::vector<unsigned char>& data) {
+		std::vector<unsigned char> chunk;
+		putBigEndian(chunk, (uint32_t)data.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+		out.write((const char*)chunk.data(), (std::streamsize)chunk.size());
+	}
+}
+
+inline bool writePNG(const std::string& filename, int width, int height, const unsigned char* rgba) {
+	std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.write((const char*)signature, sizeof(signature));
+
+	std::vector<unsigned char> header;
+	PNGDetail::putBigEndian(header, (uint32_t)width);
+	PNGDetail::putBigEndian(header, (uint32_t)height);
+	header.push_back(8); // bit depth
+	header.push_back(2); // RGB
+	header.push_back(0); // deflate
+	header.push_back(0); // adaptive filtering
+	header.push_back(0); // no interlace
+	PNGDetail::writeChunk(out, "IHDR", header);
+
+	// Scanlines top row first, each led by filter type 0
+	std::vector<unsigned char> raw;
+	raw.reserve((size_t)height * ((size_t)width * 3 + 1));
+	for (int y = height - 1; y >= 0; y--) {
+		raw.push_back(0);
+		for (int x = 0; x < width; x++) {
+			const unsigned char* pixel = &rgba[((size_t)y * width + x) * 4];
+			raw.insert(raw.end(), pixel, pixel + 3);
+		}
+	}
+
+	// zlib stream of stored blocks
+	std::vector<unsigned char> zlib = { 0x78, 0x01 };
+	size_t offset = 0;
+	do {
+		size_t length = std::min<size_t>(raw.size() - offset, 65535);
+		bool last = offset + length == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((unsigned char)length);
+		zlib.push_back((unsigned char)(length >> 8));
+		zlib.push_back((unsigned char)~length);
+		zlib.push_back((unsigned char)(~length >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (unsigned char byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	PNGDetail::putBigEndian(zlib, (b << 16) | a);
+	PNGDetail::writeChunk(out, "IDAT", zlib);
+
+	PNGDetail::writeChunk(out, "IEND", std::vector<unsigned char>());
+	out.close();
+	return !out.fail();
+}
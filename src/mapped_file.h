@@ -0,0 +1,127 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file through the OS page cache, without copying it
+class MappedFile {
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& filename) {
+		open(filename);
+	}
+	~MappedFile() {
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& filename);
+	void close();
+
+	// An empty file is open with size 0 and no data
+	bool isOpen() const { return opened; }
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const char* bytes = nullptr;
+	size_t length = 0;
+	bool opened = false;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int descriptor = -1;
+#endif
+};
+
+// Implementation
+#ifdef _WIN32
+inline bool MappedFile::open(const std::string& filename) {
+	close();
+
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+	opened = true;
+	if (length == 0) return true;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping) {
+		bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!bytes) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+inline void MappedFile::close() {
+	if (bytes) UnmapViewOfFile(bytes);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	bytes = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+	length = 0;
+	opened = false;
+}
+#else
+inline bool MappedFile::open(const std::string& filename) {
+	close();
+
+	descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (descriptor < 0) return false;
+
+	struct stat info;
+	if (fstat(descriptor, &info) != 0) {
+		close();
+		return false;
+	}
+	length = (size_t)info.st_size;
+	opened = true;
+	if (length == 0) return true;
+
+	void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (view == MAP_FAILED) {
+		close();
+		return false;
+	}
+	madvise(view, length, MADV_SEQUENTIAL);
+	bytes = (const char*)view;
+	return true;
+}
+
+inline void MappedFile::close() {
+	if (bytes) munmap((void*)bytes, length);
+	if (descriptor >= 0) ::close(descriptor);
+	bytes = nullptr;
+	descriptor = -1;
+	length = 0;
+	opened = false;
+}
+#endif
@@ -7,9 +7,19 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <unordered_map>
+#include <charconv>
+#include <cstring>
+#include <chrono>
 #include <float.h>
 #include <cmath>
 
+#include "bvh_builder.h"
+#include "wide_bvh.h"
+#include "compressed_bvh.h"
+#include "mapped_file.h"
+#include "scene_cache.h"
+
 // Vertex structure for triangle data
 struct Vertex {
 	float position[3];
@@ -56,6 +66,86 @@ struct Triangle {
 	}
 };
 
+// Deduplicated vertex of the indexed mesh (must match OBJVertex in GLSL).
+// The texture coordinate rides in the w components, so a vertex is two vec4s.
+struct MeshVertex {
+	float position[3];
+	float texCoordU;
+	float normal[3];
+	float texCoordV;
+};
+
+// Indexed triangle: three MeshVertex indices and the material, a uvec4 in GLSL
+struct MeshTriangle {
+	uint32_t vertex[3];
+	uint32_t materialIndex;
+};
+
+// Intersection-ready triangle read by the BVH leaf loop (must match OBJIntersectTriangle in GLSL):
+// the first vertex and both edges, so the ray test needs no vertex fetches or subtractions
+struct IntersectionTriangle {
+	float v0[4];
+	float edge1[4];
+	float edge2[4];
+};
+
+// OBJ v/vt/vn index triple (0-based, -1 when missing), one pool vertex per distinct triple
+struct OBJVertexKey {
+	int position, texCoord, normal;
+
+	bool operator==(const OBJVertexKey& other) const {
+		return position == other.position && texCoord == other.texCoord && normal == other.normal;
+	}
+};
+
+struct OBJVertexKeyHash {
+	size_t operator()(const OBJVertexKey& key) const {
+		uint64_t h = (uint32_t)key.position;
+		h = h * 0x9E3779B97F4A7C15ull ^ (uint32_t)key.texCoord;
+		h = h * 0x9E3779B97F4A7C15ull ^ (uint32_t)key.normal;
+		return (size_t)(h ^ (h >> 32));
+	}
+};
+
+// Open addressing map from v/vt/vn triple to pool vertex for the mapped parser.
+// Vertices are numbered in insertion order, memory is only allocated when the table grows.
+class OBJVertexTable {
+public:
+	uint32_t insert(const OBJVertexKey& key);
+	uint32_t size() const { return (uint32_t)keys.size(); }
+	const std::vector<OBJVertexKey>& getKeys() const { return keys; } // in insertion order
+
+private:
+	std::vector<OBJVertexKey> keys;
+	std::vector<uint32_t> slots; // index into keys, UINT32_MAX marks an empty slot
+
+	void grow();
+};
+
+inline uint32_t OBJVertexTable::insert(const OBJVertexKey& key) {
+	if ((keys.size() + 1) * 2 > slots.size()) grow();
+
+	size_t mask = slots.size() - 1;
+	for (size_t slot = OBJVertexKeyHash()(key) & mask; ; slot = (slot + 1) & mask) {
+		if (slots[slot] == UINT32_MAX) {
+			slots[slot] = (uint32_t)keys.size();
+			keys.push_back(key);
+			return slots[slot];
+		}
+		if (keys[slots[slot]] == key) return slots[slot];
+	}
+}
+
+inline void OBJVertexTable::grow() {
+	slots.assign(std::max<size_t>(1024, slots.size() * 2), UINT32_MAX);
+	size_t mask = slots.size() - 1;
+	for (uint32_t i = 0; i < keys.size(); i++) {
+		size_t slot = OBJVertexKeyHash()(keys[i]) & mask;
+		while (slots[slot] != UINT32_MAX) slot = (slot + 1) & mask;
+		slots[slot] = i;
+	}
+}
+
 // Material structure
 struct Material {
 	float albedo[3] = { 0.8f, 0.8f, 0.8f };
@@ -69,32 +159,34 @@ struct Material {
 	float refractionColor[3] = { 0.0f, 0.0f, 0.0f };
 };
 
-// BVH Node structure (GPU-friendly)
-struct BVHNode {
-	float minBounds[3];
-	uint32_t leftChild;    // If 0, this is a leaf node
-	float maxBounds[3];
-	uint32_t triangleCount; // For leaf nodes: number of triangles, for internal: right child
-	uint32_t triangleOffset; // For leaf nodes: offset into triangle array
-	uint32_t padding[3];     // Align to 64 bytes for GPU
-
-							 // Constructor to initialize all values
-	BVHNode() {
-		minBounds[0] = minBounds[1] = minBounds[2] = 0.0f;
-		maxBounds[0] = maxBounds[1] = maxBounds[2] = 0.0f;
-		leftChild = 0;
-		triangleCount = 0;
-		triangleOffset = 0;
-		padding[0] = padding[1] = padding[2] = 0;
-	}
-};
-
 class OBJLoader {
 private:
 	std::vector<Triangle> triangles;
 	std::vector<Material> materials;
 	std::vector<BVHNode> bvhNodes;
 	std::vector<uint32_t> triangleIndices; // For BVH leaf nodes
+	std::vector<uint32_t> trianglePositions; // Inverse of triangleIndices: where each triangle sits in the GPU buffer
+
+	BVHBuildSettings bvhSettings;
+	BVHBuildStats bvhStats;
+	std::unique_ptr<ThreadPool> refitPool;
+	BVHLayout bvhLayout = BVHLayout::Binary;
+	WideBVH wideBVH;
+	CompressedBVH compressedBVH;
+	bool layoutDirty = false;
+
+	// Ranges of the GPU buffers that are out of date after an animation step
+	size_t dirtyTriangleBegin = 0, dirtyTriangleEnd = 0;
+	uint32_t dirtyNodeBegin = 0, dirtyNodeEnd = 0;
+
+	// Indexed mesh: every triangle corner refers to a pool vertex, shared by all corners with the same v/vt/vn
+	std::vector<uint32_t> triangleVertices; // 3 pool vertices per triangle, file order
+	uint32_t meshVertexCount = 0;
+	std::vector<MeshVertex> meshVertices;   // GPU vertex buffer, numbered by first use in BVH order
+	std::vector<MeshTriangle> meshTriangles; // GPU triangle buffer, BVH order
+	// Corners (3 * BVH position + corner) using each mesh vertex, built on the first animation step
+	std::vector<uint32_t> slotUserOffsets;
+	std::vector<uint32_t> slotUsers;
 
 										   // Temporary storage during OBJ parsing
 	std::vector<std::array<float, 3>> vertices;
@@ -104,19 +196,46 @@ private:
 	// GPU buffers
 	GLuint bvhBuffer = 0;
 	GLuint triangleBuffer = 0;
+	GLuint vertexBuffer = 0;
+	GLuint intersectionBuffer = 0;
 	GLuint materialBuffer = 0;
+	GLuint wideBVHBuffer = 0;
+	GLuint compressedBVHBuffer = 0;
 
 public:
 	~OBJLoader() {
 		cleanup();
 	}
 
-	bool loadOBJ(const std::string& filename);
+	// Memory-mapped parser, threadCount == 0 uses one thread per hardware thread.
+	// The output does not depend on the thread count.
+	bool loadOBJ(const std::string& filename, unsigned threadCount = 0);
+	bool loadOBJStream(const std::string& filename); // std::istream reference parser, same output
 	bool loadMTL(const std::string& filename);
 	void buildBVH();
+	void setBVHLayout(BVHLayout layout); // converts the binary tree, call after buildBVH()
+	void printBVHMemoryReport() const;
+	void benchmarkBVHBuild(unsigned maxThreads = 0) const { ::benchmarkBVHBuild(triangles, bvhSettings, maxThreads); }
+	static void benchmarkOBJParse(const std::string& filename, int repeats = 3);
 	void uploadToGPU();
 	void cleanup();
 
+	// Scene cache: the GPU buffers of a built scene, keyed by sourceHash plus the build settings
+	// and layout. Save after uploadToGPU(). A successful load uploads straight from the mapped
+	// file and leaves no CPU side triangles or nodes, so refit() is not available afterwards.
+	bool saveSceneCache(const std::string& cachePath, uint64_t sourceHash) const;
+	bool loadSceneCache(const std::string& cachePath, uint64_t sourceHash, BVHLayout layout);
+	// Hash of the OBJ bytes and of every material library it names, for sourceHash
+	static uint64_t hashSourceFiles(const std::string& filename);
+
+	// Animation: edit triangles through getTriangles(), mark what changed and call refit().
+	// refit() keeps the tree topology and only uploads the dirty node and triangle ranges.
+	// Marking a moved corner also moves the triangles sharing its vertex and marks them.
+	std::vector<Triangle>& getTriangles() { return triangles; }
+	void markTrianglesDirty(size_t first, size_t count);
+	void refit();
+	void uploadDirtyRanges();
+
 	// Utility functions
 	void normalizeSize();
 	void centerAtOrigin();
@@ -127,17 +246,80 @@ public:
 	size_t getTriangleCount() const { return triangles.size(); }
 	size_t getBVHNodeCount() const { return bvhNodes.size(); }
 	size_t getMaterialCount() const { return materials.size(); }
+	// CPU side scene, empty after a scene cache load (see cpu_path_tracer.h)
+	const std::vector<Triangle>& getTriangles() const { return triangles; }
+	const std::vector<BVHNode>& getBVHNodes() const { return bvhNodes; }
+	const std::vector<uint32_t>& getTriangleIndices() const { return triangleIndices; }
+	bool hasRefractiveMaterials() const;
+	const BVHBuildStats& getBVHStats() const { return bvhStats; }
+
+	void setBVHBuildSettings(const BVHBuildSettings& settings) { bvhSettings = settings; }
+	const BVHBuildSettings& getBVHBuildSettings() const { return bvhSettings; }
 
 	GLuint getBVHBuffer() const { return bvhBuffer; }
 	GLuint getTriangleBuffer() const { return triangleBuffer; }
+	GLuint getVertexBuffer() const { return vertexBuffer; }
+	GLuint getIntersectionBuffer() const { return intersectionBuffer; }
 	GLuint getMaterialBuffer() const { return materialBuffer; }
+	GLuint getWideBVHBuffer() const { return wideBVHBuffer; }
+	GLuint getCompressedBVHBuffer() const { return compressedBVHBuffer; }
+	BVHLayout getBVHLayout() const { return bvhLayout; }
 
 private:
-	// BVH construction
-	uint32_t buildBVHRecursive(std::vector<uint32_t>& triangleIndices, uint32_t start, uint32_t end, int depth = 0);
-	void calculateBounds(const std::vector<uint32_t>& triangleIndices, uint32_t start, uint32_t end,
-		float minBounds[3], float maxBounds[3]);
-	int findBestSplit(const std::vector<uint32_t>& triangleIndices, uint32_t start, uint32_t end);
+	// Face corner as written in the file: 1-based or negative relative v/vt/vn, 0 when missing
+	struct OBJCorner {
+		int position = 0, texCoord = 0, normal = 0;
+	};
+
+	// Number of v, vt and vn records
+	struct OBJRecordCounts {
+		uint32_t positions = 0, texCoords = 0, normals = 0;
+	};
+
+	// mtllib or usemtl line, replayed in file order by the fix-up
+	struct OBJMaterialEvent {
+		size_t triangle = 0;            // first chunk-local triangle after the line
+		const char* library = nullptr;  // mtllib file name, null for usemtl
+		const char* libraryEnd = nullptr;
+		uint32_t material = 0;          // current material after the line
+	};
+
+	// Line-aligned slice of the file, parsed independently of the others
+	struct OBJChunk {
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		std::vector<std::array<float, 3>> vertices;
+		std::vector<std::array<float, 3>> normals;
+		std::vector<std::array<float, 2>> texCoords;
+		std::vector<OBJCorner> corners;      // 3 per triangle
+		std::vector<OBJRecordCounts> counts; // per triangle: records of this chunk before its face
+		std::vector<OBJMaterialEvent> events;
+
+		// Set by the fix-up
+		OBJRecordCounts offset;              // records in all earlier chunks
+		size_t triangleOffset = 0;
+		uint32_t material = 0;               // current material at the chunk start
+		OBJVertexTable vertexPool;           // chunk-local, merged in chunk order
+		std::vector<uint32_t> poolRemap;     // chunk-local pool vertex -> global one
+	};
+
+	static void parseChunk(OBJChunk& chunk);
+	void buildChunkTriangles(OBJChunk& chunk);
+	static int resolveIndex(int index, size_t count);
+	static void setFaceNormal(Triangle& tri);
+	static std::string materialLibraryPath(const std::string& objFilename, const std::string& library);
+	static const char* skipSpace(const char* p, const char* end);
+	static const char* tokenEnd(const char* p, const char* end);
+	static const char* parseFloat(const char* p, const char* end, float& value);
+	static const char* parseCorner(const char* p, const char* end, OBJCorner& corner);
+
+	void buildIndexedMesh();
+	void buildSlotUsers();
+	void markPositionDirty(size_t position);
+	void streamIntersectionTriangles(size_t begin, size_t end);
+	uint64_t sceneCacheSettingsHash(BVHLayout layout) const;
+	static MeshVertex toMeshVertex(const Vertex& vertex);
+	static IntersectionTriangle toIntersectionTriangle(const Triangle& tri);
 
 	// Utility functions
 	void multiplyMatrix4(const float* a, const float* b, float* result);
@@ -147,7 +329,261 @@ private:
 };
 
 // Implementation
-bool OBJLoader::loadOBJ(const std::string& filename) {
+bool OBJLoader::loadOBJ(const std::string& filename, unsigned threadCount) {
+	MappedFile file(filename);
+	if (!file.isOpen()) {
+		std::cerr << "Failed to open OBJ file: " << filename << std::endl;
+		return false;
+	}
+
+	// Clear existing data
+	vertices.clear();
+	normals.clear();
+	texCoords.clear();
+	triangles.clear();
+	materials.clear();
+	triangleVertices.clear();
+	meshVertexCount = 0;
+
+	// Add default material
+	materials.emplace_back();
+
+	if (threadCount == 0) threadCount = ThreadPool::hardwareThreads();
+	std::unique_ptr<ThreadPool> pool;
+	if (threadCount > 1 && file.size() >= (1 << 20)) {
+		pool = std::make_unique<ThreadPool>(threadCount - 1);
+	}
+
+	// Split at line boundaries, a few chunks per thread so uneven lines balance out
+	size_t chunkCount = pool ? (size_t)threadCount * 4 : 1;
+	std::vector<OBJChunk> chunks(chunkCount);
+	const char* data = file.data();
+	const char* end = data + file.size();
+	const char* cursor = data;
+	for (size_t i = 0; i < chunkCount; i++) {
+		const char* split = i + 1 == chunkCount ? end : std::max(cursor, data + file.size() * (i + 1) / chunkCount);
+		if (split < end) {
+			const char* newline = (const char*)memchr(split, '\n', end - split);
+			split = newline ? newline + 1 : end;
+		}
+		chunks[i].begin = cursor;
+		chunks[i].end = split;
+		cursor = split;
+	}
+
+	auto forEachChunk = [&](const auto& fn) {
+		if (!pool) {
+			for (OBJChunk& chunk : chunks) fn(chunk);
+			return;
+		}
+		pool->parallelFor(0, chunkCount, 1, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++) fn(chunks[i]);
+		});
+	};
+
+	forEachChunk([](OBJChunk& chunk) { parseChunk(chunk); });
+
+	// Fix-up: prefix sums place every chunk's records and triangles in the file-wide arrays.
+	// Material lines are replayed in file order, usemtl depends on the MTL files loaded before it.
+	OBJRecordCounts total;
+	size_t triangleCount = 0;
+	uint32_t currentMaterial = 0;
+	for (OBJChunk& chunk : chunks) {
+		chunk.offset = total;
+		chunk.triangleOffset = triangleCount;
+		chunk.material = currentMaterial;
+		total.positions += (uint32_t)chunk.vertices.size();
+		total.texCoords += (uint32_t)chunk.texCoords.size();
+		total.normals += (uint32_t)chunk.normals.size();
+		triangleCount += chunk.counts.size();
+
+		for (OBJMaterialEvent& event : chunk.events) {
+			if (event.library) {
+				loadMTL(materialLibraryPath(filename, std::string(event.library, event.libraryEnd)));
+			}
+			else {
+				// For simplicity, just increment material index, see loadOBJStream()
+				currentMaterial = std::min((uint32_t)(materials.size() - 1), currentMaterial + 1);
+			}
+			event.material = currentMaterial;
+		}
+	}
+
+	if (chunkCount == 1) {
+		vertices.swap(chunks[0].vertices);
+		texCoords.swap(chunks[0].texCoords);
+		normals.swap(chunks[0].normals);
+	}
+	else {
+		vertices.resize(total.positions);
+		texCoords.resize(total.texCoords);
+		normals.resize(total.normals);
+		forEachChunk([&](OBJChunk& chunk) {
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices.begin() + chunk.offset.positions);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + chunk.offset.texCoords);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.offset.normals);
+		});
+	}
+
+	triangles.resize(triangleCount);
+	triangleVertices.resize(3 * triangleCount);
+	forEachChunk([&](OBJChunk& chunk) { buildChunkTriangles(chunk); });
+
+	// Pool vertices are numbered by first use in file order: merge the chunk tables in order
+	if (chunkCount == 1) {
+		meshVertexCount = chunks[0].vertexPool.size();
+	}
+	else {
+		OBJVertexTable vertexPool;
+		for (OBJChunk& chunk : chunks) {
+			chunk.poolRemap.reserve(chunk.vertexPool.size());
+			for (const OBJVertexKey& key : chunk.vertexPool.getKeys()) {
+				chunk.poolRemap.push_back(vertexPool.insert(key));
+			}
+		}
+		forEachChunk([&](OBJChunk& chunk) {
+			uint32_t* ids = triangleVertices.data() + 3 * chunk.triangleOffset;
+			for (size_t i = 0; i < 3 * chunk.counts.size(); i++) ids[i] = chunk.poolRemap[ids[i]];
+		});
+		meshVertexCount = vertexPool.size();
+	}
+
+	std::cout << "Loaded OBJ: " << vertices.size() << " vertices, "
+		<< triangles.size() << " triangles, " << meshVertexCount << " unique v/vt/vn, "
+		<< chunkCount << (chunkCount == 1 ? " chunk" : " chunks") << std::endl;
+
+	return !triangles.empty();
+}
+
+// Tokenizes the lines of one chunk in place, indices stay as written until the fix-up
+void OBJLoader::parseChunk(OBJChunk& chunk) {
+	const char* cursor = chunk.begin;
+	while (cursor < chunk.end) {
+		const char* lineEnd = (const char*)memchr(cursor, '\n', chunk.end - cursor);
+		if (!lineEnd) lineEnd = chunk.end;
+
+		const char* prefix = skipSpace(cursor, lineEnd);
+		const char* p = tokenEnd(prefix, lineEnd);
+		size_t prefixLength = p - prefix;
+		cursor = lineEnd + 1;
+
+		if (prefixLength == 1 && prefix[0] == 'v') {
+			// Vertex position
+			std::array<float, 3> vertex;
+			p = parseFloat(p, lineEnd, vertex[0]);
+			p = parseFloat(p, lineEnd, vertex[1]);
+			parseFloat(p, lineEnd, vertex[2]);
+			chunk.vertices.push_back(vertex);
+		}
+		else if (prefixLength == 2 && prefix[0] == 'v' && prefix[1] == 'n') {
+			// Vertex normal
+			std::array<float, 3> normal;
+			p = parseFloat(p, lineEnd, normal[0]);
+			p = parseFloat(p, lineEnd, normal[1]);
+			parseFloat(p, lineEnd, normal[2]);
+			chunk.normals.push_back(normal);
+		}
+		else if (prefixLength == 2 && prefix[0] == 'v' && prefix[1] == 't') {
+			// Texture coordinate
+			std::array<float, 2> texCoord;
+			p = parseFloat(p, lineEnd, texCoord[0]);
+			parseFloat(p, lineEnd, texCoord[1]);
+			chunk.texCoords.push_back(texCoord);
+		}
+		else if (prefixLength == 1 && prefix[0] == 'f') {
+			// Fan triangulation on the fly: first, previous and current corner
+			OBJRecordCounts counts;
+			counts.positions = (uint32_t)chunk.vertices.size();
+			counts.texCoords = (uint32_t)chunk.texCoords.size();
+			counts.normals = (uint32_t)chunk.normals.size();
+
+			OBJCorner corners[3];
+			int cornerCount = 0;
+			for (p = skipSpace(p, lineEnd); p < lineEnd; p = skipSpace(p, lineEnd)) {
+				p = parseCorner(p, lineEnd, corners[std::min(cornerCount, 2)]);
+				if (++cornerCount >= 3) {
+					chunk.corners.insert(chunk.corners.end(), corners, corners + 3);
+					chunk.counts.push_back(counts);
+					corners[1] = corners[2];
+				}
+			}
+		}
+		else if (prefixLength == 6 && memcmp(prefix, "mtllib", 6) == 0) {
+			// Material library, loaded by the fix-up
+			OBJMaterialEvent event;
+			event.triangle = chunk.counts.size();
+			event.library = skipSpace(p, lineEnd);
+			event.libraryEnd = tokenEnd(event.library, lineEnd);
+			chunk.events.push_back(event);
+		}
+		else if (prefixLength == 6 && memcmp(prefix, "usemtl", 6) == 0) {
+			// Use material
+			OBJMaterialEvent event;
+			event.triangle = chunk.counts.size();
+			chunk.events.push_back(event);
+		}
+	}
+}
+
+// Resolves the corners of one chunk against the file-wide records and writes its triangles
+void OBJLoader::buildChunkTriangles(OBJChunk& chunk) {
+	size_t eventIndex = 0;
+	uint32_t material = chunk.material;
+
+	for (size_t i = 0; i < chunk.counts.size(); i++) {
+		while (eventIndex < chunk.events.size() && chunk.events[eventIndex].triangle <= i) {
+			material = chunk.events[eventIndex++].material;
+		}
+
+		// Records in the file before this face, as loadOBJStream() sees them
+		size_t positionCount = chunk.offset.positions + chunk.counts[i].positions;
+		size_t texCoordCount = chunk.offset.texCoords + chunk.counts[i].texCoords;
+		size_t normalCount = chunk.offset.normals + chunk.counts[i].normals;
+
+		size_t triangleIndex = chunk.triangleOffset + i;
+		Triangle& tri = triangles[triangleIndex];
+		tri.materialIndex = material;
+
+		// Out of range indices leave the attribute zeroed
+		Vertex* triVertices[3] = { &tri.v0, &tri.v1, &tri.v2 };
+		for (int v = 0; v < 3; v++) {
+			const OBJCorner& corner = chunk.corners[3 * i + v];
+			OBJVertexKey key = { -1, -1, -1 };
+
+			int vertexIndex = resolveIndex(corner.position, positionCount);
+			if (vertexIndex >= 0 && vertexIndex < (int)positionCount) {
+				key.position = vertexIndex;
+				memcpy(triVertices[v]->position, vertices[vertexIndex].data(), sizeof(float) * 3);
+			}
+
+			int texIndex = resolveIndex(corner.texCoord, texCoordCount);
+			if (texIndex >= 0 && texIndex < (int)texCoordCount) {
+				key.texCoord = texIndex;
+				memcpy(triVertices[v]->texCoord, texCoords[texIndex].data(), sizeof(float) * 2);
+			}
+
+			int normalIndex = resolveIndex(corner.normal, normalCount);
+			if (normalIndex >= 0 && normalIndex < (int)normalCount) {
+				key.normal = normalIndex;
+				memcpy(triVertices[v]->normal, normals[normalIndex].data(), sizeof(float) * 3);
+			}
+
+			triangleVertices[3 * triangleIndex + v] = chunk.vertexPool.insert(key);
+		}
+
+		// If no normals provided so far, calculate face normal
+		if (normalCount == 0) {
+			setFaceNormal(tri);
+		}
+	}
+}
+
+// 1-based index, or negative and relative to the count records read so far. -1 when missing.
+int OBJLoader::resolveIndex(int index, size_t count) {
+	return index < 0 ? (int)count + index : index - 1;
+}
+
+bool OBJLoader::loadOBJStream(const std::string& filename) {
 	std::ifstream file(filename);
 	if (!file.is_open()) {
 		std::cerr << "Failed to open OBJ file: " << filename << std::endl;
@@ -160,6 +596,10 @@ bool OBJLoader::loadOBJ(const std::string& filename) {
 	texCoords.clear();
 	triangles.clear();
 	materials.clear();
+	triangleVertices.clear();
+	meshVertexCount = 0;
+
+	std::unordered_map<OBJVertexKey, uint32_t, OBJVertexKeyHash> vertexPool;
 
 	// Add default material
 	materials.emplace_back();
@@ -215,11 +655,13 @@ bool OBJLoader::loadOBJ(const std::string& filename) {
 
 				for (int v = 0; v < 3; v++) {
 					std::vector<std::string> indices = split(vertexStrings[v], '/');
+					OBJVertexKey key = { -1, -1, -1 };
 
 					// Vertex position (required)
 					if (!indices.empty() && !indices[0].empty()) {
-						int vertexIndex = std::stoi(indices[0]) - 1; // OBJ is 1-indexed
+						int vertexIndex = resolveIndex(std::stoi(indices[0]), vertices.size()); // OBJ is 1-indexed
 						if (vertexIndex >= 0 && vertexIndex < (int)vertices.size()) {
+							key.position = vertexIndex;
 							triVertices[v]->position[0] = vertices[vertexIndex][0];
 							triVertices[v]->position[1] = vertices[vertexIndex][1];
 							triVertices[v]->position[2] = vertices[vertexIndex][2];
@@ -228,8 +670,9 @@ bool OBJLoader::loadOBJ(const std::string& filename) {
 
 					// Texture coordinate (optional)
 					if (indices.size() > 1 && !indices[1].empty()) {
-						int texIndex = std::stoi(indices[1]) - 1;
+						int texIndex = resolveIndex(std::stoi(indices[1]), texCoords.size());
 						if (texIndex >= 0 && texIndex < (int)texCoords.size()) {
+							key.texCoord = texIndex;
 							triVertices[v]->texCoord[0] = texCoords[texIndex][0];
 							triVertices[v]->texCoord[1] = texCoords[texIndex][1];
 						}
@@ -237,49 +680,23 @@ bool OBJLoader::loadOBJ(const std::string& filename) {
 
 					// Normal (optional)
 					if (indices.size() > 2 && !indices[2].empty()) {
-						int normalIndex = std::stoi(indices[2]) - 1;
+						int normalIndex = resolveIndex(std::stoi(indices[2]), normals.size());
 						if (normalIndex >= 0 && normalIndex < (int)normals.size()) {
+							key.normal = normalIndex;
 							triVertices[v]->normal[0] = normals[normalIndex][0];
 							triVertices[v]->normal[1] = normals[normalIndex][1];
 							triVertices[v]->normal[2] = normals[normalIndex][2];
 						}
 					}
+
+					auto pooled = vertexPool.emplace(key, meshVertexCount);
+					if (pooled.second) meshVertexCount++;
+					triangleVertices.push_back(pooled.first->second);
 				}
 
 				// If no normals provided, calculate face normal
 				if (normals.empty()) {
-					std::array<float, 3> edge1 = {
-						tri.v1.position[0] - tri.v0.position[0],
-						tri.v1.position[1] - tri.v0.position[1],
-						tri.v1.position[2] - tri.v0.position[2]
-					};
-					std::array<float, 3> edge2 = {
-						tri.v2.position[0] - tri.v0.position[0],
-						tri.v2.position[1] - tri.v0.position[1],
-						tri.v2.position[2] - tri.v0.position[2]
-					};
-
-					// Cross product
-					std::array<float, 3> normal = {
-						edge1[1] * edge2[2] - edge1[2] * edge2[1],
-						edge1[2] * edge2[0] - edge1[0] * edge2[2],
-						edge1[0] * edge2[1] - edge1[1] * edge2[0]
-					};
-
-					// Normalize
-					float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
-					if (length > 0.0f) {
-						normal[0] /= length;
-						normal[1] /= length;
-						normal[2] /= length;
-					}
-
-					// Apply to all vertices
-					for (int v = 0; v < 3; v++) {
-						triVertices[v]->normal[0] = normal[0];
-						triVertices[v]->normal[1] = normal[1];
-						triVertices[v]->normal[2] = normal[2];
-					}
+					setFaceNormal(tri);
 				}
 
 				triangles.push_back(tri);
@@ -290,13 +707,7 @@ bool OBJLoader::loadOBJ(const std::string& filename) {
 			// Material library
 			std::string mtlFile;
 			iss >> mtlFile;
-
-			// Try to load MTL file from same directory as OBJ
-			size_t lastSlash = filename.find_last_of("/\\");
-			std::string mtlPath = (lastSlash != std::string::npos) ?
-				filename.substr(0, lastSlash + 1) + mtlFile : mtlFile;
-
-			loadMTL(mtlPath);
+			loadMTL(materialLibraryPath(filename, mtlFile));
 
 		}
 		else if (prefix == "usemtl") {
@@ -313,11 +724,76 @@ bool OBJLoader::loadOBJ(const std::string& filename) {
 	file.close();
 
 	std::cout << "Loaded OBJ: " << vertices.size() << " vertices, "
-		<< triangles.size() << " triangles" << std::endl;
+		<< triangles.size() << " triangles, " << meshVertexCount << " unique v/vt/vn" << std::endl;
 
 	return !triangles.empty();
 }
 
+void OBJLoader::setFaceNormal(Triangle& tri) {
+	std::array<float, 3> edge1 = {
+		tri.v1.position[0] - tri.v0.position[0],
+		tri.v1.position[1] - tri.v0.position[1],
+		tri.v1.position[2] - tri.v0.position[2]
+	};
+	std::array<float, 3> edge2 = {
+		tri.v2.position[0] - tri.v0.position[0],
+		tri.v2.position[1] - tri.v0.position[1],
+		tri.v2.position[2] - tri.v0.position[2]
+	};
+
+	// Cross product
+	std::array<float, 3> normal = {
+		edge1[1] * edge2[2] - edge1[2] * edge2[1],
+		edge1[2] * edge2[0] - edge1[0] * edge2[2],
+		edge1[0] * edge2[1] - edge1[1] * edge2[0]
+	};
+
+	// Normalize
+	float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	if (length > 0.0f) {
+		normal[0] /= length;
+		normal[1] /= length;
+		normal[2] /= length;
+	}
+
+	// Apply to all vertices
+	Vertex* triVertices[3] = { &tri.v0, &tri.v1, &tri.v2 };
+	for (int v = 0; v < 3; v++) {
+		triVertices[v]->normal[0] = normal[0];
+		triVertices[v]->normal[1] = normal[1];
+		triVertices[v]->normal[2] = normal[2];
+	}
+}
+
+// MTL files are looked up in the directory of the OBJ
+std::string OBJLoader::materialLibraryPath(const std::string& objFilename, const std::string& library) {
+	size_t lastSlash = objFilename.find_last_of("/\\");
+	return lastSlash != std::string::npos ? objFilename.substr(0, lastSlash + 1) + library : library;
+}
+
+uint64_t OBJLoader::hashSourceFiles(const std::string& filename) {
+	MappedFile file(filename);
+	if (!file.isOpen()) return 0;
+	const char* data = file.data();
+	const char* end = data + file.size();
+	uint64_t hash = hashBytes(data, file.size());
+
+	// An edited library changes the materials without touching the OBJ
+	for (const char* line = data; line < end;) {
+		const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+		if (lineEnd == nullptr) lineEnd = end;
+		const char* p = skipSpace(line, lineEnd);
+		if (lineEnd - p > 6 && memcmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+			const char* library = skipSpace(p + 6, lineEnd);
+			std::string path = materialLibraryPath(filename, std::string(library, tokenEnd(library, lineEnd)));
+			uint64_t libraryHash = hashFile(path);
+			hash = hashBytes(&libraryHash, sizeof(libraryHash), hashString(path, hash));
+		}
+		line = lineEnd + 1;
+	}
+	return hash;
+}
+
 bool OBJLoader::loadMTL(const std::string& filename) {
 	std::ifstream file(filename);
 	if (!file.is_open()) {
@@ -387,149 +863,439 @@ bool OBJLoader::loadMTL(const std::string& filename) {
 void OBJLoader::buildBVH() {
 	if (triangles.empty()) return;
 
-	bvhNodes.clear();
-	triangleIndices.clear();
-
-	// Reserve memory to prevent reallocations during recursive construction
-	bvhNodes.reserve(2 * triangles.size());
+	BVHBuilder builder(bvhSettings);
+	builder.build(triangles, bvhNodes, triangleIndices);
+	bvhStats = builder.getStats();
 
-	// Initialize triangle indices
-	triangleIndices.resize(triangles.size());
-	for (size_t i = 0; i < triangles.size(); i++) {
-		triangleIndices[i] = (uint32_t)i;
+	trianglePositions.resize(triangleIndices.size());
+	for (uint32_t i = 0; i < triangleIndices.size(); i++) {
+		trianglePositions[triangleIndices[i]] = i;
 	}
 
-	// Build BVH recursively
-	buildBVHRecursive(triangleIndices, 0, (uint32_t)triangles.size());
+	std::cout << "Built BVH (" << BVHBuilder::modeName(bvhSettings.mode) << "): " << bvhNodes.size() << " nodes, "
+		<< bvhStats.leafCount << " leaves, depth " << bvhStats.maxDepth << ", SAH cost " << bvhStats.sahCost
+		<< ", " << bvhStats.buildTimeMs << " ms" << std::endl;
+}
 
-	std::cout << "Built BVH: " << bvhNodes.size() << " nodes" << std::endl;
+void OBJLoader::setBVHLayout(BVHLayout layout) {
+	wideBVH.clear();
+	compressedBVH.clear();
+
+	// The other layouts are converted from the CPU side binary tree
+	bvhLayout = bvhNodes.empty() ? BVHLayout::Binary : layout;
+
+	switch (bvhLayout) {
+	case BVHLayout::Wide4:
+	case BVHLayout::Wide8:
+		wideBVH.build(bvhNodes, bvhLayout == BVHLayout::Wide8 ? 8 : 4);
+		std::cout << "Collapsed BVH to BVH" << wideBVH.getWidth() << ": " << wideBVH.getNodeCount() << " nodes" << std::endl;
+		break;
+	case BVHLayout::Compressed:
+		compressedBVH.build(bvhNodes);
+		std::cout << "Compressed BVH: " << compressedBVH.getNodeCount() << " nodes" << std::endl;
+		break;
+	default:
+		break;
+	}
 }
 
-uint32_t OBJLoader::buildBVHRecursive(std::vector<uint32_t>& indices, uint32_t start, uint32_t end, int depth) {
-	uint32_t nodeIndex = (uint32_t)bvhNodes.size();
-	bvhNodes.emplace_back(); // This calls the constructor which initializes everything
+void OBJLoader::printBVHMemoryReport() const {
+	if (bvhNodes.empty() || triangles.empty()) return;
 
-	uint32_t triangleCount = end - start;
+	WideBVH wide4, wide8;
+	CompressedBVH compressed;
+	wide4.build(bvhNodes, 4);
+	wide8.build(bvhNodes, 8);
+	compressed.build(bvhNodes);
 
-	// Calculate bounds first and store them
-	float minBounds[3], maxBounds[3];
-	calculateBounds(indices, start, end, minBounds, maxBounds);
+	double triangleCount = (double)triangles.size();
+	auto report = [&](const char* name, size_t nodeCount, size_t bytes) {
+		printf("  %-12s %9zu nodes %11zu bytes %7.2f bytes/triangle\n", name, nodeCount, bytes, bytes / triangleCount);
+	};
 
-	// Set bounds in the node
-	for (int i = 0; i < 3; i++) {
-		bvhNodes[nodeIndex].minBounds[i] = minBounds[i];
-		bvhNodes[nodeIndex].maxBounds[i] = maxBounds[i];
+	size_t poolSize = triangleVertices.size() == 3 * triangles.size() ? meshVertexCount : 3 * triangles.size();
+	size_t meshBytes = triangles.size() * sizeof(MeshTriangle) + poolSize * sizeof(MeshVertex);
+	printf("BVH memory (%zu triangles, %zu bytes/triangle for intersection, %.2f bytes/triangle for shading):\n",
+		triangles.size(), sizeof(IntersectionTriangle), meshBytes / triangleCount);
+	report("binary", bvhNodes.size(), bvhNodes.size() * sizeof(BVHNode));
+	report("BVH4", wide4.getNodeCount(), wide4.getPackets().size() * sizeof(WideBVHPacket));
+	report("BVH8", wide8.getNodeCount(), wide8.getPackets().size() * sizeof(WideBVHPacket));
+	report("compressed", compressed.getNodeCount(), compressed.getNodes().size() * sizeof(CompressedBVHNode));
+}
+
+void OBJLoader::uploadToGPU() {
+	// Upload BVH nodes (the buffer is created either way so a GPU build can fill it)
+	if (bvhBuffer == 0) {
+		glGenBuffers(1, &bvhBuffer);
 	}
+	if (!bvhNodes.empty()) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bvhNodes.size() * sizeof(BVHNode),
+			bvhNodes.data(), GL_STATIC_DRAW);
+	}
+
+	// Upload the intersection triangles and the indexed shading data, both reordered by BVH
+	if (!triangles.empty()) {
+		if (triangleBuffer == 0) {
+			glGenBuffers(1, &triangleBuffer);
+			glGenBuffers(1, &vertexBuffer);
+			glGenBuffers(1, &intersectionBuffer);
+		}
 
-	// Leaf node criteria
-	if (triangleCount <= 4 || depth > 20) {
-		bvhNodes[nodeIndex].leftChild = 0; // Mark as leaf
-		bvhNodes[nodeIndex].triangleCount = triangleCount;
-		bvhNodes[nodeIndex].triangleOffset = start;
-		return nodeIndex;
+		buildIndexedMesh();
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, intersectionBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(IntersectionTriangle), nullptr, GL_STATIC_DRAW);
+		streamIntersectionTriangles(0, triangles.size());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshTriangles.size() * sizeof(MeshTriangle),
+			meshTriangles.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshVertices.size() * sizeof(MeshVertex),
+			meshVertices.data(), GL_STATIC_DRAW);
+
+		size_t copiedBytes = triangles.size() * sizeof(Triangle);
+		size_t indexedBytes = meshTriangles.size() * sizeof(MeshTriangle) + meshVertices.size() * sizeof(MeshVertex);
+		size_t intersectionBytes = triangles.size() * sizeof(IntersectionTriangle);
+		printf("Triangle data: %zu bytes indexed (%zu vertices) vs %zu bytes as Triangle copies, %.2fx smaller\n",
+			indexedBytes, meshVertices.size(), copiedBytes, (double)copiedBytes / indexedBytes);
+		printf("Intersection data: %zu bytes, leaf loop reads %zu bytes/triangle instead of %zu\n",
+			intersectionBytes, sizeof(IntersectionTriangle), sizeof(Triangle));
 	}
 
-	// Find best split
-	int bestAxis = findBestSplit(indices, start, end);
+	// Upload the wide or compressed BVH
+	if (!wideBVH.empty()) {
+		if (wideBVHBuffer == 0) {
+			glGenBuffers(1, &wideBVHBuffer);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, wideBVHBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, wideBVH.getPackets().size() * sizeof(WideBVHPacket),
+			wideBVH.getPackets().data(), GL_STATIC_DRAW);
+	}
+	if (!compressedBVH.empty()) {
+		if (compressedBVHBuffer == 0) {
+			glGenBuffers(1, &compressedBVHBuffer);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, compressedBVHBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, compressedBVH.getNodes().size() * sizeof(CompressedBVHNode),
+			compressedBVH.getNodes().data(), GL_STATIC_DRAW);
+	}
 
-	// Sort triangles along best axis
-	std::sort(indices.begin() + start, indices.begin() + end,
-		[&](uint32_t a, uint32_t b) {
-		float centroidA[3], centroidB[3];
-		triangles[a].getCentroid(centroidA);
-		triangles[b].getCentroid(centroidB);
-		return centroidA[bestAxis] < centroidB[bestAxis];
-	});
+	// Upload materials
+	if (!materials.empty()) {
+		if (materialBuffer == 0) {
+			glGenBuffers(1, &materialBuffer);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(Material),
+			materials.data(), GL_STATIC_DRAW);
+	}
 
-	uint32_t mid = start + triangleCount / 2;
+	std::cout << "Uploaded to GPU: " << triangles.size() << " triangles, "
+		<< bvhNodes.size() << " BVH nodes, " << materials.size() << " materials" << std::endl;
+}
 
-	// Build children
-	uint32_t leftChild = buildBVHRecursive(indices, start, mid, depth + 1);
-	uint32_t rightChild = buildBVHRecursive(indices, mid, end, depth + 1);
+MeshVertex OBJLoader::toMeshVertex(const Vertex& vertex) {
+	MeshVertex result;
+	for (int i = 0; i < 3; i++) {
+		result.position[i] = vertex.position[i];
+		result.normal[i] = vertex.normal[i];
+	}
+	result.texCoordU = vertex.texCoord[0];
+	result.texCoordV = vertex.texCoord[1];
+	return result;
+}
 
-	// Set child pointers
-	bvhNodes[nodeIndex].leftChild = leftChild; // Store as 1-based index (0 means leaf)
-	bvhNodes[nodeIndex].triangleCount = rightChild; // Store right child index
+IntersectionTriangle OBJLoader::toIntersectionTriangle(const Triangle& tri) {
+	IntersectionTriangle result;
+	for (int i = 0; i < 3; i++) {
+		result.v0[i] = tri.v0.position[i];
+		result.edge1[i] = tri.v1.position[i] - tri.v0.position[i];
+		result.edge2[i] = tri.v2.position[i] - tri.v0.position[i];
+	}
+	result.v0[3] = result.edge1[3] = result.edge2[3] = 0.0f;
+	return result;
+}
 
-	return nodeIndex;
+void OBJLoader::buildIndexedMesh() {
+	size_t count = triangles.size();
+	bool bvhOrder = triangleIndices.size() == count;
+
+	// Triangles that did not come from the parser get their own three vertices
+	bool indexed = triangleVertices.size() == 3 * count;
+	std::vector<uint32_t> slots(indexed ? meshVertexCount : 3 * count, UINT32_MAX);
+
+	// Pool vertices are numbered by first use, so neighbouring triangles share cache lines.
+	// Corners without a file normal share one vertex, the shader computes face normals anyway.
+	meshVertices.clear();
+	meshVertices.reserve(slots.size());
+	slotUserOffsets.clear();
+	slotUsers.clear();
+	meshTriangles.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		size_t t = bvhOrder ? triangleIndices[i] : i;
+		const Triangle& tri = triangles[t];
+		for (int c = 0; c < 3; c++) {
+			size_t id = indexed ? triangleVertices[3 * t + c] : 3 * t + c;
+			if (slots[id] == UINT32_MAX) {
+				slots[id] = (uint32_t)meshVertices.size();
+				meshVertices.push_back(toMeshVertex(c == 0 ? tri.v0 : c == 1 ? tri.v1 : tri.v2));
+			}
+			meshTriangles[i].vertex[c] = slots[id];
+		}
+		meshTriangles[i].materialIndex = tri.materialIndex;
+	}
 }
 
-void OBJLoader::calculateBounds(const std::vector<uint32_t>& indices, uint32_t start, uint32_t end,
-	float minBounds[3], float maxBounds[3]) {
-	minBounds[0] = minBounds[1] = minBounds[2] = FLT_MAX;
-	maxBounds[0] = maxBounds[1] = maxBounds[2] = -FLT_MAX;
+// Intersection triangles have no CPU copy: they are converted straight into the mapped
+// GPU buffer a chunk at a time, so an upload never holds a second copy of the scene
+void OBJLoader::streamIntersectionTriangles(size_t begin, size_t end) {
+	const size_t chunkSize = 16384; // triangles per mapping, 768 KB
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, intersectionBuffer);
+	for (size_t first = begin; first < end; first += chunkSize) {
+		size_t count = std::min(chunkSize, end - first);
+		IntersectionTriangle* mapped = (IntersectionTriangle*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER,
+			first * sizeof(IntersectionTriangle), count * sizeof(IntersectionTriangle),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (!mapped) {
+			std::cerr << "Failed to map the intersection buffer" << std::endl;
+			return;
+		}
+		for (size_t i = 0; i < count; i++) {
+			size_t position = first + i;
+			mapped[i] = toIntersectionTriangle(triangles[triangleIndices.empty() ? position : triangleIndices[position]]);
+		}
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+	}
+}
 
-	for (uint32_t i = start; i < end; i++) {
-		if (i >= indices.size() || indices[i] >= triangles.size()) continue;
+bool OBJLoader::hasRefractiveMaterials() const {
+	for (const Material& material : materials) {
+		if (material.refractionChance > 0.0f) return true;
+	}
+	return false;
+}
 
-		float triMin[3], triMax[3];
-		triangles[indices[i]].getBounds(triMin, triMax);
+uint64_t OBJLoader::sceneCacheSettingsHash(BVHLayout layout) const {
+	// Everything that changes the cached bytes, the thread count does not
+	uint32_t values[] = {
+		(uint32_t)bvhSettings.mode, bvhSettings.sahBinCount, bvhSettings.maxLeafSize, (uint32_t)bvhSettings.maxDepth,
+		bvhSettings.mortonBits, (uint32_t)layout, (uint32_t)sizeof(Triangle), (uint32_t)sizeof(BVHNode)
+	};
+	float costs[] = { bvhSettings.sahTraversalCost, bvhSettings.sahIntersectionCost };
+	return hashBytes(costs, sizeof(costs), hashBytes(values, sizeof(values)));
+}
 
-		for (int axis = 0; axis < 3; axis++) {
-			minBounds[axis] = std::min(minBounds[axis], triMin[axis]);
-			maxBounds[axis] = std::max(maxBounds[axis], triMax[axis]);
-		}
+bool OBJLoader::saveSceneCache(const std::string& cachePath, uint64_t sourceHash) const {
+	if (meshTriangles.empty() || bvhNodes.empty() || intersectionBuffer == 0) return false;
+
+	// The intersection triangles only exist on the GPU, they are written from a read mapping
+	size_t intersectionBytes = meshTriangles.size() * sizeof(IntersectionTriangle);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, intersectionBuffer);
+	const void* intersectionData = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, intersectionBytes, GL_MAP_READ_BIT);
+	if (!intersectionData) return false;
+
+	SceneCacheWriter writer;
+	writer.add(SceneCacheSection::BVHNodes, bvhNodes.data(), bvhNodes.size() * sizeof(BVHNode));
+	writer.add(SceneCacheSection::IntersectionTriangles, intersectionData, intersectionBytes);
+	writer.add(SceneCacheSection::MeshTriangles, meshTriangles.data(), meshTriangles.size() * sizeof(MeshTriangle));
+	writer.add(SceneCacheSection::MeshVertices, meshVertices.data(), meshVertices.size() * sizeof(MeshVertex));
+	writer.add(SceneCacheSection::Materials, materials.data(), materials.size() * sizeof(Material));
+	writer.add(SceneCacheSection::WideBVH, wideBVH.getPackets().data(), wideBVH.getPackets().size() * sizeof(WideBVHPacket));
+	writer.add(SceneCacheSection::CompressedBVH, compressedBVH.getNodes().data(),
+		compressedBVH.getNodes().size() * sizeof(CompressedBVHNode));
+
+	SceneCacheHeader header;
+	header.sourceHash = sourceHash;
+	header.settingsHash = sceneCacheSettingsHash(bvhLayout);
+	header.triangleCount = (uint32_t)meshTriangles.size();
+	header.bvhLayout = (uint32_t)bvhLayout;
+
+	bool written = writer.write(cachePath, header);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, intersectionBuffer);
+	glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+
+	if (!written) {
+		std::cerr << "Could not write scene cache: " << cachePath << std::endl;
+		return false;
 	}
+	std::cout << "Wrote scene cache: " << cachePath << std::endl;
+	return true;
 }
 
-int OBJLoader::findBestSplit(const std::vector<uint32_t>& indices, uint32_t start, uint32_t end) {
-	float minBounds[3], maxBounds[3];
-	calculateBounds(indices, start, end, minBounds, maxBounds);
+bool OBJLoader::loadSceneCache(const std::string& cachePath, uint64_t sourceHash, BVHLayout layout) {
+	auto startTime = std::chrono::high_resolution_clock::now();
 
-	int bestAxis = 0;
-	float maxExtent = maxBounds[0] - minBounds[0];
+	SceneCacheReader cache;
+	if (!cache.open(cachePath, sourceHash, sceneCacheSettingsHash(layout))) return false;
 
-	for (int axis = 1; axis < 3; axis++) {
-		float extent = maxBounds[axis] - minBounds[axis];
-		if (extent > maxExtent) {
-			maxExtent = extent;
-			bestAxis = axis;
-		}
+	// The cached buffers replace whatever was loaded before
+	cleanup();
+	triangles.clear();
+	bvhNodes.clear();
+	triangleIndices.clear();
+	trianglePositions.clear();
+	triangleVertices.clear();
+	meshTriangles.clear();
+	meshVertices.clear();
+	slotUserOffsets.clear();
+	slotUsers.clear();
+	wideBVH.clear();
+	compressedBVH.clear();
+	bvhLayout = layout;
+
+	auto upload = [&](GLuint& buffer, SceneCacheSection section) {
+		if (cache.size(section) == 0) return;
+		if (buffer == 0) glGenBuffers(1, &buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, cache.size(section), cache.data(section), GL_STATIC_DRAW);
+	};
+	upload(bvhBuffer, SceneCacheSection::BVHNodes);
+	upload(intersectionBuffer, SceneCacheSection::IntersectionTriangles);
+	upload(triangleBuffer, SceneCacheSection::MeshTriangles);
+	upload(vertexBuffer, SceneCacheSection::MeshVertices);
+	upload(materialBuffer, SceneCacheSection::Materials);
+	upload(wideBVHBuffer, SceneCacheSection::WideBVH);
+	upload(compressedBVHBuffer, SceneCacheSection::CompressedBVH);
+
+	// Materials are small and may be edited, keep a CPU copy
+	const Material* cachedMaterials = (const Material*)cache.data(SceneCacheSection::Materials);
+	materials.assign(cachedMaterials, cachedMaterials + cache.size(SceneCacheSection::Materials) / sizeof(Material));
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	printf("Loaded scene cache: %u triangles, %.2f MB in %.2f ms\n", cache.getHeader().triangleCount,
+		cache.fileSize() / 1.0e6, std::chrono::duration<double, std::milli>(endTime - startTime).count());
+	return true;
+}
+
+void OBJLoader::buildSlotUsers() {
+	slotUserOffsets.assign(meshVertices.size() + 1, 0);
+	for (const MeshTriangle& tri : meshTriangles) {
+		for (int c = 0; c < 3; c++) slotUserOffsets[tri.vertex[c] + 1]++;
 	}
+	for (size_t slot = 0; slot < meshVertices.size(); slot++) slotUserOffsets[slot + 1] += slotUserOffsets[slot];
 
-	return bestAxis;
+	std::vector<uint32_t> next(slotUserOffsets.begin(), slotUserOffsets.end() - 1);
+	slotUsers.resize(3 * meshTriangles.size());
+	for (size_t position = 0; position < meshTriangles.size(); position++) {
+		for (int c = 0; c < 3; c++) slotUsers[next[meshTriangles[position].vertex[c]]++] = (uint32_t)(3 * position + c);
+	}
 }
 
-void OBJLoader::uploadToGPU() {
-	// Upload BVH nodes
-	if (!bvhNodes.empty()) {
-		if (bvhBuffer == 0) {
-			glGenBuffers(1, &bvhBuffer);
+void OBJLoader::markPositionDirty(size_t position) {
+	if (dirtyTriangleBegin == dirtyTriangleEnd) {
+		dirtyTriangleBegin = position;
+		dirtyTriangleEnd = position + 1;
+	}
+	else {
+		dirtyTriangleBegin = std::min(dirtyTriangleBegin, position);
+		dirtyTriangleEnd = std::max(dirtyTriangleEnd, position + 1);
+	}
+}
+
+void OBJLoader::markTrianglesDirty(size_t first, size_t count) {
+	size_t last = std::min(triangles.size(), first + count);
+	bool uploaded = meshTriangles.size() == triangles.size();
+	if (uploaded && slotUserOffsets.empty()) buildSlotUsers();
+
+	for (size_t i = first; i < last; i++) {
+		// Without a CPU BVH the triangles stay in file order
+		size_t position = trianglePositions.empty() ? i : trianglePositions[i];
+		markPositionDirty(position);
+		if (!uploaded) continue;
+
+		// Corners with the same v/vt/vn share a mesh vertex, so a moved corner moves every
+		// triangle using it: their CPU copies follow (for refit and later edits) and they are
+		// re-streamed too. When two triangles move a shared corner apart, the later one wins.
+		for (int c = 0; c < 3; c++) {
+			float position3[3];
+			memcpy(position3, (c == 0 ? triangles[i].v0 : c == 1 ? triangles[i].v1 : triangles[i].v2).position, sizeof(position3));
+			uint32_t slot = meshTriangles[position].vertex[c];
+			if (memcmp(position3, meshVertices[slot].position, sizeof(position3)) == 0) continue;
+
+			memcpy(meshVertices[slot].position, position3, sizeof(position3));
+			for (uint32_t u = slotUserOffsets[slot]; u < slotUserOffsets[slot + 1]; u++) {
+				size_t userPosition = slotUsers[u] / 3;
+				int corner = slotUsers[u] % 3;
+				Triangle& user = triangles[triangleIndices.empty() ? userPosition : triangleIndices[userPosition]];
+				memcpy((corner == 0 ? user.v0 : corner == 1 ? user.v1 : user.v2).position, position3, sizeof(position3));
+				markPositionDirty(userPosition);
+			}
 		}
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhBuffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, bvhNodes.size() * sizeof(BVHNode),
-			bvhNodes.data(), GL_STATIC_DRAW);
+	}
+}
+
+void OBJLoader::refit() {
+	if (bvhNodes.empty()) return;
+
+	if (!refitPool && bvhSettings.threadCount != 1) {
+		unsigned threadCount = bvhSettings.threadCount == 0 ? ThreadPool::hardwareThreads() : bvhSettings.threadCount;
+		if (threadCount > 1) refitPool = std::make_unique<ThreadPool>(threadCount - 1);
 	}
 
-	// Upload triangles (reordered by BVH)
-	if (!triangles.empty()) {
-		if (triangleBuffer == 0) {
-			glGenBuffers(1, &triangleBuffer);
+	std::pair<uint32_t, uint32_t> changed = BVHBuilder::refit(triangles, triangleIndices, bvhNodes, refitPool.get(),
+		bvhSettings.parallelThreshold);
+	if (changed.first < changed.second) {
+		if (dirtyNodeBegin == dirtyNodeEnd) {
+			dirtyNodeBegin = changed.first;
+			dirtyNodeEnd = changed.second;
+		}
+		else {
+			dirtyNodeBegin = std::min(dirtyNodeBegin, changed.first);
+			dirtyNodeEnd = std::max(dirtyNodeEnd, changed.second);
 		}
 
-		// Reorder triangles according to BVH
-		std::vector<Triangle> reorderedTriangles(triangles.size());
-		for (size_t i = 0; i < triangleIndices.size(); i++) {
-			reorderedTriangles[i] = triangles[triangleIndices[i]];
+		if (!wideBVH.empty()) {
+			wideBVH.refitFrom(bvhNodes);
+			layoutDirty = true;
 		}
+		if (!compressedBVH.empty()) {
+			compressedBVH.refitFrom(bvhNodes);
+			layoutDirty = true;
+		}
+	}
 
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleBuffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, reorderedTriangles.size() * sizeof(Triangle),
-			reorderedTriangles.data(), GL_STATIC_DRAW);
+	uploadDirtyRanges();
+}
+
+void OBJLoader::uploadDirtyRanges() {
+	if (bvhBuffer != 0 && dirtyNodeBegin < dirtyNodeEnd) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyNodeBegin * sizeof(BVHNode),
+			(dirtyNodeEnd - dirtyNodeBegin) * sizeof(BVHNode), &bvhNodes[dirtyNodeBegin]);
 	}
+	dirtyNodeBegin = dirtyNodeEnd = 0;
 
-	// Upload materials
-	if (!materials.empty()) {
-		if (materialBuffer == 0) {
-			glGenBuffers(1, &materialBuffer);
+	// Wide and compressed nodes are laid out breadth first, refreshed as a whole
+	if (layoutDirty && wideBVHBuffer != 0 && !wideBVH.empty()) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, wideBVHBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, wideBVH.getPackets().size() * sizeof(WideBVHPacket),
+			wideBVH.getPackets().data());
+	}
+	if (layoutDirty && compressedBVHBuffer != 0 && !compressedBVH.empty()) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, compressedBVHBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, compressedBVH.getNodes().size() * sizeof(CompressedBVHNode),
+			compressedBVH.getNodes().data());
+	}
+	layoutDirty = false;
+
+	if (vertexBuffer != 0 && dirtyTriangleBegin < dirtyTriangleEnd) {
+		// The topology is fixed, only the pool vertices of the dirty triangles change
+		uint32_t vertexBegin = UINT32_MAX, vertexEnd = 0;
+		for (size_t position = dirtyTriangleBegin; position < dirtyTriangleEnd; position++) {
+			const Triangle& tri = triangles[triangleIndices.empty() ? position : triangleIndices[position]];
+			for (int c = 0; c < 3; c++) {
+				uint32_t slot = meshTriangles[position].vertex[c];
+				meshVertices[slot] = toMeshVertex(c == 0 ? tri.v0 : c == 1 ? tri.v1 : tri.v2);
+				vertexBegin = std::min(vertexBegin, slot);
+				vertexEnd = std::max(vertexEnd, slot + 1);
+			}
 		}
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(Material),
-			materials.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, vertexBegin * sizeof(MeshVertex),
+			(vertexEnd - vertexBegin) * sizeof(MeshVertex), &meshVertices[vertexBegin]);
+		streamIntersectionTriangles(dirtyTriangleBegin, dirtyTriangleEnd);
 	}
-
-	std::cout << "Uploaded to GPU: " << triangles.size() << " triangles, "
-		<< bvhNodes.size() << " BVH nodes, " << materials.size() << " materials" << std::endl;
+	dirtyTriangleBegin = dirtyTriangleEnd = 0;
 }
 
 void OBJLoader::cleanup() {
@@ -541,10 +1307,26 @@ void OBJLoader::cleanup() {
 		glDeleteBuffers(1, &triangleBuffer);
 		triangleBuffer = 0;
 	}
+	if (vertexBuffer != 0) {
+		glDeleteBuffers(1, &vertexBuffer);
+		vertexBuffer = 0;
+	}
+	if (intersectionBuffer != 0) {
+		glDeleteBuffers(1, &intersectionBuffer);
+		intersectionBuffer = 0;
+	}
 	if (materialBuffer != 0) {
 		glDeleteBuffers(1, &materialBuffer);
 		materialBuffer = 0;
 	}
+	if (wideBVHBuffer != 0) {
+		glDeleteBuffers(1, &wideBVHBuffer);
+		wideBVHBuffer = 0;
+	}
+	if (compressedBVHBuffer != 0) {
+		glDeleteBuffers(1, &compressedBVHBuffer);
+		compressedBVHBuffer = 0;
+	}
 }
 
 // Utility functions
@@ -620,6 +1402,86 @@ std::string OBJLoader::trim(const std::string& str) {
 	return str.substr(first, (last - first + 1));
 }
 
+// In-place tokenizer used by loadOBJ(), whitespace as in std::isspace
+const char* OBJLoader::skipSpace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f')) p++;
+	return p;
+}
+
+const char* OBJLoader::tokenEnd(const char* p, const char* end) {
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\v' && *p != '\f') p++;
+	return p;
+}
+
+// Reads one float like operator>>: 0 if the token is not a number
+const char* OBJLoader::parseFloat(const char* p, const char* end, float& value) {
+	p = skipSpace(p, end);
+	const char* first = (p < end && *p == '+') ? p + 1 : p;
+	std::from_chars_result result = std::from_chars(first, end, value);
+	if (result.ec != std::errc()) {
+		value = 0.0f;
+		return tokenEnd(p, end);
+	}
+	return result.ptr;
+}
+
+// Reads one v, v/vt, v//vn or v/vt/vn token
+const char* OBJLoader::parseCorner(const char* p, const char* end, OBJCorner& corner) {
+	corner = OBJCorner();
+	int* fields[3] = { &corner.position, &corner.texCoord, &corner.normal };
+
+	const char* last = tokenEnd(p, end);
+	for (int field = 0; p < last; field++) {
+		const char* slash = (const char*)memchr(p, '/', last - p);
+		const char* fieldEnd = slash ? slash : last;
+		if (field < 3 && p < fieldEnd) {
+			std::from_chars(*p == '+' ? p + 1 : p, fieldEnd, *fields[field]);
+		}
+		p = slash ? slash + 1 : last;
+	}
+	return last;
+}
+
+void OBJLoader::benchmarkOBJParse(const std::string& filename, int repeats) {
+	MappedFile file(filename);
+	if (!file.isOpen()) return;
+	double megabytes = file.size() / 1.0e6;
+	file.close();
+
+	auto bestOf = [&](const auto& load) {
+		double best = 0.0;
+		for (int i = 0; i < repeats; i++) {
+			auto startTime = std::chrono::high_resolution_clock::now();
+			load();
+			auto endTime = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+			if (i == 0 || ms < best) best = ms;
+		}
+		return best;
+	};
+
+	OBJLoader reference;
+	double streamMs = bestOf([&] { reference.loadOBJStream(filename); });
+
+	printf("OBJ parse benchmark (%s, %.2f MB, best of %d)\n", filename.c_str(), megabytes, repeats);
+	printf("  stream:             %9.2f ms %9.2f MB/s\n", streamMs, megabytes / (streamMs / 1000.0));
+
+	unsigned maxThreads = ThreadPool::hardwareThreads();
+	for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+		OBJLoader mapped;
+		double mappedMs = bestOf([&] { mapped.loadOBJ(filename, threads); });
+
+		bool identical = mapped.triangles.size() == reference.triangles.size() &&
+			memcmp(mapped.triangles.data(), reference.triangles.data(), mapped.triangles.size() * sizeof(Triangle)) == 0 &&
+			mapped.triangleVertices == reference.triangleVertices && mapped.meshVertexCount == reference.meshVertexCount;
+
+		printf("  mapped %2u threads: %9.2f ms %9.2f MB/s  speedup %5.2fx%s\n", threads, mappedMs,
+			megabytes / (mappedMs / 1000.0), mappedMs > 0.0 ? streamMs / mappedMs : 0.0, identical ? "" : "  OUTPUT DIFFERS");
+
+		if (threads >= maxThreads) break;
+	}
+}
+
 std::vector<std::string> OBJLoader::split(const std::string& str, char delimiter) {
 	std::vector<std::string> tokens;
 	std::stringstream ss(str);
@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+
+// Compile-time options of pathtracing_compute.glsl. Every combination is its own program,
+// built from the #define preamble returned by defines(). Options left at -1 keep the
+// shader's default.
+struct PathTracerVariant {
+	int scene = 8;               // SCENE
+	int maxBounces = 2;          // MAX_BOUNCES
+	int samplesPerDispatch = 1;  // SAMPLES_PER_DISPATCH
+	int bvhLayout = -1;          // BVH_LAYOUT, a BVHLayout value or -1 to switch on the bvh_layout uniform
+	int hasRefraction = -1;      // HAS_REFRACTION, 0 drops the refraction paths
+	int traversalStats = 0;      // TRAVERSAL_STATS, 1 builds the counting kernel (see traversal_stats.h)
+
+	std::string defines() const;
+};
+
+// Implementation
+inline std::string PathTracerVariant::defines() const {
+	std::string preamble;
+	auto define = [&](const char* name, int value) {
+		if (value >= 0) preamble += "#define " + std::string(name) + " " + std::to_string(value) + "\n";
+	};
+	define("SCENE", scene);
+	define("MAX_BOUNCES", maxBounces);
+	define("SAMPLES_PER_DISPATCH", samplesPerDispatch);
+	define("BVH_LAYOUT", bvhLayout);
+	define("HAS_REFRACTION", hasRefraction);
+	define("TRAVERSAL_STATS", traversalStats);
+	return preamble;
+}
+
+// How the path tracer dispatches a frame, switchable at runtime
+enum class PathTracerMode {
+	Megakernel,       // main() of pathtracing_compute.glsl, one invocation per pixel runs the whole path
+	Wavefront,        // generate, extend, shade and accumulate passes over ray queues (wavefront_path_tracer.h)
+	PersistentThreads // the megakernel on a device-filling launch pulling tiles from a counter (persistent_path_tracer.h)
+};
+
+inline const char* pathTracerModeName(PathTracerMode mode) {
+	switch (mode) {
+	case PathTracerMode::Wavefront: return "wavefront";
+	case PathTracerMode::PersistentThreads: return "persistent threads";
+	default: return "megakernel";
+	}
+}
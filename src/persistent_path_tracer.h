@@ -0,0 +1,148 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "shader.h"
+#include "gpu_profiler.h"
+#include "path_tracer_variant.h"
+
+// GL_NV_shader_thread_group, not in the generated glad headers
+#ifndef GL_WARP_SIZE_NV
+#define GL_WARP_SIZE_NV 0x9339
+#define GL_WARPS_PER_SM_NV 0x933A
+#define GL_SM_COUNT_NV 0x933B
+#endif
+
+// Persistent threads mode of the path tracer: the megakernel built with PERSISTENT_THREADS.
+// Instead of one 8x8 workgroup per tile of the image, only as many workgroups as the GPU runs
+// at once are launched, and they take tiles from a global atomic counter until the image is
+// done. Groups that draw short paths keep working instead of retiring early, and there is no
+// tail of late workgroups waiting for a free slot.
+class PersistentPathTracer {
+public:
+	PersistentPathTracer() = default;
+	~PersistentPathTracer() {
+		cleanup();
+	}
+
+	PersistentPathTracer(const PersistentPathTracer&) = delete;
+	PersistentPathTracer& operator=(const PersistentPathTracer&) = delete;
+
+	// Builds the kernel of the variant from sourcePath. It does not count traversal stats.
+	void create(const PathTracerVariant& variant, const char* sourcePath);
+	bool isCreated() const { return kernel != nullptr; }
+
+	// One dispatch worth of samples into the image on unit 0, bound the same way as for the
+	// megakernel. With a profiler the dispatch is timed as the "Path tracing persistent" stage.
+	void dispatch(int width, int height, const glm::vec3& sceneTranslation, int bvhLayout, GPUProfiler* profiler = nullptr);
+
+	// Workgroups launched per dispatch, 0 sizes them to the device
+	void setGroupCount(int groups) { requestedGroups = std::max(groups, 0); }
+	int getGroupCount() const { return requestedGroups; }
+	// What 0 resolves to, and whether the device reported its size or it is a guess
+	int getDeviceGroupCount() const { return deviceGroups; }
+	bool isDeviceGroupCountQueried() const { return deviceQueried; }
+	// Workgroups the last dispatch launched
+	int getLaunchedGroups() const { return launchedGroups; }
+
+	void cleanup();
+
+private:
+	static const int GROUP_SIZE = 64;       // the 8x8 layout of the megakernel
+	static const int FALLBACK_GROUPS = 512; // without a device query, enough for current desktop GPUs
+	static const GLuint WORK_BINDING = 23;
+	static constexpr const char* KERNEL_NAME = "Path tracing persistent threads";
+
+	std::unique_ptr<Shader> kernel;
+	GLuint workBuffer = 0;
+
+	int requestedGroups = 0;
+	int deviceGroups = FALLBACK_GROUPS;
+	bool deviceQueried = false;
+	int launchedGroups = 0;
+
+	void queryDeviceGroups();
+};
+
+// Implementation
+inline void PersistentPathTracer::create(const PathTracerVariant& variant, const char* sourcePath) {
+	PathTracerVariant kernelVariant = variant;
+	kernelVariant.traversalStats = 0;
+	kernel = std::make_unique<Shader>(KERNEL_NAME, sourcePath,
+		kernelVariant.defines() + "#define PERSISTENT_THREADS 1\n");
+
+	if (workBuffer == 0) {
+		glGenBuffers(1, &workBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, workBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+	}
+	queryDeviceGroups();
+}
+
+inline void PersistentPathTracer::queryDeviceGroups() {
+	// Only NVIDIA reports its shader cores through GL. A full device is every warp slot of
+	// every SM; elsewhere the fallback over-subscribes slightly, which costs little.
+	deviceGroups = FALLBACK_GROUPS;
+	deviceQueried = false;
+
+	GLint extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+	for (GLint i = 0; i < extensions; i++) {
+		const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (name == nullptr || strcmp(name, "GL_NV_shader_thread_group") != 0) continue;
+
+		GLint smCount = 0, warpsPerSM = 0, warpSize = 0;
+		glGetIntegerv(GL_SM_COUNT_NV, &smCount);
+		glGetIntegerv(GL_WARPS_PER_SM_NV, &warpsPerSM);
+		glGetIntegerv(GL_WARP_SIZE_NV, &warpSize);
+		if (smCount > 0 && warpsPerSM > 0 && warpSize > 0) {
+			deviceGroups = std::max(smCount * warpsPerSM * warpSize / GROUP_SIZE, 1);
+			deviceQueried = true;
+		}
+		break;
+	}
+}
+
+inline void PersistentPathTracer::dispatch(int width, int height, const glm::vec3& sceneTranslation, int bvhLayout,
+	GPUProfiler* profiler) {
+	if (!isCreated() || width <= 0 || height <= 0) return;
+
+	// never more groups than tiles, a group without a pixel only costs its launch
+	int tiles = ((width + 7) / 8) * ((height + 7) / 8);
+	launchedGroups = std::min(requestedGroups > 0 ? requestedGroups : deviceGroups, tiles);
+
+	uint32_t zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, workBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, WORK_BINDING, workBuffer);
+
+	kernel->setVec3("sphereX", sceneTranslation);
+	kernel->setInt("bvh_layout", bvhLayout);
+	kernel->use();
+	kernel->updateUniforms();
+
+	if (profiler) profiler->begin("Path tracing persistent");
+	glDispatchCompute((GLuint)launchedGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	if (profiler) profiler->end();
+}
+
+inline void PersistentPathTracer::cleanup() {
+	if (workBuffer != 0) glDeleteBuffers(1, &workBuffer);
+	workBuffer = 0;
+
+	// The createdShaders entry holds the current program, the kernel may not have followed a hot reload yet
+	if (kernel) {
+		auto created = Shader::createdShaders.find(KERNEL_NAME);
+		if (created != Shader::createdShaders.end()) {
+			glDeleteProgram(created->second.ID);
+			Shader::createdShaders.erase(created);
+		}
+		kernel.reset();
+	}
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include "mapped_file.h"
+#include "hash.h"
+
+// Binary cache of a loaded and built scene, so warm starts skip parsing and the BVH build.
+// Layout: SceneCacheHeader, then every section at a 64-byte aligned offset, stored exactly
+// as the GPU buffer it fills. Bump SCENE_CACHE_VERSION whenever a section's layout changes.
+const uint32_t SCENE_CACHE_MAGIC = 0x43534B4C; // "LKSC"
+const uint32_t SCENE_CACHE_VERSION = 1;
+
+enum class SceneCacheSection : uint32_t {
+	BVHNodes,              // BVHNode
+	IntersectionTriangles, // IntersectionTriangle, BVH order
+	MeshTriangles,         // MeshTriangle, BVH order
+	MeshVertices,          // MeshVertex
+	Materials,             // Material
+	WideBVH,               // WideBVHPacket, empty unless the layout is BVH4/BVH8
+	CompressedBVH,         // CompressedBVHNode, empty unless the layout is compressed
+	Count
+};
+
+struct SceneCacheHeader {
+	uint32_t magic = SCENE_CACHE_MAGIC;
+	uint32_t version = SCENE_CACHE_VERSION;
+	uint64_t sourceHash = 0;   // hash of the source asset and of what was applied to it before the build
+	uint64_t settingsHash = 0; // hash of the build settings and the BVH layout
+	uint32_t triangleCount = 0;
+	uint32_t bvhLayout = 0;
+	struct {
+		uint64_t offset;
+		uint64_t size;
+	} sections[(size_t)SceneCacheSection::Count] = {};
+};
+
+// Hash of a file's contents, 0 if it cannot be read
+inline uint64_t hashFile(const std::string& filename) {
+	MappedFile file(filename);
+	if (!file.isOpen()) return 0;
+	return hashBytes(file.data(), file.size());
+}
+
+// Collects pointers to the caller's arrays and writes them out as one cache file
+class SceneCacheWriter {
+public:
+	void add(SceneCacheSection section, const void* data, size_t size);
+	bool write(const std::string& filename, SceneCacheHeader header) const;
+
+private:
+	struct Pending {
+		const void* data = nullptr;
+		size_t size = 0;
+	};
+	Pending sections[(size_t)SceneCacheSection::Count];
+};
+
+// Maps a cache file and checks its key. The sections point into the mapping and stay
+// valid until the reader is destroyed.
+class SceneCacheReader {
+public:
+	bool open(const std::string& filename, uint64_t sourceHash, uint64_t settingsHash);
+
+	const SceneCacheHeader& getHeader() const { return header; }
+	const void* data(SceneCacheSection section) const;
+	size_t size(SceneCacheSection section) const { return (size_t)header.sections[(size_t)section].size; }
+	size_t fileSize() const { return file.size(); }
+
+private:
+	MappedFile file;
+	SceneCacheHeader header;
+};
+
+// Implementation
+inline void SceneCacheWriter::add(SceneCacheSection section, const void* data, size_t size) {
+	sections[(size_t)section].data = data;
+	sections[(size_t)section].size = size;
+}
+
+inline bool SceneCacheWriter::write(const std::string& filename, SceneCacheHeader header) const {
+	uint64_t offset = (sizeof(SceneCacheHeader) + 63) & ~(uint64_t)63;
+	for (size_t i = 0; i < (size_t)SceneCacheSection::Count; i++) {
+		header.sections[i].offset = offset;
+		header.sections[i].size = sections[i].size;
+		offset = (offset + sections[i].size + 63) & ~(uint64_t)63;
+	}
+
+	// Written under a temporary name first, so an interrupted write never leaves a valid looking cache
+	std::string temporary = filename + ".tmp";
+	std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+
+	static const char zeros[64] = {};
+	out.write((const char*)&header, sizeof(header));
+	uint64_t written = sizeof(header);
+	for (size_t i = 0; i < (size_t)SceneCacheSection::Count; i++) {
+		out.write(zeros, (std::streamsize)(header.sections[i].offset - written));
+		if (sections[i].size > 0) out.write((const char*)sections[i].data, (std::streamsize)sections[i].size);
+		written = header.sections[i].offset + sections[i].size;
+	}
+	out.close();
+	if (!out) {
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	std::remove(filename.c_str());
+	return std::rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+inline bool SceneCacheReader::open(const std::string& filename, uint64_t sourceHash, uint64_t settingsHash) {
+	if (!file.open(filename) || file.size() < sizeof(SceneCacheHeader)) return false;
+
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != SCENE_CACHE_MAGIC || header.version != SCENE_CACHE_VERSION ||
+		header.sourceHash != sourceHash || header.settingsHash != settingsHash) {
+		file.close();
+		return false;
+	}
+
+	// Truncated files are treated as stale
+	for (size_t i = 0; i < (size_t)SceneCacheSection::Count; i++) {
+		if (header.sections[i].offset + header.sections[i].size > file.size()) {
+			file.close();
+			return false;
+		}
+	}
+	return true;
+}
+
+inline const void* SceneCacheReader::data(SceneCacheSection section) const {
+	return file.data() + header.sections[(size_t)section].offset;
+}
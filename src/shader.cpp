@@ -1,10 +1,28 @@
 
 #include "shader.h"
+#include "hash.h"
 
 //TODO: Make a map
 //list of created shaders
 std::map<std::string,Shader> Shader::createdShaders;
 
+unsigned int Shader::glCallCount = 0;
+unsigned int Shader::glCallsLastFrame = 0;
+bool Shader::useProgramCache = true;
+std::unordered_map<unsigned int, unsigned int> Shader::reloadedPrograms;
+std::unordered_map<unsigned int, std::unordered_map<std::string, Shader::UniformState>> Shader::programUniformStates;
+
+//header of a .programcache file, followed by the binary itself
+struct ProgramCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t binaryLength;
+};
+const uint32_t PROGRAM_CACHE_MAGIC = 0x50434B4C; // "LKCP"
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
 // constructor generates the shader on the fly
 // ------------------------------------------------------------------------
 Shader::Shader(std::string shader_name, const char* vertexPath, const char* fragmentPath, const char* geometryPath)
@@ -90,17 +108,30 @@ Shader::Shader(std::string shader_name, const char* vertexPath, const char* frag
 	if (geometryPath != nullptr)
 		glDeleteShader(geometry);
 
+	cacheUniformLocations();
 
 	Shader::createdShaders.insert({ shader_name, *this });
 
 }
 
-Shader::Shader(std::string shader_name, const char* computePath) {
+Shader::Shader(std::string shader_name, const char* computePath, const std::string &defines)
+	: sourcePath(computePath), defines(defines) {
 
 
 	uniform_floats["iTime"] = 0.0f;
 	uniform_floats["iFrame"] = 0.0f;
 
+	// every variant is compiled once, later requests share the program
+	for (const auto &created : Shader::createdShaders) {
+		if (created.second.sourcePath == sourcePath && created.second.defines == defines) {
+			ID = created.second.ID;
+			cacheUniformLocations();
+			std::cout << "Reusing the program of " << created.first << " for " << shader_name << std::endl;
+			Shader::createdShaders.insert({ shader_name, *this });
+			return;
+		}
+	}
+
 	// 1. retrieve the compute source code from filePath
 	std::string computeCode;
 
@@ -122,7 +153,7 @@ Shader::Shader(std::string shader_name, const char* computePath) {
 		cShaderFile.close();
 
 		// convert stream into string
-		computeCode = cShaderStream.str();
+		computeCode = injectDefines(cShaderStream.str(), defines);
 
 	}
 	catch (std::ifstream::failure e)
@@ -130,8 +161,21 @@ Shader::Shader(std::string shader_name, const char* computePath) {
 		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 	}
 	const char* cShaderCode = computeCode.c_str();
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// 2. warm start from the program binary cache
+	std::string cachePath = programCachePath(sourcePath, defines);
+	uint64_t cacheKey = programCacheKey(computeCode);
+	ID = 0;
+	if (useProgramCache && loadProgramBinary(cachePath, cacheKey)) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		std::cout << "Loaded " << shader_name << " from the program cache in " << ms << " ms (warm)" << std::endl;
+		cacheUniformLocations();
+		Shader::createdShaders.insert({ shader_name, *this });
+		return;
+	}
 
-	// 2. compile shaders
+	// 3. compile shaders
 	unsigned int compute;
 	// vertex shader
 	compute = glCreateShader(GL_COMPUTE_SHADER);
@@ -142,12 +186,21 @@ Shader::Shader(std::string shader_name, const char* computePath) {
 	// shader Program
 	ID = glCreateProgram();
 	glAttachShader(ID, compute);
+	if (useProgramCache)
+		glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
 	glLinkProgram(ID);
 	checkCompileErrors(ID, "PROGRAM");
 	// delete the shaders as they're linked into our program now and no longer necessery
 	glDeleteShader(compute);
 
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "Compiled " << shader_name << " in " << ms << " ms (cold)" << std::endl;
+	if (useProgramCache)
+		saveProgramBinary(cachePath, cacheKey);
+
+	cacheUniformLocations();
+
 	Shader::createdShaders.insert({shader_name, *this });
 }
 
@@ -155,7 +208,13 @@ Shader::Shader(std::string shader_name, const char* computePath) {
 // ------------------------------------------------------------------------
 void Shader::use()
 {
+	bool reloaded = followReload();
 	glUseProgram(ID);
+	glCallCount++;
+
+	// a reloaded program starts with default values, it gets the current ones before its first dispatch
+	if (reloaded)
+		sendUniforms();
 }
 // utility uniform functions
 // ------------------------------------------------------------------------
@@ -203,55 +262,321 @@ void Shader::setVec4(const std::string name, float x, float y, float z, float w)
 // ------------------------------------------------------------------------
 void Shader::setMat2(const std::string name, const glm::mat2 mat)
 {
-	glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	GLint location = getUniformLocation(name);
+	if (location < 0) return;
+	glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+	glCallCount++;
 }
 // ------------------------------------------------------------------------
 void Shader::setMat3(const std::string name, const glm::mat3 mat)
 {
-	glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	GLint location = getUniformLocation(name);
+	if (location < 0) return;
+	glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+	glCallCount++;
 }
 // ------------------------------------------------------------------------
 void Shader::setMat4(const std::string name, const glm::mat4 mat)
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	GLint location = getUniformLocation(name);
+	if (location < 0) return;
+	glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+	glCallCount++;
 }
 
 void Shader::updateUniforms() {
 	++uniform_floats["iTime"];
 	++uniform_floats["iFrame"];
+	sendUniforms();
+}
+
+//only values that differ from the last ones sent reach GL, inactive uniforms are skipped
+void Shader::sendUniforms() {
 	for (const auto &element : uniform_bool) {
-		glUniform1i(glGetUniformLocation(ID, element.first.c_str()), (int)element.second);
+		UniformState &state = uniformState(element.first);
+		int value = (int)element.second;
+		if (state.location < 0 || !valueChanged(state, &value, sizeof(value))) continue;
+		glUniform1i(state.location, value);
+		glCallCount++;
 	}
 	
 	for (const auto &element : uniform_ints) {
-		glUniform1i(glGetUniformLocation(ID, element.first.c_str()), element.second);
+		UniformState &state = uniformState(element.first);
+		if (state.location < 0 || !valueChanged(state, &element.second, sizeof(int))) continue;
+		glUniform1i(state.location, element.second);
+		glCallCount++;
 	}
 
 	for (const auto &elements : uniform_floats) {
-		glUniform1f(glGetUniformLocation(ID, elements.first.c_str()), elements.second);
+		UniformState &state = uniformState(elements.first);
+		if (state.location < 0 || !valueChanged(state, &elements.second, sizeof(float))) continue;
+		glUniform1f(state.location, elements.second);
+		glCallCount++;
 	}
 
 	for (const auto &elements : uniform_vec2) {
-		glUniform2fv(glGetUniformLocation(ID, elements.first.c_str()), 1, &elements.second[0]);
+		UniformState &state = uniformState(elements.first);
+		if (state.location < 0 || !valueChanged(state, &elements.second[0], sizeof(glm::vec2))) continue;
+		glUniform2fv(state.location, 1, &elements.second[0]);
+		glCallCount++;
 	}
 
 	for (const auto &elements : uniform_vec3) {
-		glUniform3fv(glGetUniformLocation(ID, elements.first.c_str()), 1, &elements.second[0]);
+		UniformState &state = uniformState(elements.first);
+		if (state.location < 0 || !valueChanged(state, &elements.second[0], sizeof(glm::vec3))) continue;
+		glUniform3fv(state.location, 1, &elements.second[0]);
+		glCallCount++;
 	}
 
 	for (const auto &elements : uniform_vec4) {
-		glUniform4fv(glGetUniformLocation(ID, elements.first.c_str()), 1, &elements.second[0]);
+		UniformState &state = uniformState(elements.first);
+		if (state.location < 0 || !valueChanged(state, &elements.second[0], sizeof(glm::vec4))) continue;
+		glUniform4fv(state.location, 1, &elements.second[0]);
+		glCallCount++;
+	}
+}
+
+void Shader::cacheUniformLocations() {
+	std::unordered_map<std::string, UniformState> &uniformStates = programUniformStates[ID];
+	uniformStates.clear();
+
+	GLint count = 0, maxNameLength = 0;
+	glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength);
+	std::vector<char> name(maxNameLength + 1);
+
+	const GLenum property = GL_LOCATION;
+	for (GLint i = 0; i < count; i++) {
+		GLint location = -1;
+		glGetProgramResourceiv(ID, GL_UNIFORM, i, 1, &property, 1, NULL, &location);
+		//uniform block members have no location
+		if (location < 0)
+			continue;
+
+		glGetProgramResourceName(ID, GL_UNIFORM, i, (GLsizei)name.size(), NULL, name.data());
+		std::string uniformName = name.data();
+		uniformStates[uniformName].location = location;
+
+		//arrays are listed as name[0], the plain name refers to the same element
+		if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+			uniformStates[uniformName.substr(0, uniformName.size() - 3)].location = location;
+	}
+}
+
+GLint Shader::getUniformLocation(const std::string &name) {
+	return uniformState(name).location;
+}
+
+Shader::UniformState &Shader::uniformState(const std::string &name) {
+	//every active uniform was found after the link, anything else stays at -1
+	return programUniformStates[ID][name];
+}
+
+bool Shader::valueChanged(UniformState &state, const void *value, size_t size) {
+	if (state.sent && memcmp(state.value, value, size) == 0)
+		return false;
+	memcpy(state.value, value, size);
+	state.sent = true;
+	return true;
+}
+
+std::string Shader::injectDefines(const std::string &source, const std::string &defines) {
+	if (defines.empty())
+		return source;
+
+	size_t version = source.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+	if (lineEnd == std::string::npos)
+		return defines + source;
+	return source.substr(0, lineEnd + 1) + defines + "#line 2\n" + source.substr(lineEnd + 1);
+}
+
+//variants keep separate cache files so switching between them does not evict one another
+std::string Shader::programCachePath(const std::string &sourcePath, const std::string &defines) {
+	std::string cachePath = sourcePath;
+	if (!defines.empty()) {
+		char variant[24];
+		snprintf(variant, sizeof(variant), ".%016llx", (unsigned long long)hashString(defines));
+		cachePath += variant;
+	}
+	return cachePath + ".programcache";
+}
+
+//the binary is only valid for the exact source and driver build that produced it
+uint64_t Shader::programCacheKey(const std::string &source) {
+	uint64_t key = hashString(source);
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+		const char *value = (const char *)glGetString(name);
+		key = hashString(value ? value : "", key);
 	}
+	return key;
 }
 
-void Shader::attachCamera(PTCamera &camera) {
-	setFloat("u_fov", 50.f);
-	setVec3("cameraPos", camera.cameraPos);
-	setVec3("cameraFwd", camera.cameraFwd);
-	setVec3("cameraUp", camera.cameraUp);
-	setVec3("cameraRight", camera.cameraRight);
-	setVec3("cameraMov", camera.cameraMov);
+//returns false whenever the cache is missing, stale or rejected by the driver, ID is then 0
+bool Shader::loadProgramBinary(const std::string &cachePath, uint64_t key) {
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	if (formatCount == 0)
+		return false;
+
+	std::ifstream file(cachePath, std::ios::binary);
+	if (!file)
+		return false;
+
+	ProgramCacheHeader header;
+	if (!file.read((char *)&header, sizeof(header)) || header.magic != PROGRAM_CACHE_MAGIC ||
+		header.version != PROGRAM_CACHE_VERSION || header.key != key)
+		return false;
+
+	std::vector<char> binary(header.binaryLength);
+	if (!file.read(binary.data(), binary.size()))
+		return false;
+
+	ID = glCreateProgram();
+	glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glProgramBinary(ID, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+
+	//drivers may reject their own binaries after an update, that is not an error
+	GLint success = 0;
+	glGetProgramiv(ID, GL_LINK_STATUS, &success);
+	if (!success) {
+		std::cout << "Program cache rejected by the driver, recompiling: " << cachePath << std::endl;
+		glDeleteProgram(ID);
+		ID = 0;
+		return false;
+	}
+	return true;
+}
+
+void Shader::saveProgramBinary(const std::string &cachePath, uint64_t key) {
+	GLint success = 0, length = 0;
+	glGetProgramiv(ID, GL_LINK_STATUS, &success);
+	glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!success || length <= 0)
+		return;
+
+	ProgramCacheHeader header = { PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, 0, 0 };
+	std::vector<char> binary(length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	glGetProgramBinary(ID, length, &written, &format, binary.data());
+	if (written <= 0)
+		return;
+	header.binaryFormat = format;
+	header.binaryLength = (uint32_t)written;
+
+	std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+	file.write((const char *)&header, sizeof(header));
+	file.write(binary.data(), written);
+	if (!file)
+		std::cout << "Could not write the program cache: " << cachePath << std::endl;
+}
+
+std::vector<std::string> Shader::reloadChanged(const std::vector<std::string> &changedPaths) {
+	std::vector<std::string> reloaded;
+	std::unordered_map<unsigned int, unsigned int> replaced;
+	for (auto &created : createdShaders) {
+		Shader &shader = created.second;
+		if (shader.sourcePath.empty())
+			continue;
+		bool changed = false;
+		for (const std::string &path : changedPaths)
+			changed = changed || path == shader.sourcePath;
+		if (!changed)
+			continue;
+
+		// variants sharing a program are compiled once
+		auto previous = replaced.find(shader.ID);
+		if (previous != replaced.end()) {
+			shader.ID = previous->second;
+			shader.cacheUniformLocations();
+			reloaded.push_back(created.first);
+			continue;
+		}
+
+		unsigned int oldID = shader.ID;
+		if (shader.reload()) {
+			replaced[oldID] = shader.ID;
+			reloaded.push_back(created.first);
+		}
+	}
+
+	// Keys are deleted names and values live programs, so a copy of a Shader follows in one step.
+	// The driver hands freed names out again: a pair keyed by a name that is live again goes, and
+	// pairs leading to a replaced program lead to its replacement, so no chain can loop.
+	for (const auto &program : replaced) {
+		reloadedPrograms.erase(program.second);
+		for (auto &pair : reloadedPrograms) {
+			if (pair.second == program.first)
+				pair.second = program.second;
+		}
+		reloadedPrograms[program.first] = program.second;
+		programUniformStates.erase(program.first);
+		glDeleteProgram(program.first);
+	}
+	return reloaded;
+}
+
+bool Shader::reload() {
+	std::ifstream file(sourcePath);
+	if (!file) {
+		std::cout << "Hot reload could not read " << sourcePath << std::endl;
+		return false;
+	}
+	std::stringstream stream;
+	stream << file.rdbuf();
+	std::string computeCode = injectDefines(stream.str(), defines);
+	const char *cShaderCode = computeCode.c_str();
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &cShaderCode, NULL);
+	glCompileShader(compute);
+	checkCompileErrors(compute, "COMPUTE");
+
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, compute);
+	if (useProgramCache)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	checkCompileErrors(program, "PROGRAM");
+	glDeleteShader(compute);
+
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		std::cout << "Hot reload failed, keeping the running program of " << sourcePath << std::endl;
+		glDeleteProgram(program);
+		return false;
+	}
+
+	ID = program;
+	cacheUniformLocations();
+	if (useProgramCache) {
+		saveProgramBinary(programCachePath(sourcePath, defines), programCacheKey(computeCode));
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "Reloaded " << sourcePath << " in " << ms << " ms" << std::endl;
+	return true;
+}
+
+bool Shader::followReload() {
+	if (reloadedPrograms.empty())
+		return false;
+
+	auto next = reloadedPrograms.find(ID);
+	if (next == reloadedPrograms.end())
+		return false;
+	ID = next->second;
+	// the new program starts with default uniform values, everything is sent again
+	cacheUniformLocations();
+	return true;
+}
 
+void Shader::endFrame() {
+	glCallsLastFrame = glCallCount;
+	glCallCount = 0;
 }
 
 // utility function for checking shader compilation/linking errors.
@@ -11,6 +11,10 @@
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <cstdio>
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -36,13 +40,27 @@ public:
 	std::unordered_map<std::string, bool> uniform_bool;
 	std::unordered_map<std::string, glm::vec2> uniform_vec2;
 
+	//source file and define preamble of a compute shader, identify its variant
+	std::string sourcePath;
+	std::string defines;
+
+	//GL calls issued by all shaders (uniform uploads, location queries, program binds),
+	//counted so the CPU side cost per frame can be measured
+	static unsigned int glCallCount;
+	static unsigned int glCallsLastFrame;
+
+	//compute programs are stored as driver binaries next to their source (<path>.programcache)
+	//and loaded from there when the source and the driver are unchanged
+	static bool useProgramCache;
+
 	// constructor generates a basic shader on the fly
 	// ------------------------------------------------------------------------
 	Shader(std::string shader_name, const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
 
-	//constructor for a compute shader
+	//constructor for a compute shader, defines is a #define preamble inserted after #version.
+	//a source/defines pair that is already in createdShaders shares that program
 	//------------------------------------------------------------------------
-	Shader(std::string shader_name, const char* computePath);
+	Shader(std::string shader_name, const char* computePath, const std::string &defines = "");
 
 	// activate the shader
 	// ------------------------------------------------------------------------
@@ -82,13 +100,63 @@ public:
 	// ------------------------------------------------------------------------
 	void setMat4(const std::string name, const glm::mat4 mat);
 
+	//advances iTime and iFrame and sends the uniforms whose value changed since the last update
 	void updateUniforms();
 
-	void attachCamera(PTCamera &camera);
+	//looks up the locations of all active uniforms, needed again after every link
+	void cacheUniformLocations();
+
+	//location of an active uniform, -1 if the program does not use it
+	GLint getUniformLocation(const std::string &name);
+
+	//stores the GL call count of the frame that just ended and starts counting the next one
+	static void endFrame();
+
+	//hot reload: recompiles the compute programs in createdShaders built from one of the
+	//changed paths. A program is only replaced when the new one links, every Shader using
+	//it switches over on its next use(). Returns the names of the reloaded shaders.
+	static std::vector<std::string> reloadChanged(const std::vector<std::string> &changedPaths);
 
 
 
 private:
+	//cached location and the value last sent to it, ints and bools are stored bitwise
+	struct UniformState {
+		GLint location = -1;
+		bool sent = false;
+		float value[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	};
+	// kept per program: Shaders sharing a program, and the copies in createdShaders, see the values
+	// any of them sent, so one cannot skip an upload another one overwrote
+	static std::unordered_map<unsigned int, std::unordered_map<std::string, UniformState>> programUniformStates;
+
+	// programs replaced by a hot reload, old ID to new ID
+	static std::unordered_map<unsigned int, unsigned int> reloadedPrograms;
+
+	// recompiles this compute shader from sourcePath, keeps the current program on failure
+	bool reload();
+
+	// switches to the program that replaced ID, if any, and returns true when it did
+	bool followReload();
+
+	// sends the uniforms whose value differs from the last one sent
+	void sendUniforms();
+
+	// returns the state of a uniform, names the program does not use get location -1
+	UniformState &uniformState(const std::string &name);
+
+	// records the value as sent and returns true if it differs from the last one
+	static bool valueChanged(UniformState &state, const void *value, size_t size);
+
+	// inserts the define preamble after the #version line, line numbers in errors stay those of the file
+	static std::string injectDefines(const std::string &source, const std::string &defines);
+
+	// program binary cache, keyed by the exact source text and the driver
+	static uint64_t programCacheKey(const std::string &source);
+	static std::string programCachePath(const std::string &sourcePath, const std::string &defines);
+	bool loadProgramBinary(const std::string &cachePath, uint64_t key);
+	void saveProgramBinary(const std::string &cachePath, uint64_t key);
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type);
@@ -0,0 +1,126 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <climits>
+#endif
+
+// Reports watched shader files that were written since the last poll, so they can be
+// reloaded at a frame boundary. Linux watches the containing directories with inotify,
+// which also catches editors that save by renaming a new file over the old one. Other
+// platforms compare modification times on every poll.
+class ShaderFileWatcher {
+public:
+	ShaderFileWatcher() = default;
+	~ShaderFileWatcher() {
+		close();
+	}
+
+	ShaderFileWatcher(const ShaderFileWatcher&) = delete;
+	ShaderFileWatcher& operator=(const ShaderFileWatcher&) = delete;
+
+	// Adding a path twice is harmless
+	void watch(const std::string& path);
+
+	// Watched paths changed since the last call, each listed once
+	std::vector<std::string> poll();
+
+	void close();
+
+private:
+	struct WatchedFile {
+		std::string path;      // as given to watch(), this is what poll() reports
+		std::string directory; // "." when the path has none
+		std::string name;
+		std::filesystem::file_time_type lastWrite;
+		int descriptor = -1;   // inotify watch of the directory
+	};
+	std::vector<WatchedFile> files;
+
+#ifdef __linux__
+	int inotifyFd = -1;
+#endif
+
+	static std::filesystem::file_time_type lastWriteTime(const std::string& path);
+};
+
+// Implementation
+inline std::filesystem::file_time_type ShaderFileWatcher::lastWriteTime(const std::string& path) {
+	std::error_code error;
+	std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+	return error ? std::filesystem::file_time_type() : time;
+}
+
+inline void ShaderFileWatcher::watch(const std::string& path) {
+	for (const WatchedFile& file : files) {
+		if (file.path == path) return;
+	}
+
+	WatchedFile file;
+	file.path = path;
+	size_t separator = path.find_last_of("/\\");
+	file.directory = separator == std::string::npos ? "." : path.substr(0, separator);
+	file.name = separator == std::string::npos ? path : path.substr(separator + 1);
+	file.lastWrite = lastWriteTime(path);
+
+#ifdef __linux__
+	if (inotifyFd < 0) {
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	}
+	if (inotifyFd >= 0) {
+		// Watching a directory twice returns the same descriptor
+		file.descriptor = inotify_add_watch(inotifyFd, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	}
+#endif
+	files.push_back(file);
+}
+
+inline std::vector<std::string> ShaderFileWatcher::poll() {
+	std::vector<bool> changed(files.size(), false);
+
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+		ssize_t length;
+		while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char* cursor = buffer; cursor < buffer + length; ) {
+				const inotify_event* event = (const inotify_event*)cursor;
+				for (size_t i = 0; i < files.size(); i++) {
+					if (event->len > 0 && files[i].descriptor == event->wd && files[i].name == event->name) {
+						changed[i] = true;
+					}
+				}
+				cursor += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+#endif
+
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < files.size(); i++) {
+		// Without an inotify watch the modification time decides
+		if (files[i].descriptor < 0) {
+			std::filesystem::file_time_type time = lastWriteTime(files[i].path);
+			changed[i] = time != files[i].lastWrite;
+			files[i].lastWrite = time;
+		}
+		if (changed[i]) paths.push_back(files[i].path);
+	}
+	return paths;
+}
+
+inline void ShaderFileWatcher::close() {
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		::close(inotifyFd);
+		inotifyFd = -1;
+	}
+#endif
+	files.clear();
+}
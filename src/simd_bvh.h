@@ -0,0 +1,470 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <float.h>
+
+#include <glm/glm.hpp>
+
+#include "bvh_builder.h"
+#include "wide_bvh.h"
+
+// x86 builds carry SSE4 and AVX2 kernels. GCC and Clang compile them per function with a
+// target attribute, so the rest of the program stays on the baseline instruction set and
+// the level is picked at runtime; MSVC allows the intrinsics without any flag.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_BVH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_TARGET_SSE4
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define SIMD_BVH_X86 0
+#endif
+
+enum class SIMDLevel {
+	Scalar,
+	SSE4,
+	AVX2
+};
+
+const char* simdLevelName(SIMDLevel level);
+// Best level the CPU and OS support, detected once
+SIMDLevel detectSIMDLevel();
+
+// Triangle in BVH leaf order, the CPU copy of the kernel's intersection buffer
+struct CPUTriangle {
+	glm::vec3 v0;
+	glm::vec3 edge1;
+	glm::vec3 edge2;
+	uint32_t materialIndex;
+};
+
+// 8-wide BVH for single ray, multi box traversal on the CPU. The binary tree is collapsed
+// with WideBVH, every node keeps its 8 child boxes SoA, and the triangles of each leaf are
+// packed SoA in blocks of 8. AVX2 tests a node or a block in one step, SSE4 in two halves.
+// The tests repeat the kernel's arithmetic, so hits match the scalar traversal.
+class SIMDBVH {
+public:
+	void build(const std::vector<BVHNode>& nodes, const std::vector<CPUTriangle>& triangles);
+	void clear();
+
+	bool empty() const { return nodes.empty(); }
+	size_t getNodeCount() const { return nodes.size(); }
+	size_t getBlockCount() const { return blocks.size(); }
+
+	// Closest hit with minimumT < t < tMax, t and triangle (index into the BVH order triangles)
+	// are only written on a hit. level must be SSE4 or AVX2 and supported by the CPU.
+	bool intersect(SIMDLevel level, const glm::vec3& origin, const glm::vec3& direction, float minimumT, float tMax,
+		float& t, uint32_t& triangle) const;
+
+private:
+	static const int STACK_SIZE = 512;
+
+	struct alignas(32) Node {
+		float minX[8], minY[8], minZ[8];
+		float maxX[8], maxY[8], maxZ[8];
+		uint32_t child[8]; // internal child: node index, leaf child: first block
+		uint32_t count[8]; // 0 for internal children, triangle count for leaves, WIDE_BVH_EMPTY for unused slots
+	};
+
+	struct alignas(32) TriangleBlock {
+		float v0x[8], v0y[8], v0z[8];
+		float edge1x[8], edge1y[8], edge1z[8];
+		float edge2x[8], edge2y[8], edge2z[8];
+		uint32_t triangle[8]; // padding lanes have zero edges, which the determinant test rejects
+	};
+
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 invDirection;
+		float minimumT;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<TriangleBlock> blocks;
+	glm::vec3 rootMin = glm::vec3(0.0f); // rays missing the root box skip the 8-wide tests
+	glm::vec3 rootMax = glm::vec3(0.0f);
+
+	template<typename Kernels>
+	bool traverse(const Ray& ray, float& t, uint32_t& triangle) const;
+
+#if SIMD_BVH_X86
+	struct SSE4Kernels {
+		SIMD_TARGET_SSE4 static unsigned intersectNode(const Node& node, const Ray& ray, float tMax, float* tnear);
+		SIMD_TARGET_SSE4 static bool intersectLeaf(const TriangleBlock* leaf, uint32_t count, const Ray& ray,
+			float& t, uint32_t& triangle);
+	};
+	struct AVX2Kernels {
+		SIMD_TARGET_AVX2 static unsigned intersectNode(const Node& node, const Ray& ray, float tMax, float* tnear);
+		SIMD_TARGET_AVX2 static bool intersectLeaf(const TriangleBlock* leaf, uint32_t count, const Ray& ray,
+			float& t, uint32_t& triangle);
+	};
+#endif
+
+	static int lowestBit(unsigned mask);
+};
+
+// Implementation
+inline const char* simdLevelName(SIMDLevel level) {
+	switch (level) {
+	case SIMDLevel::SSE4: return "SSE4";
+	case SIMDLevel::AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+inline SIMDLevel detectSIMDLevel() {
+	static const SIMDLevel level = [] {
+#if SIMD_BVH_X86 && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool osSavesAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osSavesAVX) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+		return avx2 ? SIMDLevel::AVX2 : sse41 ? SIMDLevel::SSE4 : SIMDLevel::Scalar;
+#elif SIMD_BVH_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return SIMDLevel::AVX2;
+		if (__builtin_cpu_supports("sse4.1")) return SIMDLevel::SSE4;
+		return SIMDLevel::Scalar;
+#else
+		return SIMDLevel::Scalar;
+#endif
+	}();
+	return level;
+}
+
+inline void SIMDBVH::clear() {
+	nodes.clear();
+	blocks.clear();
+}
+
+inline void SIMDBVH::build(const std::vector<BVHNode>& binaryNodes, const std::vector<CPUTriangle>& triangles) {
+	clear();
+	if (binaryNodes.empty()) return;
+
+	rootMin = glm::vec3(binaryNodes[0].minBounds[0], binaryNodes[0].minBounds[1], binaryNodes[0].minBounds[2]);
+	rootMax = glm::vec3(binaryNodes[0].maxBounds[0], binaryNodes[0].maxBounds[1], binaryNodes[0].maxBounds[2]);
+
+	WideBVH wide;
+	wide.build(binaryNodes, 8);
+	const std::vector<WideBVHPacket>& packets = wide.getPackets();
+
+	nodes.resize(wide.getNodeCount());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		Node& node = nodes[i];
+		for (int slot = 0; slot < 8; slot++) {
+			const WideBVHPacket& packet = packets[i * 2 + slot / 4];
+			int lane = slot % 4;
+			node.child[slot] = packet.child[lane];
+			node.count[slot] = packet.count[lane];
+
+			// Unused slots get a box at infinity, which no ray enters
+			bool unused = packet.count[lane] == WIDE_BVH_EMPTY;
+			node.minX[slot] = unused ? INFINITY : packet.minX[lane];
+			node.minY[slot] = unused ? INFINITY : packet.minY[lane];
+			node.minZ[slot] = unused ? INFINITY : packet.minZ[lane];
+			node.maxX[slot] = unused ? INFINITY : packet.maxX[lane];
+			node.maxY[slot] = unused ? INFINITY : packet.maxY[lane];
+			node.maxZ[slot] = unused ? INFINITY : packet.maxZ[lane];
+
+			if (unused || packet.count[lane] == 0) continue;
+
+			// Leaf: its triangles go into their own blocks, padding lanes stay zero
+			uint32_t first = packet.child[lane];
+			uint32_t count = packet.count[lane];
+			node.child[slot] = (uint32_t)blocks.size();
+			blocks.resize(blocks.size() + (count + 7) / 8, TriangleBlock());
+			for (uint32_t k = 0; k < count; k++) {
+				TriangleBlock& block = blocks[node.child[slot] + k / 8];
+				uint32_t blockLane = k % 8;
+				uint32_t index = first + k;
+				if (index >= triangles.size()) break;
+				const CPUTriangle& tri = triangles[index];
+				block.v0x[blockLane] = tri.v0.x;
+				block.v0y[blockLane] = tri.v0.y;
+				block.v0z[blockLane] = tri.v0.z;
+				block.edge1x[blockLane] = tri.edge1.x;
+				block.edge1y[blockLane] = tri.edge1.y;
+				block.edge1z[blockLane] = tri.edge1.z;
+				block.edge2x[blockLane] = tri.edge2.x;
+				block.edge2y[blockLane] = tri.edge2.y;
+				block.edge2z[blockLane] = tri.edge2.z;
+				block.triangle[blockLane] = index;
+			}
+		}
+	}
+}
+
+inline int SIMDBVH::lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+inline bool SIMDBVH::intersect(SIMDLevel level, const glm::vec3& origin, const glm::vec3& direction, float minimumT,
+	float tMax, float& t, uint32_t& triangle) const {
+	if (nodes.empty()) return false;
+
+	Ray ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	ray.invDirection = 1.0f / direction;
+	ray.minimumT = minimumT;
+
+	glm::vec3 t0 = (rootMin - origin) * ray.invDirection;
+	glm::vec3 t1 = (rootMax - origin) * ray.invDirection;
+	glm::vec3 tmin = glm::min(t0, t1);
+	glm::vec3 tmax = glm::max(t0, t1);
+	float entry = std::max(std::max(tmin.x, tmin.y), tmin.z);
+	float exit = std::min(std::min(tmax.x, tmax.y), tmax.z);
+	if (!(entry <= exit && exit > 0.0f && entry < tMax)) return false;
+
+	float closest = tMax;
+	bool hit = false;
+#if SIMD_BVH_X86
+	if (level == SIMDLevel::AVX2) hit = traverse<AVX2Kernels>(ray, closest, triangle);
+	else hit = traverse<SSE4Kernels>(ray, closest, triangle);
+#endif
+	if (hit) t = closest;
+	return hit;
+}
+
+template<typename Kernels>
+bool SIMDBVH::traverse(const Ray& ray, float& t, uint32_t& triangle) const {
+	// Entry distance is kept so nodes behind a closer hit found later are skipped
+	uint32_t stack[STACK_SIZE];
+	float stackDist[STACK_SIZE];
+	int stackPtr = 0;
+	stack[stackPtr] = 0;
+	stackDist[stackPtr++] = -INFINITY;
+
+	bool hit = false;
+	while (stackPtr > 0) {
+		--stackPtr;
+		if (stackDist[stackPtr] >= t) continue;
+		const Node& node = nodes[stack[stackPtr]];
+
+		alignas(32) float tnear[8];
+		unsigned mask = Kernels::intersectNode(node, ray, t, tnear);
+
+		// Leaves are tested right away, internal children are pushed far to near
+		uint32_t hitChild[8];
+		float hitDist[8];
+		int hitCount = 0;
+		while (mask != 0) {
+			int slot = lowestBit(mask);
+			mask &= mask - 1;
+
+			uint32_t count = node.count[slot];
+			if (count == WIDE_BVH_EMPTY) continue;
+			if (count > 0) {
+				if (Kernels::intersectLeaf(&blocks[node.child[slot]], count, ray, t, triangle)) hit = true;
+				continue;
+			}
+
+			int position = hitCount++;
+			while (position > 0 && hitDist[position - 1] < tnear[slot]) {
+				hitChild[position] = hitChild[position - 1];
+				hitDist[position] = hitDist[position - 1];
+				position--;
+			}
+			hitChild[position] = node.child[slot];
+			hitDist[position] = tnear[slot];
+		}
+
+		// Farthest first, so the nearest is popped next; a full stack drops the farthest
+		for (int i = std::max(hitCount - (STACK_SIZE - stackPtr), 0); i < hitCount; i++) {
+			stack[stackPtr] = hitChild[i];
+			stackDist[stackPtr++] = hitDist[i];
+		}
+	}
+	return hit;
+}
+
+#if SIMD_BVH_X86
+// Slab test in the kernel's order: tmin = min(t1, t0) picks t0 on ties and NaNs like glm::min
+SIMD_TARGET_SSE4 inline unsigned SIMDBVH::SSE4Kernels::intersectNode(const Node& node, const Ray& ray, float tMax,
+	float* tnear) {
+	__m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+	__m128 ix = _mm_set1_ps(ray.invDirection.x), iy = _mm_set1_ps(ray.invDirection.y), iz = _mm_set1_ps(ray.invDirection.z);
+	__m128 limit = _mm_set1_ps(tMax);
+	__m128 zero = _mm_setzero_ps();
+
+	unsigned mask = 0;
+	for (int half = 0; half < 8; half += 4) {
+		__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX + half), ox), ix);
+		__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY + half), oy), iy);
+		__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ + half), oz), iz);
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX + half), ox), ix);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY + half), oy), iy);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ + half), oz), iz);
+
+		__m128 entry = _mm_max_ps(_mm_min_ps(t1z, t0z), _mm_max_ps(_mm_min_ps(t1y, t0y), _mm_min_ps(t1x, t0x)));
+		__m128 exit = _mm_min_ps(_mm_max_ps(t1z, t0z), _mm_min_ps(_mm_max_ps(t1y, t0y), _mm_max_ps(t1x, t0x)));
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(entry, exit), _mm_cmpgt_ps(exit, zero)), _mm_cmplt_ps(entry, limit));
+
+		_mm_store_ps(tnear + half, entry);
+		mask |= (unsigned)_mm_movemask_ps(inside) << half;
+	}
+	return mask;
+}
+
+// Moller-Trumbore in the order of objTriangleIntersect, 4 triangles per step
+SIMD_TARGET_SSE4 inline bool SIMDBVH::SSE4Kernels::intersectLeaf(const TriangleBlock* leaf, uint32_t count, const Ray& ray,
+	float& t, uint32_t& triangle) {
+	__m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+	__m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	__m128 epsilon = _mm_set1_ps(0.00001f), negativeEpsilon = _mm_set1_ps(-0.00001f);
+	__m128 minimumDist = _mm_set1_ps(0.000001f), minimumT = _mm_set1_ps(ray.minimumT);
+
+	bool hit = false;
+	for (uint32_t first = 0; first < count; first += 4) {
+		const TriangleBlock& block = leaf[first / 8];
+		int lane = first % 8;
+
+		__m128 e1x = _mm_load_ps(block.edge1x + lane), e1y = _mm_load_ps(block.edge1y + lane), e1z = _mm_load_ps(block.edge1z + lane);
+		__m128 e2x = _mm_load_ps(block.edge2x + lane), e2y = _mm_load_ps(block.edge2y + lane), e2z = _mm_load_ps(block.edge2z + lane);
+
+		__m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+		__m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+		__m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+		__m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+		__m128 parallel = _mm_and_ps(_mm_cmpgt_ps(a, negativeEpsilon), _mm_cmplt_ps(a, epsilon));
+
+		__m128 f = _mm_div_ps(one, a);
+		__m128 sx = _mm_sub_ps(ox, _mm_load_ps(block.v0x + lane));
+		__m128 sy = _mm_sub_ps(oy, _mm_load_ps(block.v0y + lane));
+		__m128 sz = _mm_sub_ps(oz, _mm_load_ps(block.v0z + lane));
+		__m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(e1y, sz));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(e1z, sx));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(e1x, sy));
+		__m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+		__m128 dist = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+		// Rejections are negated comparisons, so NaNs pass them as in the scalar code
+		__m128 rejected = _mm_or_ps(parallel, _mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmpgt_ps(u, one)));
+		rejected = _mm_or_ps(rejected, _mm_or_ps(_mm_cmplt_ps(v, zero), _mm_cmpgt_ps(_mm_add_ps(u, v), one)));
+		__m128 accepted = _mm_and_ps(_mm_cmpgt_ps(dist, minimumDist), _mm_cmpgt_ps(dist, minimumT));
+		accepted = _mm_andnot_ps(rejected, accepted);
+
+		unsigned mask = (unsigned)_mm_movemask_ps(accepted);
+		if (mask == 0) continue;
+
+		// Lane order with a strict less than, the first of equal hits wins like in the scalar loop
+		alignas(16) float lanes[4];
+		_mm_store_ps(lanes, dist);
+		while (mask != 0) {
+			int i = lowestBit(mask);
+			mask &= mask - 1;
+			if (lanes[i] < t) {
+				t = lanes[i];
+				triangle = block.triangle[lane + i];
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+
+SIMD_TARGET_AVX2 inline unsigned SIMDBVH::AVX2Kernels::intersectNode(const Node& node, const Ray& ray, float tMax,
+	float* tnear) {
+	__m256 ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y), oz = _mm256_set1_ps(ray.origin.z);
+	__m256 ix = _mm256_set1_ps(ray.invDirection.x), iy = _mm256_set1_ps(ray.invDirection.y), iz = _mm256_set1_ps(ray.invDirection.z);
+
+	__m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), ox), ix);
+	__m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), oy), iy);
+	__m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), oz), iz);
+	__m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), ox), ix);
+	__m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), oy), iy);
+	__m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), oz), iz);
+
+	__m256 entry = _mm256_max_ps(_mm256_min_ps(t1z, t0z), _mm256_max_ps(_mm256_min_ps(t1y, t0y), _mm256_min_ps(t1x, t0x)));
+	__m256 exit = _mm256_min_ps(_mm256_max_ps(t1z, t0z), _mm256_min_ps(_mm256_max_ps(t1y, t0y), _mm256_max_ps(t1x, t0x)));
+	__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ),
+		_mm256_cmp_ps(exit, _mm256_setzero_ps(), _CMP_GT_OQ)), _mm256_cmp_ps(entry, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+	_mm256_store_ps(tnear, entry);
+	return (unsigned)_mm256_movemask_ps(inside);
+}
+
+// Moller-Trumbore in the order of objTriangleIntersect, a block of 8 triangles per step.
+// No FMA: fused products would round differently from the scalar code.
+SIMD_TARGET_AVX2 inline bool SIMDBVH::AVX2Kernels::intersectLeaf(const TriangleBlock* leaf, uint32_t count, const Ray& ray,
+	float& t, uint32_t& triangle) {
+	__m256 dx = _mm256_set1_ps(ray.direction.x), dy = _mm256_set1_ps(ray.direction.y), dz = _mm256_set1_ps(ray.direction.z);
+	__m256 ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y), oz = _mm256_set1_ps(ray.origin.z);
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	__m256 epsilon = _mm256_set1_ps(0.00001f), negativeEpsilon = _mm256_set1_ps(-0.00001f);
+	__m256 minimumDist = _mm256_set1_ps(0.000001f), minimumT = _mm256_set1_ps(ray.minimumT);
+
+	bool hit = false;
+	for (uint32_t first = 0; first < count; first += 8) {
+		const TriangleBlock& block = leaf[first / 8];
+
+		__m256 e1x = _mm256_load_ps(block.edge1x), e1y = _mm256_load_ps(block.edge1y), e1z = _mm256_load_ps(block.edge1z);
+		__m256 e2x = _mm256_load_ps(block.edge2x), e2y = _mm256_load_ps(block.edge2y), e2z = _mm256_load_ps(block.edge2z);
+
+		__m256 hx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+		__m256 hy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+		__m256 hz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+		__m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, hx), _mm256_mul_ps(e1y, hy)), _mm256_mul_ps(e1z, hz));
+		__m256 parallel = _mm256_and_ps(_mm256_cmp_ps(a, negativeEpsilon, _CMP_GT_OQ), _mm256_cmp_ps(a, epsilon, _CMP_LT_OQ));
+
+		__m256 f = _mm256_div_ps(one, a);
+		__m256 sx = _mm256_sub_ps(ox, _mm256_load_ps(block.v0x));
+		__m256 sy = _mm256_sub_ps(oy, _mm256_load_ps(block.v0y));
+		__m256 sz = _mm256_sub_ps(oz, _mm256_load_ps(block.v0z));
+		__m256 u = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, hx), _mm256_mul_ps(sy, hy)), _mm256_mul_ps(sz, hz)));
+
+		__m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(e1y, sz));
+		__m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(e1z, sx));
+		__m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(e1x, sy));
+		__m256 v = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+		__m256 dist = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)));
+
+		__m256 rejected = _mm256_or_ps(parallel, _mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(u, one, _CMP_GT_OQ)));
+		rejected = _mm256_or_ps(rejected, _mm256_or_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ),
+			_mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_GT_OQ)));
+		__m256 accepted = _mm256_and_ps(_mm256_cmp_ps(dist, minimumDist, _CMP_GT_OQ), _mm256_cmp_ps(dist, minimumT, _CMP_GT_OQ));
+		accepted = _mm256_andnot_ps(rejected, accepted);
+
+		unsigned mask = (unsigned)_mm256_movemask_ps(accepted);
+		if (mask == 0) continue;
+
+		alignas(32) float lanes[8];
+		_mm256_store_ps(lanes, dist);
+		while (mask != 0) {
+			int i = lowestBit(mask);
+			mask &= mask - 1;
+			if (lanes[i] < t) {
+				t = lanes[i];
+				triangle = block.triangle[i];
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+#endif
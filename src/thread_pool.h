@@ -0,0 +1,219 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+
+// Work-stealing thread pool used by the CPU side builders and renderers.
+// Every worker owns a deque: it pushes and pops its own work at the back
+// and, when empty, steals from the front of the other workers' deques.
+// Threads waiting on a TaskGroup help execute queued work, so nested
+// fork/join recursion cannot deadlock.
+class ThreadPool {
+public:
+	// threadCount == 0 uses one worker per hardware thread
+	explicit ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned getThreadCount() const { return (unsigned)workers.size(); }
+
+	// Queue a task. From a worker it goes to that worker's own deque,
+	// from any other thread it is spread round robin.
+	void submit(std::function<void()> task);
+
+	// Run one queued task on the calling thread, returns false if none was found
+	bool runPendingTask();
+
+	// Index of the calling worker in this pool, or -1 for foreign threads
+	int currentWorkerIndex() const;
+
+	// Calls fn(rangeBegin, rangeEnd) over [begin, end) split into chunks of at most grainSize
+	template<typename Function>
+	void parallelFor(size_t begin, size_t end, size_t grainSize, Function&& fn);
+
+	static unsigned hardwareThreads() {
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+private:
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::atomic<bool> stopping{ false };
+	std::atomic<size_t> queuedTasks{ 0 };
+	std::atomic<unsigned> nextQueue{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	bool popTask(int self, std::function<void()>& task);
+	void workerLoop(unsigned index);
+};
+
+// Fork/join helper: tasks started through run() are guaranteed to be
+// finished when wait() returns. A null pool runs everything inline.
+class TaskGroup {
+public:
+	explicit TaskGroup(ThreadPool* pool) : pool(pool) {}
+	~TaskGroup() { wait(); }
+
+	template<typename Function>
+	void run(Function&& fn);
+
+	void wait();
+
+private:
+	ThreadPool* pool;
+	std::atomic<int> pending{ 0 };
+};
+
+// Implementation
+namespace ThreadPoolDetail {
+	inline thread_local const ThreadPool* currentPool = nullptr;
+	inline thread_local int currentIndex = -1;
+}
+
+inline ThreadPool::ThreadPool(unsigned threadCount) {
+	if (threadCount == 0) threadCount = hardwareThreads();
+
+	for (unsigned i = 0; i < threadCount; i++) {
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	for (unsigned i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+inline ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+inline int ThreadPool::currentWorkerIndex() const {
+	return ThreadPoolDetail::currentPool == this ? ThreadPoolDetail::currentIndex : -1;
+}
+
+inline void ThreadPool::submit(std::function<void()> task) {
+	int self = currentWorkerIndex();
+	unsigned target = self >= 0 ? (unsigned)self : nextQueue++ % (unsigned)queues.size();
+	{
+		std::lock_guard<std::mutex> lock(queues[target]->mutex);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	queuedTasks++;
+
+	// Taking the sleep mutex orders this notify after a worker's predicate check
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+inline bool ThreadPool::popTask(int self, std::function<void()>& task) {
+	unsigned count = (unsigned)queues.size();
+
+	// Own queue first, newest task (best cache locality)
+	if (self >= 0) {
+		WorkerQueue& own = *queues[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			queuedTasks--;
+			return true;
+		}
+	}
+
+	// Steal the oldest task (usually the biggest subtree) from someone else
+	unsigned start = self >= 0 ? (unsigned)self + 1 : nextQueue.load();
+	for (unsigned i = 0; i < count; i++) {
+		WorkerQueue& victim = *queues[(start + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			queuedTasks--;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool ThreadPool::runPendingTask() {
+	std::function<void()> task;
+	if (!popTask(currentWorkerIndex(), task)) return false;
+	task();
+	return true;
+}
+
+inline void ThreadPool::workerLoop(unsigned index) {
+	ThreadPoolDetail::currentPool = this;
+	ThreadPoolDetail::currentIndex = (int)index;
+
+	std::function<void()> task;
+	while (true) {
+		if (popTask((int)index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return stopping || queuedTasks > 0; });
+		if (stopping && queuedTasks == 0) break;
+	}
+}
+
+template<typename Function>
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grainSize, Function&& fn) {
+	if (begin >= end) return;
+	grainSize = std::max<size_t>(1, grainSize);
+
+	TaskGroup group(this);
+	for (size_t chunk = begin; chunk < end; chunk += grainSize) {
+		size_t chunkEnd = std::min(end, chunk + grainSize);
+		group.run([&fn, chunk, chunkEnd] { fn(chunk, chunkEnd); });
+	}
+	group.wait();
+}
+
+template<typename Function>
+void TaskGroup::run(Function&& fn) {
+	if (!pool) {
+		fn();
+		return;
+	}
+
+	pending++;
+	pool->submit([this, fn = std::forward<Function>(fn)]() mutable {
+		fn();
+		pending--;
+	});
+}
+
+inline void TaskGroup::wait() {
+	while (pending > 0) {
+		if (!pool || !pool->runPendingTask()) {
+			std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,367 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "thread_pool.h"
+
+// Order the tiles are dealt out in
+enum class TileOrder {
+	Scanline, // rows, bottom to top
+	Morton,   // Z curve, tiles that run close in time are close on screen
+	Spiral    // square rings from the centre outwards, the centre of the image finishes first
+};
+
+inline const char* tileOrderName(TileOrder order) {
+	switch (order) {
+	case TileOrder::Scanline: return "scanline";
+	case TileOrder::Morton: return "Morton";
+	default: return "spiral";
+	}
+}
+
+// Splits an image into square tiles and runs them on a ThreadPool. The ordered tiles are
+// dealt round robin into one deque per worker slot; a slot takes its next tile from the
+// front of its own deque and, once that is empty, steals from the back of the others.
+// A static split leaves the threads that drew the mesh running long after the ones that
+// drew the sky, stealing keeps all of them busy until the last tiles. Every tile is timed,
+// and finished tiles can be collected while a run is still going.
+class TileScheduler {
+public:
+	struct Tile {
+		int x0 = 0, y0 = 0, x1 = 0, y1 = 0; // pixel rectangle [x0, x1) x [y0, y1)
+	};
+
+	struct TileTiming {
+		Tile tile;
+		float milliseconds = 0.0f;
+		uint16_t worker = 0; // slot that ran the tile
+		bool stolen = false; // taken from another slot's deque
+	};
+
+	struct WorkerSummary {
+		double busyMs = 0.0;
+		uint32_t tiles = 0;
+		uint32_t steals = 0;
+	};
+
+	struct Summary {
+		double wallMs = 0.0;
+		double minTileMs = 0.0;
+		double meanTileMs = 0.0;
+		double maxTileMs = 0.0;
+		uint32_t tiles = 0;
+		uint32_t steals = 0;
+		std::vector<WorkerSummary> workers;
+
+		// Busiest worker over the mean busy time, 1 is a perfect balance
+		double imbalance() const;
+	};
+
+	void setTileSize(int size) { tileSize = std::max(1, size); }
+	int getTileSize() const { return tileSize; }
+	void setOrder(TileOrder tileOrder) { order = tileOrder; }
+	TileOrder getOrder() const { return order; }
+	// Without stealing every slot only runs the tiles it was dealt, a static split to compare against
+	void setStealing(bool enabled) { stealing = enabled; }
+	bool getStealing() const { return stealing; }
+
+	// Ordered tiles of a width x height image, rebuilt only when something changed
+	void setup(int width, int height);
+	const std::vector<Tile>& getTiles() const { return tiles; }
+
+	// Calls fn(tile) once for every tile, on the pool's workers or inline for a null pool.
+	// Raising cancel skips the tiles not started yet and makes run return false.
+	template<typename Function>
+	bool run(ThreadPool* pool, Function&& fn, const std::atomic<bool>* cancel = nullptr);
+
+	// Appends the tiles finished since the last call, safe to call during a run
+	void takeFinished(std::vector<Tile>& finishedTiles);
+
+	// Of the last run that was not cancelled, timings in the order of getTiles()
+	std::vector<TileTiming> getTimings() const;
+	Summary getSummary() const;
+
+	void printReport() const;
+	// tile,x,y,width,height,worker,stolen,ms per line
+	bool exportCSV(const std::string& filename) const;
+
+private:
+	struct SlotQueue {
+		std::mutex mutex;
+		std::deque<uint32_t> tiles;
+	};
+
+	int tileSize = 16;
+	TileOrder order = TileOrder::Spiral;
+	bool stealing = true;
+
+	int imageWidth = 0;
+	int imageHeight = 0;
+	int builtTileSize = 0;
+	TileOrder builtOrder = TileOrder::Spiral;
+	std::vector<Tile> tiles;
+
+	std::vector<std::unique_ptr<SlotQueue>> queues;
+
+	std::mutex finishedMutex;
+	std::vector<Tile> finished;
+
+	mutable std::mutex resultMutex;
+	std::vector<TileTiming> lastTimings;
+	Summary lastSummary;
+
+	bool nextTile(unsigned slot, uint32_t& tile, bool& stolen);
+	static Summary summarize(const std::vector<TileTiming>& timings, unsigned slotCount, double wallMs);
+	static uint32_t mortonCode(uint32_t x, uint32_t y);
+};
+
+// Implementation
+inline double TileScheduler::Summary::imbalance() const {
+	double total = 0.0, busiest = 0.0;
+	for (const WorkerSummary& worker : workers) {
+		total += worker.busyMs;
+		busiest = std::max(busiest, worker.busyMs);
+	}
+	return total > 0.0 ? busiest * (double)workers.size() / total : 1.0;
+}
+
+inline uint32_t TileScheduler::mortonCode(uint32_t x, uint32_t y) {
+	auto spread = [](uint32_t v) {
+		v &= 0xFFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	};
+	return spread(x) | (spread(y) << 1);
+}
+
+inline void TileScheduler::setup(int width, int height) {
+	if (width == imageWidth && height == imageHeight && tileSize == builtTileSize && order == builtOrder) return;
+	imageWidth = width;
+	imageHeight = height;
+	builtTileSize = tileSize;
+	builtOrder = order;
+
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+
+	// Sort keys: Morton code, or spiral ring then the angle around the centre
+	struct Keyed {
+		uint32_t primary;
+		float secondary;
+		Tile tile;
+	};
+	std::vector<Keyed> keyed;
+	keyed.reserve((size_t)tilesX * tilesY);
+	float centerX = (tilesX - 1) * 0.5f;
+	float centerY = (tilesY - 1) * 0.5f;
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < tilesX; tx++) {
+			Keyed entry;
+			entry.tile.x0 = tx * tileSize;
+			entry.tile.y0 = ty * tileSize;
+			entry.tile.x1 = std::min(entry.tile.x0 + tileSize, width);
+			entry.tile.y1 = std::min(entry.tile.y0 + tileSize, height);
+
+			float dx = tx - centerX;
+			float dy = ty - centerY;
+			switch (order) {
+			case TileOrder::Scanline:
+				entry.primary = (uint32_t)(ty * tilesX + tx);
+				entry.secondary = 0.0f;
+				break;
+			case TileOrder::Morton:
+				entry.primary = mortonCode((uint32_t)tx, (uint32_t)ty);
+				entry.secondary = 0.0f;
+				break;
+			case TileOrder::Spiral:
+				entry.primary = (uint32_t)(std::max(std::abs(dx), std::abs(dy)) + 0.5f);
+				entry.secondary = std::atan2(dy, dx);
+				break;
+			}
+			keyed.push_back(entry);
+		}
+	}
+	std::stable_sort(keyed.begin(), keyed.end(), [](const Keyed& a, const Keyed& b) {
+		return a.primary != b.primary ? a.primary < b.primary : a.secondary < b.secondary;
+	});
+
+	tiles.resize(keyed.size());
+	for (size_t i = 0; i < keyed.size(); i++) tiles[i] = keyed[i].tile;
+}
+
+inline bool TileScheduler::nextTile(unsigned slot, uint32_t& tile, bool& stolen) {
+	unsigned count = (unsigned)queues.size();
+
+	// Own deque from the front, the next tile in order
+	{
+		SlotQueue& own = *queues[slot];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tiles.empty()) {
+			tile = own.tiles.front();
+			own.tiles.pop_front();
+			stolen = false;
+			return true;
+		}
+	}
+	if (!stealing) return false;
+
+	// Steal from the back, the tile the victim would have reached last
+	for (unsigned i = 1; i < count; i++) {
+		SlotQueue& victim = *queues[(slot + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tiles.empty()) {
+			tile = victim.tiles.back();
+			victim.tiles.pop_back();
+			stolen = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+template<typename Function>
+bool TileScheduler::run(ThreadPool* pool, Function&& fn, const std::atomic<bool>* cancel) {
+	using Clock = std::chrono::high_resolution_clock;
+	Clock::time_point start = Clock::now();
+
+	unsigned slotCount = pool ? pool->getThreadCount() : 1;
+	slotCount = std::max(1u, std::min(slotCount, (unsigned)tiles.size()));
+	queues.clear();
+	for (unsigned slot = 0; slot < slotCount; slot++) {
+		queues.push_back(std::make_unique<SlotQueue>());
+	}
+	for (uint32_t i = 0; i < (uint32_t)tiles.size(); i++) {
+		queues[i % slotCount]->tiles.push_back(i);
+	}
+	{
+		std::lock_guard<std::mutex> lock(finishedMutex);
+		finished.clear();
+	}
+
+	std::vector<TileTiming> timings(tiles.size());
+	std::atomic<bool> cancelled{ false };
+	auto work = [&](unsigned slot) {
+		uint32_t index;
+		bool stolen;
+		while (nextTile(slot, index, stolen)) {
+			if (cancel && cancel->load()) {
+				cancelled = true;
+				return;
+			}
+			Clock::time_point tileStart = Clock::now();
+			fn(tiles[index]);
+
+			TileTiming& timing = timings[index];
+			timing.tile = tiles[index];
+			timing.milliseconds = std::chrono::duration<float, std::milli>(Clock::now() - tileStart).count();
+			timing.worker = (uint16_t)slot;
+			timing.stolen = stolen;
+
+			std::lock_guard<std::mutex> lock(finishedMutex);
+			finished.push_back(tiles[index]);
+		}
+	};
+
+	// One task per slot; the calling thread may run one of them while it waits
+	if (pool && slotCount > 1) {
+		TaskGroup group(pool);
+		for (unsigned slot = 0; slot < slotCount; slot++) {
+			group.run([&work, slot] { work(slot); });
+		}
+		group.wait();
+	}
+	else {
+		work(0);
+	}
+	if (cancelled) return false;
+
+	double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	Summary summary = summarize(timings, slotCount, wallMs);
+	std::lock_guard<std::mutex> lock(resultMutex);
+	lastTimings = std::move(timings);
+	lastSummary = std::move(summary);
+	return true;
+}
+
+inline void TileScheduler::takeFinished(std::vector<Tile>& finishedTiles) {
+	std::lock_guard<std::mutex> lock(finishedMutex);
+	finishedTiles.insert(finishedTiles.end(), finished.begin(), finished.end());
+	finished.clear();
+}
+
+inline std::vector<TileScheduler::TileTiming> TileScheduler::getTimings() const {
+	std::lock_guard<std::mutex> lock(resultMutex);
+	return lastTimings;
+}
+
+inline TileScheduler::Summary TileScheduler::getSummary() const {
+	std::lock_guard<std::mutex> lock(resultMutex);
+	return lastSummary;
+}
+
+inline TileScheduler::Summary TileScheduler::summarize(const std::vector<TileTiming>& timings, unsigned slotCount,
+	double wallMs) {
+	Summary summary;
+	summary.wallMs = wallMs;
+	summary.workers.resize(slotCount);
+	if (timings.empty()) return summary;
+
+	double total = 0.0;
+	summary.minTileMs = timings[0].milliseconds;
+	for (const TileTiming& timing : timings) {
+		WorkerSummary& worker = summary.workers[timing.worker];
+		worker.busyMs += timing.milliseconds;
+		worker.tiles++;
+		if (timing.stolen) {
+			worker.steals++;
+			summary.steals++;
+		}
+		total += timing.milliseconds;
+		summary.minTileMs = std::min(summary.minTileMs, (double)timing.milliseconds);
+		summary.maxTileMs = std::max(summary.maxTileMs, (double)timing.milliseconds);
+	}
+	summary.tiles = (uint32_t)timings.size();
+	summary.meanTileMs = total / (double)timings.size();
+	return summary;
+}
+
+inline void TileScheduler::printReport() const {
+	Summary summary = getSummary();
+	printf("Tile scheduler: %u %dx%d tiles, %s order, %s, %.1f ms\n", summary.tiles, builtTileSize, builtTileSize,
+		tileOrderName(builtOrder), stealing ? "work stealing" : "static split", summary.wallMs);
+	printf("  tile ms: min %.3f, mean %.3f, max %.3f\n", summary.minTileMs, summary.meanTileMs, summary.maxTileMs);
+	for (size_t i = 0; i < summary.workers.size(); i++) {
+		const WorkerSummary& worker = summary.workers[i];
+		printf("  worker %2zu: busy %8.1f ms, %5u tiles, %4u stolen\n", i, worker.busyMs, worker.tiles, worker.steals);
+	}
+	printf("  %u steals, imbalance %.3f (busiest worker / mean)\n", summary.steals, summary.imbalance());
+}
+
+inline bool TileScheduler::exportCSV(const std::string& filename) const {
+	std::ofstream out(filename, std::ios::trunc);
+	if (!out) return false;
+
+	out << "tile,x,y,width,height,worker,stolen,ms\n";
+	std::vector<TileTiming> timings = getTimings();
+	for (size_t i = 0; i < timings.size(); i++) {
+		const TileTiming& timing = timings[i];
+		out << i << "," << timing.tile.x0 << "," << timing.tile.y0 << "," << timing.tile.x1 - timing.tile.x0 << ","
+			<< timing.tile.y1 - timing.tile.y0 << "," << timing.worker << "," << (timing.stolen ? 1 : 0) << ","
+			<< timing.milliseconds << "\n";
+	}
+	out.close();
+	return !out.fail();
+}
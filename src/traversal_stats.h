@@ -0,0 +1,188 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstring>
+
+// Storage buffer binding of TraversalStatsBuffer in pathtracing_compute.glsl
+const GLuint TRAVERSAL_STATS_BINDING = 18;
+// Image unit the stats kernel writes its heatmap to
+const GLuint TRAVERSAL_STATS_IMAGE_UNIT = 1;
+const int TRAVERSAL_STATS_BUCKETS = 32;
+
+// Counters written by a TRAVERSAL_STATS kernel, std430 (must match TraversalStatsBuffer in GLSL).
+// Histogram bucket 0 counts rays with no node visits (triangle tests), bucket k rays with
+// [2^(k-1), 2^k) of them
+struct TraversalCounters {
+	uint32_t rays;
+	uint32_t nodeVisits;
+	uint32_t leafTests;
+	uint32_t triangleTests;
+	uint32_t stackDrops;
+	uint32_t padding[3];
+	uint32_t nodeHistogram[TRAVERSAL_STATS_BUCKETS];
+	uint32_t triangleHistogram[TRAVERSAL_STATS_BUCKETS];
+};
+static_assert(sizeof(TraversalCounters) == 288, "TraversalCounters must match the std430 block");
+
+// Counters summed over one or more frames
+struct TraversalReport {
+	uint64_t frames = 0;
+	uint64_t rays = 0;
+	uint64_t nodeVisits = 0;
+	uint64_t leafTests = 0;
+	uint64_t triangleTests = 0;
+	uint64_t stackDrops = 0;
+	uint64_t nodeHistogram[TRAVERSAL_STATS_BUCKETS] = {};
+	uint64_t triangleHistogram[TRAVERSAL_STATS_BUCKETS] = {};
+
+	void add(const TraversalCounters& counters, uint64_t frameCount);
+	void add(const TraversalReport& report);
+
+	double perRay(uint64_t count) const { return rays > 0 ? (double)count / (double)rays : 0.0; }
+};
+
+// Owns the counter buffer of the stats kernel and reads it back without stalling: after each
+// frame the counters are copied into one of a few readback buffers behind a fence and cleared,
+// and copies whose fence has signaled are mapped on a later poll.
+class TraversalStats {
+public:
+	TraversalStats() = default;
+	~TraversalStats() {
+		cleanup();
+	}
+
+	TraversalStats(const TraversalStats&) = delete;
+	TraversalStats& operator=(const TraversalStats&) = delete;
+
+	// Binds the counter buffer at TRAVERSAL_STATS_BINDING, call before the dispatch
+	void bind();
+	// Queues the readback of the frame's counters, call after the dispatch
+	void endFrame();
+	// Collects finished readbacks, never waits on the GPU
+	void poll();
+
+	const TraversalReport& getLastReadback() const { return lastReadback; }
+	const TraversalReport& getTotals() const { return totals; }
+	void resetTotals() { totals = TraversalReport(); }
+
+	void cleanup();
+
+private:
+	static const int READBACK_COUNT = 3;
+
+	GLuint counterBuffer = 0;
+	GLuint readbackBuffers[READBACK_COUNT] = {};
+	GLsync fences[READBACK_COUNT] = {};
+	uint64_t readbackFrames[READBACK_COUNT] = {};
+	int next = 0;
+	uint64_t framesInCounters = 0; // frames summed in counterBuffer since it was last cleared
+
+	TraversalReport lastReadback;
+	TraversalReport totals;
+
+	void create();
+};
+
+// Implementation
+inline void TraversalReport::add(const TraversalCounters& counters, uint64_t frameCount) {
+	frames += frameCount;
+	rays += counters.rays;
+	nodeVisits += counters.nodeVisits;
+	leafTests += counters.leafTests;
+	triangleTests += counters.triangleTests;
+	stackDrops += counters.stackDrops;
+	for (int i = 0; i < TRAVERSAL_STATS_BUCKETS; i++) {
+		nodeHistogram[i] += counters.nodeHistogram[i];
+		triangleHistogram[i] += counters.triangleHistogram[i];
+	}
+}
+
+inline void TraversalReport::add(const TraversalReport& report) {
+	frames += report.frames;
+	rays += report.rays;
+	nodeVisits += report.nodeVisits;
+	leafTests += report.leafTests;
+	triangleTests += report.triangleTests;
+	stackDrops += report.stackDrops;
+	for (int i = 0; i < TRAVERSAL_STATS_BUCKETS; i++) {
+		nodeHistogram[i] += report.nodeHistogram[i];
+		triangleHistogram[i] += report.triangleHistogram[i];
+	}
+}
+
+inline void TraversalStats::create() {
+	glGenBuffers(1, &counterBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TraversalCounters), nullptr, GL_DYNAMIC_COPY);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	glGenBuffers(READBACK_COUNT, readbackBuffers);
+	for (int i = 0; i < READBACK_COUNT; i++) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(TraversalCounters), nullptr, GL_STREAM_READ);
+	}
+}
+
+inline void TraversalStats::bind() {
+	if (counterBuffer == 0) create();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRAVERSAL_STATS_BINDING, counterBuffer);
+}
+
+inline void TraversalStats::endFrame() {
+	if (counterBuffer == 0) return;
+	framesInCounters++;
+
+	// Every readback still in flight, the counters keep summing into the next frame
+	if (fences[next] != 0) return;
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, counterBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[next]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(TraversalCounters));
+	fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readbackFrames[next] = framesInCounters;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	framesInCounters = 0;
+
+	next = (next + 1) % READBACK_COUNT;
+}
+
+inline void TraversalStats::poll() {
+	// Oldest copy first, so the last readback is the most recent frame
+	for (int i = 0; i < READBACK_COUNT; i++) {
+		int slot = (next + i) % READBACK_COUNT;
+		if (fences[slot] == 0) continue;
+
+		GLenum status = glClientWaitSync(fences[slot], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+		glDeleteSync(fences[slot]);
+		fences[slot] = 0;
+
+		TraversalCounters counters;
+		glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffers[slot]);
+		void* mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, sizeof(TraversalCounters), GL_MAP_READ_BIT);
+		if (!mapped) continue;
+		memcpy(&counters, mapped, sizeof(counters));
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+		lastReadback = TraversalReport();
+		lastReadback.add(counters, readbackFrames[slot]);
+		totals.add(lastReadback);
+	}
+}
+
+inline void TraversalStats::cleanup() {
+	for (int i = 0; i < READBACK_COUNT; i++) {
+		if (fences[i] != 0) {
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+	if (counterBuffer != 0) {
+		glDeleteBuffers(1, &counterBuffer);
+		glDeleteBuffers(READBACK_COUNT, readbackBuffers);
+		counterBuffer = 0;
+	}
+}
@@ -3,9 +3,15 @@
 
 
 #include "./shader.h"//has GLAD and should be before glfw
+#include "./gpu_profiler.h"
+#include "./traversal_stats.h"
+#include "./cpu_viewport.h"
+#include "./wavefront_path_tracer.h"
+#include "./persistent_path_tracer.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <string>
+#include "./globals.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -68,6 +74,8 @@ namespace UI{
 	}
 
 	static void drawShaderUI(Shader &shader) {
+		ImGui::Text("GL calls last frame: %u", Shader::glCallsLastFrame);
+
 		for (auto &elements : shader.uniform_floats) {
 			if (ImGui::SliderFloat(elements.first.c_str(), &elements.second, -10.0f, 50.0f)) {
 				shader.uniform_floats["iFrame"] = 0.0f;
@@ -87,6 +95,190 @@ namespace UI{
 		}
 	}
 
+	static void drawProfilerUI(GPUProfiler &profiler, const std::string &tracePath) {
+		ImGui::Begin("GPU Profiler");
+
+		ImGui::Text("GPU frame: %.3f ms", profiler.frameMs());
+		ImGui::Text("Samples/s: %.2f M", profiler.samplesPerSecond() / 1.0e6);
+		ImGui::Text("Dropped results: %llu", (unsigned long long)profiler.droppedResults());
+
+		ImGui::Columns(5, "stages");
+		ImGui::Text("Stage"); ImGui::NextColumn();
+		ImGui::Text("avg ms"); ImGui::NextColumn();
+		ImGui::Text("p50 ms"); ImGui::NextColumn();
+		ImGui::Text("p99 ms"); ImGui::NextColumn();
+		ImGui::Text("last ms"); ImGui::NextColumn();
+		ImGui::Separator();
+		for (size_t i = 0; i < profiler.stageCount(); ++i) {
+			GPUProfiler::StageStats stats = profiler.stageStats(i);
+			ImGui::Text("%s", profiler.stageName(i).c_str()); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats.averageMs); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats.p50Ms); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats.p99Ms); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats.lastMs); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+		ImGui::Separator();
+
+		bool recording = profiler.isRecording();
+		if (ImGui::Checkbox("Record trace", &recording)) {
+			profiler.setRecording(recording);
+		}
+		ImGui::SameLine();
+		ImGui::Text("%zu frames", profiler.tracedFrames());
+		if (ImGui::Button("Export CSV")) {
+			if (profiler.exportCSV(tracePath))
+				std::cout << "Wrote GPU profile to " << tracePath << std::endl;
+			else
+				std::cout << "Could not write GPU profile to " << tracePath << std::endl;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear")) {
+			profiler.clearTrace();
+		}
+
+		ImGui::End();
+	}
+
+	static void drawTraversalHistogram(const char* label, const uint64_t (&histogram)[TRAVERSAL_STATS_BUCKETS]) {
+		// buckets past the last non-empty one are left out
+		float values[TRAVERSAL_STATS_BUCKETS];
+		int count = 1;
+		for (int i = 0; i < TRAVERSAL_STATS_BUCKETS; ++i) {
+			values[i] = (float)histogram[i];
+			if (histogram[i] != 0) count = i + 1;
+		}
+		ImGui::PlotHistogram(label, values, count, 0, "bucket k: [2^(k-1), 2^k)", 0.0f, FLT_MAX, ImVec2(0, 80));
+	}
+
+	static void drawTraversalStatsUI(TraversalStats &stats, GLuint heatmapTexture, Shader &pathtracingShader) {
+		ImGui::Begin("Traversal Stats");
+
+		const TraversalReport &last = stats.getLastReadback();
+		const TraversalReport &totals = stats.getTotals();
+
+		ImGui::Text("Last readback: %llu rays", (unsigned long long)last.rays);
+		ImGui::Text("Per ray: %.2f nodes, %.2f leaves, %.2f triangles",
+			last.perRay(last.nodeVisits), last.perRay(last.leafTests), last.perRay(last.triangleTests));
+		ImGui::Text("Stack overflow drops: %llu", (unsigned long long)last.stackDrops);
+		ImGui::Separator();
+
+		ImGui::Text("Totals: %llu frames, %llu rays", (unsigned long long)totals.frames, (unsigned long long)totals.rays);
+		ImGui::Text("Per ray: %.2f nodes, %.2f leaves, %.2f triangles",
+			totals.perRay(totals.nodeVisits), totals.perRay(totals.leafTests), totals.perRay(totals.triangleTests));
+		ImGui::Text("Stack overflow drops: %llu", (unsigned long long)totals.stackDrops);
+		if (ImGui::Button("Reset totals")) {
+			stats.resetTotals();
+		}
+
+		drawTraversalHistogram("Node visits", totals.nodeHistogram);
+		drawTraversalHistogram("Triangle tests", totals.triangleHistogram);
+		ImGui::Separator();
+
+		ImGui::Combo("Heatmap", &pathtracingShader.uniform_ints["stats_heatmap"], "Node visits\0Triangle tests\0");
+		ImGui::SliderInt("Heatmap max", &pathtracingShader.uniform_ints["stats_heatmap_max"], 1, 1024);
+		ImVec2 size = ImGui::GetContentRegionAvail();
+		ImGui::Image((void *)(intptr_t)heatmapTexture, size, ImVec2(0, 1), ImVec2(1, 0));
+
+		ImGui::End();
+	}
+
+	static void drawCPURendererUI(CPUViewport &viewport, bool &enabled, Shader &pathtracingShader) {
+		ImGui::Begin("CPU Renderer");
+
+		// both renderers accumulate into the same image, a switch starts it over
+		if (ImGui::Checkbox("Render on CPU", &enabled)) {
+			gLink::frame_count = 0.0;
+			pathtracingShader.uniform_floats["iFrame"] = 0.f;
+		}
+		const CPUPathTracer &tracer = viewport.getTracer();
+		ImGui::Text("%u threads, %s traversal", tracer.getThreadCount(), simdLevelName(tracer.getSIMDLevel()));
+		ImGui::Text("Frame %d, last frame %.1f ms", viewport.getFrame(), viewport.getLastFrameMs());
+		ImGui::Separator();
+
+		CPUViewport::TileSettings &settings = viewport.tileSettings;
+		int order = (int)settings.order;
+		if (ImGui::Combo("Tile order", &order, "Scanline\0Morton\0Spiral\0"))
+			settings.order = (TileOrder)order;
+		ImGui::RadioButton("16x16", &settings.tileSize, 16);
+		ImGui::SameLine();
+		ImGui::RadioButton("32x32", &settings.tileSize, 32);
+		ImGui::Checkbox("Work stealing", &settings.stealing);
+		ImGui::Separator();
+
+		TileScheduler::Summary summary = tracer.getTileScheduler().getSummary();
+		ImGui::Text("%u tiles, %u stolen, imbalance %.3f", summary.tiles, summary.steals, summary.imbalance());
+		ImGui::Text("Tile ms: min %.3f, mean %.3f, max %.3f", summary.minTileMs, summary.meanTileMs, summary.maxTileMs);
+
+		ImGui::Columns(4, "workers");
+		ImGui::Text("Worker"); ImGui::NextColumn();
+		ImGui::Text("busy ms"); ImGui::NextColumn();
+		ImGui::Text("tiles"); ImGui::NextColumn();
+		ImGui::Text("stolen"); ImGui::NextColumn();
+		ImGui::Separator();
+		for (size_t i = 0; i < summary.workers.size(); ++i) {
+			const TileScheduler::WorkerSummary &worker = summary.workers[i];
+			ImGui::Text("%zu", i); ImGui::NextColumn();
+			ImGui::Text("%.1f", worker.busyMs); ImGui::NextColumn();
+			ImGui::Text("%u", worker.tiles); ImGui::NextColumn();
+			ImGui::Text("%u", worker.steals); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+		ImGui::Separator();
+
+		// tile times of the last frame, black to red to yellow, row 0 of the image at the bottom
+		std::vector<TileScheduler::TileTiming> timings = tracer.getTileScheduler().getTimings();
+		int imageWidth = 1, imageHeight = 1;
+		for (const TileScheduler::TileTiming &timing : timings) {
+			imageWidth = std::max(imageWidth, timing.tile.x1);
+			imageHeight = std::max(imageHeight, timing.tile.y1);
+		}
+		float scale = ImGui::GetContentRegionAvail().x / (float)imageWidth;
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImDrawList *drawList = ImGui::GetWindowDrawList();
+		for (const TileScheduler::TileTiming &timing : timings) {
+			float heat = summary.maxTileMs > 0.0 ? (float)(timing.milliseconds / summary.maxTileMs) : 0.0f;
+			ImU32 color = ImGui::ColorConvertFloat4ToU32(ImVec4(std::min(1.0f, heat * 2.0f), std::max(0.0f, heat * 2.0f - 1.0f), 0.0f, 1.0f));
+			ImVec2 min(origin.x + timing.tile.x0 * scale, origin.y + (imageHeight - timing.tile.y1) * scale);
+			ImVec2 max(origin.x + timing.tile.x1 * scale, origin.y + (imageHeight - timing.tile.y0) * scale);
+			drawList->AddRectFilled(min, max, color);
+		}
+		ImGui::Dummy(ImVec2(imageWidth * scale, imageHeight * scale));
+
+		ImGui::End();
+	}
+
+	static void drawPathTracerModeUI(PathTracerMode &mode, const WavefrontPathTracer &wavefront, PersistentPathTracer &persistent,
+		Shader &pathtracingShader) {
+		ImGui::Begin("Path Tracer");
+
+		// same samples either way, a switch still starts the image over
+		int selected = (int)mode;
+		bool changed = ImGui::RadioButton("Megakernel", &selected, (int)PathTracerMode::Megakernel);
+		ImGui::SameLine();
+		changed |= ImGui::RadioButton("Wavefront", &selected, (int)PathTracerMode::Wavefront);
+		ImGui::SameLine();
+		changed |= ImGui::RadioButton("Persistent threads", &selected, (int)PathTracerMode::PersistentThreads);
+		if (changed && selected != (int)mode) {
+			mode = (PathTracerMode)selected;
+			gLink::frame_count = 0.0;
+			pathtracingShader.uniform_floats["iFrame"] = 0.f;
+		}
+		if (wavefront.isCreated())
+			ImGui::Text("Wavefront state %.1f MB", wavefront.memoryBytes() / 1.0e6);
+		if (persistent.isCreated()) {
+			// 0 launches what the device reports it runs at once
+			int groups = persistent.getGroupCount();
+			if (ImGui::SliderInt("Persistent groups", &groups, 0, 4096))
+				persistent.setGroupCount(groups);
+			ImGui::Text("Device fills at %d groups (%s), launched %d", persistent.getDeviceGroupCount(),
+				persistent.isDeviceGroupCountQueried() ? "queried" : "guess", persistent.getLaunchedGroups());
+		}
+		ImGui::TextDisabled("Pass times are in the profiler window");
+
+		ImGui::End();
+	}
+
 	//we want to be able to pass in a shader and add it to a window of all attached shaders
 	//that are being used
 	//void drawattachedShaders(Shader &attachedShader) {
@@ -0,0 +1,229 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "shader.h"
+#include "gpu_profiler.h"
+#include "path_tracer_variant.h"
+
+// Wavefront mode of the path tracer: pathtracing_compute.glsl built as separate passes
+// (WAVEFRONT_PASS) instead of the megakernel main(). Per dispatch, generate writes one path per
+// pixel sample, then every bounce runs extend (TestSceneTrace, hits sorted into one queue per
+// material type) and one shade pass per material type (ShadeHit, survivors requeued), and
+// accumulate blends the samples into the image. The queues live in SSBOs with atomic counters;
+// a one invocation pass turns the counters into the glDispatchComputeIndirect sizes of extend
+// and shade, so the CPU never reads a count back.
+// Each pass keeps far fewer registers live than the megakernel, and a shade pass only runs the
+// code of its material type. The cost is the path and hit state going through memory.
+class WavefrontPathTracer {
+public:
+	WavefrontPathTracer() = default;
+	~WavefrontPathTracer() {
+		cleanup();
+	}
+
+	WavefrontPathTracer(const WavefrontPathTracer&) = delete;
+	WavefrontPathTracer& operator=(const WavefrontPathTracer&) = delete;
+
+	// Builds the passes of the variant from sourcePath. The passes do not count traversal stats.
+	void create(const PathTracerVariant& variant, const char* sourcePath);
+	bool isCreated() const { return generatePass != nullptr; }
+
+	// One dispatch worth of samples into the image on unit 0, the equivalent of one megakernel
+	// dispatch: the scene buffers, textures and FrameUniforms are bound by the caller the same way.
+	// With a profiler each pass is timed as its own stage.
+	void dispatch(int width, int height, const glm::vec3& sceneTranslation, int bvhLayout, GPUProfiler* profiler = nullptr);
+
+	// Bytes of path, hit and queue state allocated for the current resolution
+	size_t memoryBytes() const;
+
+	void cleanup();
+
+private:
+	static const int GROUP_SIZE = 64;   // WAVEFRONT_GROUP_SIZE
+	static const int MATERIAL_TYPES = 3; // diffuse, specular, refractive
+
+	// WavefrontQueueState in the shader
+	struct QueueState {
+		uint32_t rayCount;
+		uint32_t hitCounts[MATERIAL_TYPES];
+		uint32_t extendArgs[3];
+		uint32_t shadeArgs[3 * MATERIAL_TYPES];
+	};
+
+	static const GLuint STATE_BINDING = 19;
+	static const GLuint PATH_BINDING = 20;
+	static const GLuint HIT_BINDING = 21;
+	static const GLuint QUEUE_BINDING = 22;
+	static const size_t PATH_SIZE = 64;  // sizeof WavefrontPath in std430
+	static const size_t HIT_SIZE = 96;   // sizeof WavefrontHit in std430
+
+	std::unique_ptr<Shader> generatePass;
+	std::unique_ptr<Shader> extendPass;
+	std::unique_ptr<Shader> shadePasses[MATERIAL_TYPES];
+	std::unique_ptr<Shader> accumulatePass;
+	std::unique_ptr<Shader> dispatchPass;
+
+	GLuint stateBuffer = 0;
+	GLuint pathBuffer = 0;
+	GLuint hitBuffer = 0;
+	GLuint queueBuffer = 0;
+	uint32_t capacity = 0; // paths the buffers hold
+
+	int maxBounces = 2;
+	int samplesPerDispatch = 1;
+	bool hasRefraction = true;
+
+	void reserve(uint32_t paths);
+	void prepare(Shader& pass, uint32_t paths, const glm::vec3& sceneTranslation, int bvhLayout);
+	void sizeNextPass(int step);
+};
+
+// Implementation
+inline void WavefrontPathTracer::create(const PathTracerVariant& variant, const char* sourcePath) {
+	maxBounces = variant.maxBounces;
+	samplesPerDispatch = variant.samplesPerDispatch;
+	hasRefraction = variant.hasRefraction != 0;
+
+	PathTracerVariant passVariant = variant;
+	passVariant.traversalStats = 0;
+	std::string defines = passVariant.defines();
+	auto pass = [&](const char* name, int passIndex, int material = 0) {
+		std::string passDefines = defines + "#define WAVEFRONT_PASS " + std::to_string(passIndex) + "\n" +
+			"#define WAVEFRONT_MATERIAL " + std::to_string(material) + "\n";
+		return std::make_unique<Shader>(name, sourcePath, passDefines);
+	};
+	generatePass = pass("Wavefront generate", 1);
+	extendPass = pass("Wavefront extend", 2);
+	shadePasses[0] = pass("Wavefront shade diffuse", 3, 0);
+	shadePasses[1] = pass("Wavefront shade specular", 3, 1);
+	if (hasRefraction) shadePasses[2] = pass("Wavefront shade refractive", 3, 2);
+	accumulatePass = pass("Wavefront accumulate", 4);
+	dispatchPass = pass("Wavefront dispatch", 5);
+
+	if (stateBuffer == 0) {
+		glGenBuffers(1, &stateBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, stateBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(QueueState), nullptr, GL_DYNAMIC_DRAW);
+	}
+}
+
+inline void WavefrontPathTracer::reserve(uint32_t paths) {
+	if (paths <= capacity) return;
+	capacity = paths;
+
+	if (pathBuffer == 0) {
+		glGenBuffers(1, &pathBuffer);
+		glGenBuffers(1, &hitBuffer);
+		glGenBuffers(1, &queueBuffer);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pathBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * PATH_SIZE, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, hitBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * HIT_SIZE, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * (1 + MATERIAL_TYPES) * sizeof(uint32_t), nullptr,
+		GL_DYNAMIC_COPY);
+}
+
+inline size_t WavefrontPathTracer::memoryBytes() const {
+	return sizeof(QueueState) + (size_t)capacity * (PATH_SIZE + HIT_SIZE + (1 + MATERIAL_TYPES) * sizeof(uint32_t));
+}
+
+inline void WavefrontPathTracer::prepare(Shader& pass, uint32_t paths, const glm::vec3& sceneTranslation, int bvhLayout) {
+	pass.setVec3("sphereX", sceneTranslation);
+	pass.setInt("bvh_layout", bvhLayout);
+	pass.setInt("wavefront_paths", (int)paths);
+	pass.use();
+	pass.updateUniforms();
+}
+
+inline void WavefrontPathTracer::sizeNextPass(int step) {
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	dispatchPass->use();
+	glUniform1i(dispatchPass->getUniformLocation("wavefront_step"), step);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+inline void WavefrontPathTracer::dispatch(int width, int height, const glm::vec3& sceneTranslation, int bvhLayout,
+	GPUProfiler* profiler) {
+	if (!isCreated() || width <= 0 || height <= 0) return;
+
+	uint32_t pixels = (uint32_t)width * (uint32_t)height;
+	uint32_t paths = pixels * (uint32_t)samplesPerDispatch;
+	reserve(paths);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_BINDING, stateBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PATH_BINDING, pathBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HIT_BINDING, hitBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, QUEUE_BINDING, queueBuffer);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, stateBuffer);
+
+	// every path starts out in the ray queue
+	QueueState state = {};
+	state.rayCount = paths;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, stateBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(state), &state);
+
+	if (profiler) profiler->begin("Wavefront generate");
+	prepare(*generatePass, paths, sceneTranslation, bvhLayout);
+	glDispatchCompute((paths + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+	sizeNextPass(0);
+	if (profiler) profiler->end();
+
+	// rays the last shade queues are never extended, like the megakernel leaving its bounce loop
+	for (int bounce = 0; bounce < maxBounces; bounce++) {
+		if (profiler) profiler->begin("Wavefront extend " + std::to_string(bounce));
+		prepare(*extendPass, paths, sceneTranslation, bvhLayout);
+		glDispatchComputeIndirect((GLintptr)offsetof(QueueState, extendArgs));
+		sizeNextPass(1);
+		if (profiler) profiler->end();
+
+		if (profiler) profiler->begin("Wavefront shade " + std::to_string(bounce));
+		for (int type = 0; type < MATERIAL_TYPES; type++) {
+			if (!shadePasses[type]) continue;
+			prepare(*shadePasses[type], paths, sceneTranslation, bvhLayout);
+			glDispatchComputeIndirect((GLintptr)(offsetof(QueueState, shadeArgs) + type * 3 * sizeof(uint32_t)));
+		}
+		sizeNextPass(0);
+		if (profiler) profiler->end();
+	}
+
+	if (profiler) profiler->begin("Wavefront accumulate");
+	prepare(*accumulatePass, paths, sceneTranslation, bvhLayout);
+	glDispatchCompute((pixels + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	if (profiler) profiler->end();
+}
+
+inline void WavefrontPathTracer::cleanup() {
+	GLuint buffers[] = { stateBuffer, pathBuffer, hitBuffer, queueBuffer };
+	for (GLuint buffer : buffers) {
+		if (buffer != 0) glDeleteBuffers(1, &buffer);
+	}
+	stateBuffer = pathBuffer = hitBuffer = queueBuffer = 0;
+	capacity = 0;
+
+	// The createdShaders entry holds the current program, a pass not used since a hot reload does not
+	auto release = [](std::unique_ptr<Shader>& pass, const char* name) {
+		if (!pass) return;
+		auto created = Shader::createdShaders.find(name);
+		if (created != Shader::createdShaders.end()) {
+			glDeleteProgram(created->second.ID);
+			Shader::createdShaders.erase(created);
+		}
+		pass.reset();
+	};
+	release(generatePass, "Wavefront generate");
+	release(extendPass, "Wavefront extend");
+	release(shadePasses[0], "Wavefront shade diffuse");
+	release(shadePasses[1], "Wavefront shade specular");
+	release(shadePasses[2], "Wavefront shade refractive");
+	release(accumulatePass, "Wavefront accumulate");
+	release(dispatchPass, "Wavefront dispatch");
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <float.h>
+
+#include "bvh_builder.h"
+
+// Marks an unused child slot of a wide node
+const uint32_t WIDE_BVH_EMPTY = 0xFFFFFFFF;
+
+// Four children of a wide node, stored SoA so the shader tests them with vec4 math.
+// A BVH4 node is one packet, a BVH8 node two consecutive packets (must match WideBVHPacket in GLSL).
+struct WideBVHPacket {
+	float minX[4], minY[4], minZ[4];
+	float maxX[4], maxY[4], maxZ[4];
+	uint32_t child[4]; // internal child: index of its wide node, leaf child: first triangle
+	uint32_t count[4]; // 0 for internal children, triangle count for leaves, WIDE_BVH_EMPTY for unused slots
+};
+
+// 4- or 8-wide BVH collapsed from the binary tree. Each wide node keeps the
+// bounds of all its children together, so one fetch tests all of them.
+class WideBVH {
+public:
+	// width is 4 or 8
+	void build(const std::vector<BVHNode>& nodes, int width);
+
+	// Copies the bounds of a refitted binary tree into the existing wide layout
+	void refitFrom(const std::vector<BVHNode>& nodes);
+
+	void clear();
+
+	bool empty() const { return packets.empty(); }
+	int getWidth() const { return width; }
+	size_t getNodeCount() const { return packets.size() / (width / 4); }
+	const std::vector<WideBVHPacket>& getPackets() const { return packets; }
+
+private:
+	int width = 4;
+	std::vector<WideBVHPacket> packets;
+	std::vector<uint32_t> sources; // binary node behind every child slot, WIDE_BVH_EMPTY for unused slots
+
+	void setBounds(uint32_t slot, const BVHNode& node);
+};
+
+// Implementation
+inline void WideBVH::clear() {
+	packets.clear();
+	sources.clear();
+}
+
+inline void WideBVH::setBounds(uint32_t slot, const BVHNode& node) {
+	WideBVHPacket& packet = packets[slot / 4];
+	uint32_t lane = slot % 4;
+	packet.minX[lane] = node.minBounds[0];
+	packet.minY[lane] = node.minBounds[1];
+	packet.minZ[lane] = node.minBounds[2];
+	packet.maxX[lane] = node.maxBounds[0];
+	packet.maxY[lane] = node.maxBounds[1];
+	packet.maxZ[lane] = node.maxBounds[2];
+}
+
+inline void WideBVH::build(const std::vector<BVHNode>& nodes, int width) {
+	this->width = width >= 8 ? 8 : 4;
+	clear();
+	if (nodes.empty()) return;
+
+	uint32_t packetsPerNode = (uint32_t)this->width / 4;
+
+	// Binary node each wide node is collapsed from, in wide node order
+	std::vector<uint32_t> pending;
+	pending.push_back(0);
+
+	std::vector<uint32_t> children;
+	for (size_t wideIndex = 0; wideIndex < pending.size(); wideIndex++) {
+		const BVHNode& source = nodes[pending[wideIndex]];
+
+		children.clear();
+		if (source.leftChild == 0) {
+			// Leaf root, becomes the only child
+			children.push_back(pending[wideIndex]);
+		}
+		else {
+			children.push_back(source.leftChild);
+			children.push_back(source.triangleCount);
+		}
+
+		// Keep opening the internal child with the largest surface area
+		while (children.size() < (size_t)this->width) {
+			int best = -1;
+			float bestArea = -1.0f;
+			for (size_t i = 0; i < children.size(); i++) {
+				const BVHNode& child = nodes[children[i]];
+				if (child.leftChild == 0) continue;
+
+				float dx = child.maxBounds[0] - child.minBounds[0];
+				float dy = child.maxBounds[1] - child.minBounds[1];
+				float dz = child.maxBounds[2] - child.minBounds[2];
+				float area = dx * dy + dy * dz + dz * dx;
+				if (area > bestArea) {
+					bestArea = area;
+					best = (int)i;
+				}
+			}
+			if (best < 0) break;
+
+			const BVHNode& opened = nodes[children[best]];
+			children[best] = opened.leftChild;
+			children.push_back(opened.triangleCount);
+		}
+
+		uint32_t firstSlot = (uint32_t)(wideIndex * packetsPerNode * 4);
+		packets.resize(packets.size() + packetsPerNode);
+		sources.resize(packets.size() * 4, WIDE_BVH_EMPTY);
+
+		for (uint32_t i = 0; i < (uint32_t)this->width; i++) {
+			uint32_t slot = firstSlot + i;
+			WideBVHPacket& packet = packets[slot / 4];
+			uint32_t lane = slot % 4;
+			if (i >= children.size()) {
+				setBounds(slot, BVHNode());
+				packet.child[lane] = 0;
+				packet.count[lane] = WIDE_BVH_EMPTY;
+				continue;
+			}
+
+			const BVHNode& child = nodes[children[i]];
+			setBounds(slot, child);
+			if (child.leftChild == 0) {
+				packet.child[lane] = child.triangleOffset;
+				packet.count[lane] = child.triangleCount;
+			}
+			else {
+				packet.child[lane] = (uint32_t)pending.size();
+				packet.count[lane] = 0;
+				pending.push_back(children[i]);
+			}
+			sources[slot] = children[i];
+		}
+	}
+}
+
+inline void WideBVH::refitFrom(const std::vector<BVHNode>& nodes) {
+	for (uint32_t slot = 0; slot < sources.size(); slot++) {
+		if (sources[slot] != WIDE_BVH_EMPTY) {
+			setBounds(slot, nodes[sources[slot]]);
+		}
+	}
+}